@@ -0,0 +1,25 @@
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Force included (-include) into every file of bin/micro_bench, so the primitives under
+ * test allocate through these counters. The system headers come first, their include
+ * guards keep the macros below from reaching the real declarations.
+ */
+extern size_t bench_allocations;
+
+void *counted_malloc(size_t size);
+void *counted_calloc(size_t count, size_t size);
+void *counted_realloc(void *ptr, size_t size);
+char *counted_strdup(const char *str);
+
+#undef strdup
+#define malloc(size) counted_malloc(size)
+#define calloc(count, size) counted_calloc(count, size)
+#define realloc(ptr, size) counted_realloc(ptr, size)
+#define strdup(str) counted_strdup(str)
+
+#endif
@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "lexer.h"
+#include "parser.h"
+#include "evaluator.h"
+#include "environment.h"
+#include "compiler.h"
+#include "vm.h"
+#include "gc.h"
+#include "repl.h"
+
+/*
+ * Runs Monkey programs through each phase and times them separately.
+ *
+ *   bench [--engine=eval|vm|both] [--runs=N] [--baseline=FILE] program.mk...
+ *
+ * Every program runs in its own process so peak RSS is per program. Output is one tab
+ * separated line per program and engine, after a header line. Phase columns are mean
+ * milliseconds per run, ops_per_sec is whole runs (lex to result) per second. The parser
+ * lexes as it goes, so parse_ms already includes lexing: lex_ms is a lexer-only pass shown
+ * for reference and left out of total_ms. Save the output and pass it back with --baseline
+ * to get each line's speedup against it.
+ */
+
+#define DEFAULT_RUNS 5
+#define MAX_BASELINES 256
+#define LINE_LEN 1024
+
+typedef struct Baseline {
+    char program[256];
+    char engine[8];
+    double total_ms;
+} baseline_t;
+
+static baseline_t baselines[MAX_BASELINES];
+static int baseline_count = 0;
+
+static double now_ms(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static char *read_file(const char *path){
+    FILE *file = fopen(path, "rb");
+    if (file == NULL){
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *source = malloc(length + 1);
+    size_t read = fread(source, 1, length, file);
+    source[read] = '\0';
+    fclose(file);
+    return source;
+}
+
+/*Columns are program, engine, runs, tokens, lex, parse, compile, run, total, ...*/
+static bool load_baseline(const char *path){
+    FILE *file = fopen(path, "r");
+    if (file == NULL){
+        return false;
+    }
+    char line[LINE_LEN];
+    while (fgets(line, sizeof(line), file) != NULL && baseline_count < MAX_BASELINES){
+        baseline_t *baseline = &baselines[baseline_count];
+        int runs, tokens;
+        double lex, parse, compile, run;
+        if (sscanf(line, "%255s\t%7s\t%d\t%d\t%lf\t%lf\t%lf\t%lf\t%lf", baseline->program, baseline->engine,
+                   &runs, &tokens, &lex, &parse, &compile, &run, &baseline->total_ms) == 9){
+            baseline_count++;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+static baseline_t *find_baseline(const char *program, const char *engine){
+    for (int i = 0; i < baseline_count; i++){
+        if (strcmp(baselines[i].program, program) == 0 && strcmp(baselines[i].engine, engine) == 0){
+            return &baselines[i];
+        }
+    }
+    return NULL;
+}
+
+static program_t *parse_source(const char *source){
+    lexer_t *lexer = new_lexer(source);
+    parser_t *parser = new_parser(lexer);
+    program_t *program = parse_program(parser);
+    bool failed = parser->errors->count > 0;
+    free_parser(parser);
+    free_lexer(lexer);
+    if (failed){
+        free_program(program);
+        return NULL;
+    }
+    return program;
+}
+
+static value_t run_eval(program_t *program){
+    size_t roots = gc_save_roots();
+    environment_t *env = new_environment();
+    gc_push_env_root(env);
+    value_t result = eval(program, NODE_PROGRAM, env);
+    gc_restore_roots(roots);
+    return result;
+}
+
+static int bench_program(const char *path, engine_t engine, int runs){
+    char *source = read_file(path);
+    if (source == NULL){
+        fprintf(stderr, "could not read %s\n", path);
+        return 1;
+    }
+
+    int tokens = 0;
+    double start = now_ms();
+    for (int r = 0; r < runs; r++){
+        lexer_t *lexer = new_lexer(source);
+        tokens = 0;
+        while (lexer_next_token(lexer).type != EOF_TOKEN){
+            tokens++;
+        }
+        free_lexer(lexer);
+    }
+    double lex = (now_ms() - start) / runs;
+
+    program_t *program = NULL;
+    start = now_ms();
+    for (int r = 0; r < runs; r++){
+        if (program != NULL){
+            free_program(program);
+        }
+        program = parse_source(source);
+        if (program == NULL){
+            fprintf(stderr, "%s: parse errors\n", path);
+            return 1;
+        }
+    }
+    double parse = (now_ms() - start) / runs;
+
+    double compile = 0, run = 0;
+    value_t result = VALUE_NULL;
+    for (int r = 0; r < runs && !value_is(result, OBJECT_ERROR); r++){
+        if (engine == ENGINE_EVAL){
+            start = now_ms();
+            result = run_eval(program);
+            run += now_ms() - start;
+            continue;
+        }
+        start = now_ms();
+        compiler_t *compiler = new_compiler();
+        if (!compile_program(compiler, program)){
+            print_compiler_errors(compiler);
+            free_compiler(compiler);
+            return 1;
+        }
+        compile += now_ms() - start;
+        start = now_ms();
+        vm_t *vm = new_vm(compiler_bytecode(compiler));
+        result = vm_run(vm);
+        free_vm(vm);
+        run += now_ms() - start;
+        // Otherwise peak RSS grows with --runs and isn't comparable with eval's
+        free_compiler(compiler);
+    }
+    if (value_is(result, OBJECT_ERROR)){
+        fprintf(stderr, "%s: ", path);
+        print_value(result, stderr);
+        fputc('\n', stderr);
+        return 1;
+    }
+    compile /= runs;
+    run /= runs;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double total = parse + compile + run;
+    const char *engine_name = engine == ENGINE_EVAL ? "eval" : "vm";
+    printf("%s\t%s\t%d\t%d\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%.1f\t%ld", path, engine_name, runs, tokens,
+           lex, parse, compile, run, total, 1000 / total, usage.ru_maxrss);
+    baseline_t *baseline = find_baseline(path, engine_name);
+    if (baseline != NULL){
+        printf("\t%.3f\t%.2f", baseline->total_ms, baseline->total_ms / total);
+    } else if (baseline_count > 0){
+        printf("\t-\t-");
+    }
+    printf("\n");
+    return 0;
+}
+
+/*Forked so each program starts from a fresh heap and reports its own peak RSS*/
+static bool bench_in_child(const char *path, engine_t engine, int runs){
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0){
+        int status = bench_program(path, engine, runs);
+        fflush(stdout);
+        _exit(status);
+    }
+    int status;
+    return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static void usage(const char *program){
+    fprintf(stderr, "usage: %s [--engine=eval|vm|both] [--runs=N] [--baseline=FILE] program.mk...\n", program);
+}
+
+int main(int argc, char *argv[]){
+    bool run_eval_engine = true, run_vm_engine = true;
+    int runs = DEFAULT_RUNS;
+    int first_program = argc;
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--engine=eval") == 0){
+            run_vm_engine = false;
+        } else if (strcmp(argv[i], "--engine=vm") == 0){
+            run_eval_engine = false;
+        } else if (strcmp(argv[i], "--engine=both") == 0){
+            run_eval_engine = run_vm_engine = true;
+        } else if (strncmp(argv[i], "--runs=", 7) == 0){
+            runs = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--baseline=", 11) == 0){
+            if (!load_baseline(argv[i] + 11)){
+                fprintf(stderr, "could not read baseline %s\n", argv[i] + 11);
+                return 1;
+            }
+        } else if (argv[i][0] != '-'){
+            first_program = i;
+            break;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (first_program == argc || runs < 1){
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("program\tengine\truns\ttokens\tlex_ms\tparse_ms\tcompile_ms\trun_ms\ttotal_ms\tops_per_sec\tpeak_rss_kb");
+    printf(baseline_count > 0 ? "\tbaseline_ms\tspeedup\n" : "\n");
+    int failed = 0;
+    for (int i = first_program; i < argc; i++){
+        if (run_eval_engine && !bench_in_child(argv[i], ENGINE_EVAL, runs)){
+            failed++;
+        }
+        if (run_vm_engine && !bench_in_child(argv[i], ENGINE_VM, runs)){
+            failed++;
+        }
+    }
+    return failed > 0;
+}
@@ -0,0 +1,16 @@
+let make_adder = fn(x) { fn(y) { x + y } };
+let compose = fn(f, g) { fn(x) { g(f(x)) } };
+let twice = fn(f) { compose(f, f) };
+let accumulate = fn(n, acc) {
+    if (n == 0) {
+        acc
+    } else {
+        let add = make_adder(n);
+        let add_twice = twice(add);
+        accumulate(n - 1, add_twice(acc))
+    }
+};
+let round = fn(i, total) {
+    if (i == 0) { total } else { round(i - 1, total + accumulate(150, 0)) }
+};
+round(300, 0);
@@ -0,0 +1,26 @@
+let map = fn(arr, f) {
+    let iter = fn(arr, acc) {
+        if (len(arr) == 0) { acc } else { iter(rest(arr), push(acc, f(first(arr)))) }
+    };
+    iter(arr, [])
+};
+let reduce = fn(arr, initial, f) {
+    let iter = fn(arr, acc) {
+        if (len(arr) == 0) { acc } else { iter(rest(arr), f(acc, first(arr))) }
+    };
+    iter(arr, initial)
+};
+let range = fn(n) {
+    let iter = fn(i, acc) { if (i == n) { acc } else { iter(i + 1, push(acc, i)) } };
+    iter(0, [])
+};
+let numbers = range(200);
+let round = fn(i, total) {
+    if (i == 0) {
+        total
+    } else {
+        let squares = map(numbers, fn(x) { x * x });
+        round(i - 1, total + reduce(squares, 0, fn(a, b) { a + b }))
+    }
+};
+round(150, 0);
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "hashmap.h"
+#include "vector.h"
+#include "custom_string.h"
+#include "alloc_count.h"
+
+/*
+ * Times the primitives under the evaluator: hash_map_t with short identifier, long and
+ * integer-like keys, vector_t appends and rests, and string_t appends and concats, each
+ * at a few sizes. Output is one tab separated line per operation after a header line:
+ * structure, case, size, operation, ns/op and allocations/op.
+ */
+
+#define MAX_KEYS 100000
+#define KEY_LEN 96
+
+size_t bench_allocations = 0;
+
+#undef malloc
+#undef calloc
+#undef realloc
+#undef strdup
+
+void *counted_malloc(size_t size){
+    bench_allocations++;
+    return malloc(size);
+}
+
+void *counted_calloc(size_t count, size_t size){
+    bench_allocations++;
+    return calloc(count, size);
+}
+
+void *counted_realloc(void *ptr, size_t size){
+    bench_allocations++;
+    return realloc(ptr, size);
+}
+
+char *counted_strdup(const char *str){
+    bench_allocations++;
+    return strdup(str);
+}
+
+typedef struct KeySet {
+    char *name;
+    void (*make)(char *buf, int i);
+} key_set_t;
+
+static void identifier_key(char *buf, int i){
+    snprintf(buf, KEY_LEN, "%c%d", 'a' + i % 26, i / 26);
+}
+
+static void long_key(char *buf, int i){
+    // Shared prefix, so equality checks have to get to the end
+    snprintf(buf, KEY_LEN, "a rather long string key that only differs at the very end: %d", i);
+}
+
+static void integer_key(char *buf, int i){
+    snprintf(buf, KEY_LEN, "%d", i);
+}
+
+static const key_set_t KEY_SETS[] = {
+    {"identifier", identifier_key},
+    {"long", long_key},
+    {"integer", integer_key},
+};
+
+static const int SIZES[] = {10, 1000, MAX_KEYS};
+
+static char keys[MAX_KEYS][KEY_LEN];
+static char missing[MAX_KEYS][KEY_LEN];
+
+typedef struct BenchTimer {
+    double elapsed;
+    size_t allocations;
+    double start;
+    size_t start_allocations;
+} bench_timer_t;
+
+static double now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void timer_start(bench_timer_t *timer){
+    timer->start_allocations = bench_allocations;
+    timer->start = now_ns();
+}
+
+static void timer_stop(bench_timer_t *timer){
+    timer->elapsed += now_ns() - timer->start;
+    timer->allocations += bench_allocations - timer->start_allocations;
+}
+
+static void report(char *structure, char *variant, int size, char *op, bench_timer_t *timer, long ops){
+    printf("%s\t%s\t%d\t%s\t%.1f\t%.3f\n", structure, variant, size, op,
+           timer->elapsed / ops, (double)timer->allocations / ops);
+}
+
+static void bench_hashmap(const key_set_t *key_set, int size){
+    // Repeat small tables so every measurement covers roughly the same number of operations
+    int rounds = MAX_KEYS / size;
+    bench_timer_t insert = {0}, hit = {0}, miss = {0}, delete = {0};
+    uintptr_t checksum = 0;
+
+    for (int r = 0; r < rounds; r++){
+        hash_map_t *map = new_hash_table(NULL);
+
+        timer_start(&insert);
+        for (int i = 0; i < size; i++){
+            hash_set(map, keys[i], (void *)(uintptr_t)(i + 1));
+        }
+        timer_stop(&insert);
+
+        timer_start(&hit);
+        for (int i = 0; i < size; i++){
+            checksum += (uintptr_t)hash_get(map, keys[i]);
+        }
+        timer_stop(&hit);
+
+        timer_start(&miss);
+        for (int i = 0; i < size; i++){
+            checksum += (uintptr_t)hash_get(map, missing[i]);
+        }
+        timer_stop(&miss);
+
+        timer_start(&delete);
+        for (int i = 0; i < size; i++){
+            hash_delete(map, keys[i]);
+        }
+        timer_stop(&delete);
+
+        free_hash(map);
+    }
+
+    long ops = (long)rounds * size;
+    report("hashmap", key_set->name, size, "insert", &insert, ops);
+    report("hashmap", key_set->name, size, "hit", &hit, ops);
+    report("hashmap", key_set->name, size, "miss", &miss, ops);
+    report("hashmap", key_set->name, size, "delete", &delete, ops);
+    if (checksum == 0){
+        printf("unexpected checksum\n");
+    }
+}
+
+static void *same_element(const void *element){
+    return (void *)element;
+}
+
+static void bench_vector(int size){
+    int rounds = MAX_KEYS / size;
+    bench_timer_t append = {0}, rest = {0};
+
+    for (int r = 0; r < rounds; r++){
+        vector_t *vector = create_vector();
+        timer_start(&append);
+        for (int i = 0; i < size; i++){
+            append_vector(vector, keys[i]);
+        }
+        timer_stop(&append);
+
+        timer_start(&rest);
+        vector_t *tail = rest_vector(vector, same_element);
+        timer_stop(&rest);
+
+        free_vector(tail);
+        free_vector(vector);
+    }
+
+    report("vector", "pointer", size, "append", &append, (long)rounds * size);
+    report("vector", "pointer", size, "rest", &rest, rounds);
+}
+
+static void bench_string(int size){
+    int rounds = MAX_KEYS / size;
+    bench_timer_t append = {0}, append_char = {0}, concat = {0}, clone = {0};
+
+    for (int r = 0; r < rounds; r++){
+        string_t *words = string_new();
+        timer_start(&append);
+        for (int i = 0; i < size; i++){
+            string_append(words, "monkey ");
+        }
+        timer_stop(&append);
+
+        string_t *chars = string_new();
+        timer_start(&append_char);
+        for (int i = 0; i < size; i++){
+            string_append_char(chars, 'm');
+        }
+        timer_stop(&append_char);
+
+        timer_start(&concat);
+        string_t *joined = string_concat(chars, chars);
+        timer_stop(&concat);
+
+        timer_start(&clone);
+        string_t *copy = string_clone(chars);
+        timer_stop(&clone);
+
+        string_free(copy);
+        string_free(joined);
+        string_free(chars);
+        string_free(words);
+    }
+
+    report("string", "short", size, "append", &append, (long)rounds * size);
+    report("string", "char", size, "append_char", &append_char, (long)rounds * size);
+    report("string", "char", size, "concat", &concat, rounds);
+    report("string", "char", size, "clone", &clone, rounds);
+}
+
+int main(void){
+    printf("structure\tcase\tsize\top\tns_per_op\tallocs_per_op\n");
+    for (int k = 0; k < sizeof(KEY_SETS) / sizeof(KEY_SETS[0]); k++){
+        for (int i = 0; i < MAX_KEYS; i++){
+            KEY_SETS[k].make(keys[i], i);
+            KEY_SETS[k].make(missing[i], MAX_KEYS + i);
+        }
+        for (int i = 0; i < sizeof(SIZES) / sizeof(SIZES[0]); i++){
+            bench_hashmap(&KEY_SETS[k], SIZES[i]);
+        }
+    }
+    for (int i = 0; i < sizeof(SIZES) / sizeof(SIZES[0]); i++){
+        bench_vector(SIZES[i]);
+    }
+    for (int i = 0; i < sizeof(SIZES) / sizeof(SIZES[0]); i++){
+        bench_string(SIZES[i]);
+    }
+    return 0;
+}
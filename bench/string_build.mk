@@ -0,0 +1,13 @@
+let repeat = fn(s, n, acc) {
+    if (n == 0) { acc } else { repeat(s, n - 1, acc + s) }
+};
+let round = fn(i, total) {
+    if (i == 0) {
+        total
+    } else {
+        let line = repeat("monkey ", 200, "");
+        let doubled = line + line;
+        round(i - 1, total + len(doubled))
+    }
+};
+round(150, 0);
@@ -0,0 +1,27 @@
+let text = ["the", "quick", "brown", "fox", "jumps", "over", "the", "lazy", "dog",
+            "and", "the", "dog", "sleeps", "while", "the", "fox", "runs", "away",
+            "over", "the", "hills", "and", "far", "away", "from", "the", "quick", "dog"];
+let vocabulary = {"the": 0, "quick": 1, "brown": 2, "fox": 3, "jumps": 4, "over": 5,
+                  "lazy": 6, "dog": 7, "and": 8, "sleeps": 9, "while": 10, "runs": 11,
+                  "away": 12, "hills": 13, "far": 14, "from": 15};
+let count = fn(words, word, n) {
+    if (len(words) == 0) {
+        n
+    } else {
+        let hit = if (first(words) == word) { 1 } else { 0 };
+        count(rest(words), word, n + hit)
+    }
+};
+let tally = fn(words, total) {
+    if (len(words) == 0) {
+        total
+    } else {
+        let word = first(words);
+        let counts = {word: count(text, word, 0), "index": vocabulary[word]};
+        tally(rest(words), total + counts[word] * 100 + counts["index"])
+    }
+};
+let round = fn(i, total) {
+    if (i == 0) { total } else { round(i - 1, total + tally(text, 0)) }
+};
+round(150, 0);
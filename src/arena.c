@@ -0,0 +1,75 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+arena_t *new_arena(void){
+    // The first chunk is allocated on first use, so an empty program costs one small struct
+    return calloc(1, sizeof(arena_t));
+}
+
+static arena_chunk_t *new_chunk(size_t capacity){
+    arena_chunk_t *chunk = malloc(sizeof(arena_chunk_t) + capacity);
+    if (chunk == NULL){
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->used = 0;
+    chunk->capacity = capacity;
+    return chunk;
+}
+
+void *arena_alloc(arena_t *arena, size_t size){
+    const size_t align = _Alignof(max_align_t);
+    size = (size + align - 1) & ~(align - 1);
+
+    arena_chunk_t *chunk = arena->chunks;
+    if (chunk == NULL || chunk->capacity - chunk->used < size){
+        // Oversized requests get a chunk of their own behind the current one so it keeps filling
+        if (size > ARENA_CHUNK_SIZE / 4 && chunk != NULL){
+            arena_chunk_t *large = new_chunk(size);
+            if (large == NULL){
+                return NULL;
+            }
+            large->used = size;
+            large->next = chunk->next;
+            chunk->next = large;
+            arena->allocated += size;
+            memset(large->data, 0, size);
+            return large->data;
+        }
+        chunk = new_chunk(size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE);
+        if (chunk == NULL){
+            return NULL;
+        }
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+    }
+
+    void *memory = chunk->data + chunk->used;
+    chunk->used += size;
+    arena->allocated += size;
+    memset(memory, 0, size);
+    return memory;
+}
+
+char *arena_strndup(arena_t *arena, const char *str, size_t len){
+    char *copy = arena_alloc(arena, len + 1);
+    if (copy == NULL){
+        return NULL;
+    }
+    memcpy(copy, str, len);
+    return copy;
+}
+
+void free_arena(arena_t *arena){
+    if (arena == NULL){
+        return;
+    }
+    arena_chunk_t *chunk = arena->chunks;
+    while (chunk != NULL){
+        arena_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
@@ -0,0 +1,32 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/*
+ * Bump allocator for data that all dies at once, like the AST of one program.
+ * Allocations are carved out of large chunks in order, so nodes built together sit
+ * next to each other, and free_arena releases everything without visiting the nodes.
+ * Individual allocations are never freed or resized in place.
+ */
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+typedef struct ArenaChunk {
+	struct ArenaChunk *next;
+	size_t used;
+	size_t capacity;
+	_Alignas(max_align_t) char data[];
+} arena_chunk_t;
+
+typedef struct Arena {
+	arena_chunk_t *chunks; // newest first, allocations come from the head
+	size_t allocated;
+} arena_t;
+
+arena_t *new_arena(void);
+/*Zeroed memory aligned for any type, lives until the arena is freed*/
+void *arena_alloc(arena_t *arena, size_t size);
+char *arena_strndup(arena_t *arena, const char *str, size_t len);
+void free_arena(arena_t *arena);
+
+#endif
@@ -18,9 +18,52 @@ char *program_to_string(program_t *program) {
     return result;
 }
 
+line_table_t new_line_table(const char *source, uint32_t length){
+	return (line_table_t){ .source = source, .length = length };
+}
+
+static void build_line_table(line_table_t *lines, arena_t *arena){
+	const char *end = lines->source + lines->length;
+	uint32_t count = 1;
+	for (const char *p = lines->source; (p = memchr(p, '\n', end - p)) != NULL; p++){
+		count++;
+	}
+	lines->starts = arena_alloc(arena, count * sizeof(uint32_t));
+	lines->starts[0] = 0;
+	lines->count = 1;
+	for (const char *p = lines->source; (p = memchr(p, '\n', end - p)) != NULL; p++){
+		lines->starts[lines->count++] = p + 1 - lines->source;
+	}
+}
+
+source_position_t line_table_position(line_table_t *lines, arena_t *arena, token_t token){
+	// The caller has to know the token came from this source, only a span past its end is caught
+	if (lines->source == NULL || token.offset + token.length > lines->length){
+		return (source_position_t){0};
+	}
+	if (lines->starts == NULL){
+		build_line_table(lines, arena);
+	}
+	// The last line starting at or before the offset
+	uint32_t low = 0, high = lines->count;
+	while (high - low > 1){
+		uint32_t mid = low + (high - low) / 2;
+		if (lines->starts[mid] <= token.offset){
+			low = mid;
+		} else {
+			high = mid;
+		}
+	}
+	return (source_position_t){ .line = low + 1, .column = token.offset - lines->starts[low] + 1 };
+}
+
+source_position_t program_position(program_t *program, token_t token){
+	return line_table_position(&program->lines, program->arena, token);
+}
+
 void token_literal(program_t *program){
 	for (int i = 0; i < program->statements->count; i++){
-		print_token(&((statement_t *)program->statements->data[i])->token);
+		print_token(program->lines.source, ((statement_t *)program->statements->data[i])->token);
 	};
 }
 
@@ -42,16 +85,14 @@ void format_statement(string_t *str_buffer, statement_t *statement) {
 
     switch(statement->type) {
         case LET_STATEMENT: {
-            string_append(str_buffer, statement->token.literal);
-            string_append(str_buffer, " ");
+            string_append(str_buffer, "let ");
             string_append(str_buffer, statement->name.value);
             string_append(str_buffer, " = ");
             format_expression_statement(str_buffer, statement->value);
             break;
         }
         case RETURN_STATEMENT: {
-            string_append(str_buffer, statement->token.literal);
-            string_append(str_buffer, " ");
+            string_append(str_buffer, "return ");
             if (statement->value != NULL){
                 format_expression_statement(str_buffer, statement->value);
             }
@@ -69,14 +110,17 @@ void format_statement(string_t *str_buffer, statement_t *statement) {
 void format_expression_statement(string_t *str, expression_t *expression) {
     switch(expression->type) {
         case IDENT_EXPR:
-            string_append(str, expression->token.literal);
+            string_append(str, expression->ident.value);
             break;
-        case INTEGER_LITERAL:
-            string_append(str, expression->token.literal);
+        case INTEGER_LITERAL: {
+            char digits[16];
+            snprintf(digits, sizeof(digits), "%d", expression->integer);
+            string_append(str, digits);
             break;
+        }
         case PREFIX_EXPR:
             string_append(str, "(");
-            string_append(str, expression->prefix_expression.op);
+            string_append(str, operator_to_string(expression->prefix_expression.op));
             format_expression_statement(str, expression->prefix_expression.right);
             string_append(str, ")");
             break;
@@ -84,13 +128,13 @@ void format_expression_statement(string_t *str, expression_t *expression) {
             string_append(str, "(");
             format_expression_statement(str, expression->infix_expression.left);
             string_append(str, " ");
-            string_append(str, expression->infix_expression.op);
+            string_append(str, operator_to_string(expression->infix_expression.op));
             string_append(str, " ");
             format_expression_statement(str, expression->infix_expression.right);
             string_append(str, ")");
             break;
         case BOOLEAN_EXPR:
-            string_append(str, expression->token.literal);
+            string_append(str, expression->boolean ? "true" : "false");
             break;
         case IF_EXPR:
             string_append(str, "if");
@@ -103,11 +147,10 @@ void format_expression_statement(string_t *str, expression_t *expression) {
             }
             break;
         case FUNCTION_LITERAL:
-            string_append(str, expression->token.literal);
-            string_append(str, "(");
+            string_append(str, "fn(");
             for (size_t i = 0; i < expression->function_literal.parameters->count; i++) {
                 identifier_t *ident = (identifier_t *)expression->function_literal.parameters->data[i];
-                string_append(str, ident->token.literal);
+                string_append(str, ident->value);
                 if (i < expression->function_literal.parameters->count - 1) {
                     string_append(str, ", ");
                 }
@@ -129,7 +172,7 @@ void format_expression_statement(string_t *str, expression_t *expression) {
             break;
         case STRING_LITERAL:
             string_append(str, "\"");
-            string_append(str, expression->token.literal);
+            string_append(str, expression->string_literal->data);
             string_append(str, "\"");
             break;
         case ARRAY_LITERAL:
@@ -184,16 +227,19 @@ void format_block_statement(string_t *str, block_statement_t *block) {
     }
 }
 
-expression_t *new_expression(expression_type_t type, token_t token){
-    expression_t *expression = malloc(sizeof(expression_t));
+expression_t *new_expression(arena_t *arena, expression_type_t type, token_t token){
+    expression_t *expression = arena_alloc(arena, sizeof(expression_t));
+    if (expression == NULL){
+        return NULL;
+    }
     expression->token = token;
     expression->type = type;
     expression->node_type = NODE_EXPRESSION;
     return expression;
 }
 
-statement_t *new_statement(statement_type_t type){
-    statement_t *statement = malloc(sizeof(statement_t));
+statement_t *new_statement(arena_t *arena, statement_type_t type){
+    statement_t *statement = arena_alloc(arena, sizeof(statement_t));
     if (statement == NULL){
         return NULL;
     }
@@ -202,9 +248,12 @@ statement_t *new_statement(statement_type_t type){
     return statement;
 }
 
-block_statement_t *new_block_statement(){
-    block_statement_t *block_statement = malloc(sizeof(block_statement_t));
-    block_statement->statements = create_vector();
+block_statement_t *new_block_statement(arena_t *arena){
+    block_statement_t *block_statement = arena_alloc(arena, sizeof(block_statement_t));
+    if (block_statement == NULL){
+        return NULL;
+    }
+    block_statement->statements = create_arena_vector(arena);
     block_statement->node_type = NODE_BLOCK_STATEMENT;
     return block_statement;
 }
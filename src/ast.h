@@ -5,6 +5,7 @@
 #include "token.h"
 #include "custom_string.h"
 #include "vector.h"
+#include "arena.h"
 
 typedef enum {
 	NODE_EXPRESSION,
@@ -34,20 +35,26 @@ typedef enum {
 	INDEX_EXPR,
 } expression_type_t;
 
+#define UNRESOLVED_SLOT -1
+
 typedef struct Identifier {
 	token_t token;
-	char *value;
+	const char *value; // interned, see intern.h
+	/*Filled in by the resolver: frames to walk outwards and the slot within that frame*/
+	int depth;
+	int slot;
+	int builtin; // builtin registry index + 1 for a global naming a builtin, 0 otherwise
 } identifier_t;
 
 typedef struct Expression expression_t;
 
 typedef struct PrefixExpression {
-	char *op;
+	TokenType op;
 	expression_t *right;
 } prefix_expression_t;
 
 typedef struct InfixExpression {
-	char *op;
+	TokenType op;
 	expression_t *right;
 	expression_t *left;
 } infix_expression_t;
@@ -64,6 +71,12 @@ typedef struct IfExpression {
 typedef struct FunctionLiteral {
 	block_statement_t *body;
 	vector_t *parameters;
+	/*Parameters followed by every let in the body, set by the resolver*/
+	int num_locals;
+	/*Whether the body creates closures, which keep the call frame alive past the call*/
+	bool frame_escapes;
+	/*Interned, the let binding's name or fn@ and the literal's source position*/
+	const char *name;
 } function_literal_t;
 
 typedef struct ArrayLiteral {
@@ -84,6 +97,8 @@ typedef struct ParserHashLiteral {
 typedef struct CallExpression {
 	expression_t *function;
 	vector_t *arguments;
+	/*Set by the resolver when the call's value is what its function returns*/
+	bool tail;
 } call_expression_t;
 
 typedef struct IndexExpression {
@@ -126,19 +141,44 @@ typedef struct BlockStatement {
 	vector_t *statements;
 } block_statement_t;
 
+/*Where each line of a source starts, built on the first lookup so lexing stays one pass*/
+typedef struct LineTable{
+	const char *source;
+	uint32_t length;
+	uint32_t *starts; // Arena allocated, NULL until the first lookup
+	uint32_t count;
+} line_table_t;
+
+/*1-based, columns count bytes. Line 0 means the position is unknown*/
+typedef struct SourcePosition{
+	uint32_t line;
+	uint32_t column;
+} source_position_t;
+
+line_table_t new_line_table(const char *source, uint32_t length);
+source_position_t line_table_position(line_table_t *lines, arena_t *arena, token_t token);
+
 typedef struct Program{
 	node_type_t node_type;
 	vector_t *statements;
+	/*Owns every node, name and vector of the tree, freed all at once by free_program*/
+	arena_t *arena;
+	/*Function objects made by the evaluator point into the tree, so it must outlive them*/
+	bool has_function_literals;
+	/*Nodes keep their token, whose offset this maps back to a line and column*/
+	line_table_t lines;
 } program_t;
 
+source_position_t program_position(program_t *program, token_t token);
+
 void token_literal(program_t *program);
 void format_statement(string_t *str_buffer, statement_t *statement);
 void format_expression_statement(string_t *str, expression_t *expression);
 void format_block_statement(string_t *str, block_statement_t *block);
 void ast_string(string_t *format_buffer, program_t *program);
 char *program_to_string(program_t *program);
-expression_t *new_expression(expression_type_t type, token_t token);
-statement_t *new_statement(statement_type_t type);
-block_statement_t *new_block_statement();
+expression_t *new_expression(arena_t *arena, expression_type_t type, token_t token);
+statement_t *new_statement(arena_t *arena, statement_type_t type);
+block_statement_t *new_block_statement(arena_t *arena);
 expression_t *parser_hash_get_value(parser_hash_literal_t *hash, expression_t *key);
 #endif
@@ -0,0 +1,204 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "code.h"
+#include "custom_string.h"
+
+static const definition_t DEFINITIONS[OPCODE_COUNT] = {
+    [OP_CONSTANT]        = {"OpConstant", 1, {2}},
+    [OP_POP]             = {"OpPop", 0, {0}},
+    [OP_ADD]             = {"OpAdd", 0, {0}},
+    [OP_SUB]             = {"OpSub", 0, {0}},
+    [OP_MUL]             = {"OpMul", 0, {0}},
+    [OP_DIV]             = {"OpDiv", 0, {0}},
+    [OP_TRUE]            = {"OpTrue", 0, {0}},
+    [OP_FALSE]           = {"OpFalse", 0, {0}},
+    [OP_NULL]            = {"OpNull", 0, {0}},
+    [OP_EQUAL]           = {"OpEqual", 0, {0}},
+    [OP_NOT_EQUAL]       = {"OpNotEqual", 0, {0}},
+    [OP_GREATER_THAN]    = {"OpGreaterThan", 0, {0}},
+    [OP_LESS_THAN]       = {"OpLessThan", 0, {0}},
+    [OP_MINUS]           = {"OpMinus", 0, {0}},
+    [OP_BANG]            = {"OpBang", 0, {0}},
+    [OP_JUMP_NOT_TRUTHY] = {"OpJumpNotTruthy", 1, {2}},
+    [OP_JUMP]            = {"OpJump", 1, {2}},
+    [OP_GET_GLOBAL]      = {"OpGetGlobal", 1, {2}},
+    [OP_SET_GLOBAL]      = {"OpSetGlobal", 1, {2}},
+    [OP_GET_LOCAL]       = {"OpGetLocal", 1, {1}},
+    [OP_SET_LOCAL]       = {"OpSetLocal", 1, {1}},
+    [OP_GET_BUILTIN]     = {"OpGetBuiltin", 1, {1}},
+    [OP_GET_FREE]        = {"OpGetFree", 1, {1}},
+    [OP_CURRENT_CLOSURE] = {"OpCurrentClosure", 0, {0}},
+    [OP_ARRAY]           = {"OpArray", 1, {2}},
+    [OP_HASH]            = {"OpHash", 1, {2}},
+    [OP_INDEX]           = {"OpIndex", 0, {0}},
+    [OP_CALL]            = {"OpCall", 1, {1}},
+    [OP_RETURN_VALUE]    = {"OpReturnValue", 0, {0}},
+    [OP_RETURN]          = {"OpReturn", 0, {0}},
+    [OP_CLOSURE]         = {"OpClosure", 2, {2, 1}},
+};
+
+const definition_t *lookup_definition(opcode_t op){
+    if (op < 0 || op >= OPCODE_COUNT){
+        return NULL;
+    }
+    return &DEFINITIONS[op];
+}
+
+instructions_t *new_instructions(void){
+    instructions_t *instructions = malloc(sizeof(instructions_t));
+    if (instructions == NULL){
+        return NULL;
+    }
+    instructions->cap = 16;
+    instructions->len = 0;
+    instructions->data = malloc(instructions->cap);
+    instructions->positions = NULL;
+    instructions->positions_len = 0;
+    instructions->positions_cap = 0;
+    return instructions;
+}
+
+void free_instructions(instructions_t *instructions){
+    if (instructions == NULL) return;
+    free(instructions->data);
+    free(instructions->positions);
+    free(instructions);
+}
+
+static void instructions_reserve(instructions_t *instructions, size_t extra){
+    size_t needed = instructions->len + extra;
+    if (needed <= instructions->cap){
+        return;
+    }
+    size_t new_cap = instructions->cap;
+    while (new_cap < needed){
+        new_cap *= 2;
+    }
+    instructions->data = realloc(instructions->data, new_cap);
+    instructions->cap = new_cap;
+}
+
+size_t emit_instruction(instructions_t *instructions, opcode_t op, ...){
+    const definition_t *def = lookup_definition(op);
+    size_t position = instructions->len;
+
+    instructions_reserve(instructions, 1 + MAX_OPERANDS * 2);
+    instructions->data[instructions->len++] = (uint8_t)op;
+
+    va_list operands;
+    va_start(operands, op);
+    for (int i = 0; i < def->operand_count; i++){
+        int operand = va_arg(operands, int);
+        switch (def->operand_widths[i]){
+            case 2:
+                instructions->data[instructions->len++] = (uint8_t)((operand >> 8) & 0xff);
+                instructions->data[instructions->len++] = (uint8_t)(operand & 0xff);
+                break;
+            case 1:
+                instructions->data[instructions->len++] = (uint8_t)(operand & 0xff);
+                break;
+        }
+    }
+    va_end(operands);
+
+    return position;
+}
+
+static void append_position(instructions_t *instructions, instruction_position_t position){
+    // Entries past the end belong to instructions that were removed again
+    while (instructions->positions_len > 0
+            && instructions->positions[instructions->positions_len - 1].offset >= position.offset){
+        instructions->positions_len--;
+    }
+    if (instructions->positions_len > 0){
+        instruction_position_t *last = &instructions->positions[instructions->positions_len - 1];
+        if (last->line == position.line && last->column == position.column){
+            return;
+        }
+    }
+    if (instructions->positions_len == instructions->positions_cap){
+        instructions->positions_cap = instructions->positions_cap == 0 ? 8 : instructions->positions_cap * 2;
+        instructions->positions = realloc(instructions->positions,
+                instructions->positions_cap * sizeof(instruction_position_t));
+    }
+    instructions->positions[instructions->positions_len++] = position;
+}
+
+void instructions_concat(instructions_t *dest, const instructions_t *src){
+    size_t base = dest->len;
+    instructions_reserve(dest, src->len);
+    memcpy(dest->data + dest->len, src->data, src->len);
+    dest->len += src->len;
+    for (size_t i = 0; i < src->positions_len; i++){
+        instruction_position_t position = src->positions[i];
+        position.offset += base;
+        append_position(dest, position);
+    }
+}
+
+/*Instructions emitted from here on came from line:column, line 0 when that isn't known*/
+void instructions_mark_position(instructions_t *instructions, uint32_t line, uint32_t column){
+    append_position(instructions, (instruction_position_t){
+        .offset = instructions->len,
+        .line = line,
+        .column = column,
+    });
+}
+
+bool instructions_position(const instructions_t *instructions, size_t offset, uint32_t *line, uint32_t *column){
+    // The last entry starting at or before the offset
+    size_t low = 0, high = instructions->positions_len;
+    while (low < high){
+        size_t mid = low + (high - low) / 2;
+        if (instructions->positions[mid].offset <= offset){
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == 0 || instructions->positions[low - 1].line == 0){
+        return false;
+    }
+    *line = instructions->positions[low - 1].line;
+    *column = instructions->positions[low - 1].column;
+    return true;
+}
+
+uint16_t read_uint16(const uint8_t *ins){
+    return (uint16_t)((ins[0] << 8) | ins[1]);
+}
+
+uint8_t read_uint8(const uint8_t *ins){
+    return ins[0];
+}
+
+string_t *instructions_to_string(const instructions_t *instructions){
+    string_t *out = string_new();
+    char line[128];
+    size_t i = 0;
+    while (i < instructions->len){
+        const definition_t *def = lookup_definition(instructions->data[i]);
+        if (def == NULL){
+            snprintf(line, sizeof(line), "ERROR: opcode %d undefined\n", instructions->data[i]);
+            string_append(out, line);
+            i++;
+            continue;
+        }
+
+        int written = snprintf(line, sizeof(line), "%04zu %s", i, def->name);
+        size_t offset = i + 1;
+        for (int j = 0; j < def->operand_count; j++){
+            int operand = def->operand_widths[j] == 2
+                ? read_uint16(instructions->data + offset)
+                : read_uint8(instructions->data + offset);
+            written += snprintf(line + written, sizeof(line) - written, " %d", operand);
+            offset += def->operand_widths[j];
+        }
+        string_append(out, line);
+        string_append_char(out, '\n');
+        i = offset;
+    }
+    return out;
+}
@@ -0,0 +1,82 @@
+#ifndef CODE_H
+#define CODE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "custom_string.h"
+
+/*Bytecode for the VM backend - one opcode byte followed by big endian operands*/
+typedef enum {
+	OP_CONSTANT,
+	OP_POP,
+	OP_ADD,
+	OP_SUB,
+	OP_MUL,
+	OP_DIV,
+	OP_TRUE,
+	OP_FALSE,
+	OP_NULL,
+	OP_EQUAL,
+	OP_NOT_EQUAL,
+	OP_GREATER_THAN,
+	OP_LESS_THAN,
+	OP_MINUS,
+	OP_BANG,
+	OP_JUMP_NOT_TRUTHY,
+	OP_JUMP,
+	OP_GET_GLOBAL,
+	OP_SET_GLOBAL,
+	OP_GET_LOCAL,
+	OP_SET_LOCAL,
+	OP_GET_BUILTIN,
+	OP_GET_FREE,
+	OP_CURRENT_CLOSURE,
+	OP_ARRAY,
+	OP_HASH,
+	OP_INDEX,
+	OP_CALL,
+	OP_RETURN_VALUE,
+	OP_RETURN,
+	OP_CLOSURE,
+
+	OPCODE_COUNT,
+} opcode_t;
+
+#define MAX_OPERANDS 2
+
+typedef struct Definition {
+	const char *name;
+	int operand_count;
+	int operand_widths[MAX_OPERANDS];
+} definition_t;
+
+/*The bytecode from offset up to the next entry's offset was compiled from line:column*/
+typedef struct InstructionPosition {
+	uint32_t offset;
+	uint32_t line;
+	uint32_t column;
+} instruction_position_t;
+
+typedef struct Instructions {
+	uint8_t *data;
+	size_t len;
+	size_t cap;
+	// Only where the position changes, so straight line code from one expression is one entry
+	instruction_position_t *positions;
+	size_t positions_len;
+	size_t positions_cap;
+} instructions_t;
+
+const definition_t *lookup_definition(opcode_t op);
+instructions_t *new_instructions(void);
+void free_instructions(instructions_t *instructions);
+size_t emit_instruction(instructions_t *instructions, opcode_t op, ...);
+void instructions_concat(instructions_t *dest, const instructions_t *src);
+void instructions_mark_position(instructions_t *instructions, uint32_t line, uint32_t column);
+bool instructions_position(const instructions_t *instructions, size_t offset, uint32_t *line, uint32_t *column);
+string_t *instructions_to_string(const instructions_t *instructions);
+uint16_t read_uint16(const uint8_t *ins);
+uint8_t read_uint8(const uint8_t *ins);
+
+#endif
@@ -0,0 +1,604 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "compiler.h"
+#include "ast.h"
+#include "code.h"
+#include "object.h"
+#include "symbol_table.h"
+#include "intern.h"
+#include "stats.h"
+#include "vector.h"
+
+static bool compile_statement(compiler_t *compiler, statement_t *statement);
+static bool compile_expression(compiler_t *compiler, expression_t *expression, const char *binding_name);
+static bool compile_expression_node(compiler_t *compiler, expression_t *expression, const char *binding_name);
+static bool compile_block_statement(compiler_t *compiler, block_statement_t *block);
+
+static void compiler_error(compiler_t *compiler, const char *format, ...){
+    char error[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(error, sizeof(error), format, args);
+    va_end(args);
+    append_vector(compiler->errors, strdup(error));
+}
+
+static source_position_t token_position(compiler_t *compiler, token_t token){
+    return compiler->program == NULL
+        ? (source_position_t){0}
+        : program_position(compiler->program, token);
+}
+
+/*Like compiler_error, prefixed with the token's line:column when it is from the program being compiled*/
+static void compiler_error_at(compiler_t *compiler, token_t token, const char *format, ...){
+    char error[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(error, sizeof(error), format, args);
+    va_end(args);
+    source_position_t position = token_position(compiler, token);
+    if (position.line == 0){
+        compiler_error(compiler, "%s", error);
+    } else {
+        compiler_error(compiler, "%u:%u: %s", position.line, position.column, error);
+    }
+}
+
+static bool same_key(void *a, void *b){
+    return a == b;
+}
+
+symbol_table_t *new_global_symbol_table(void){
+    symbol_table_t *symbol_table = new_symbol_table();
+    for (int i = 0; i < builtin_count(); i++){
+        symbol_define_builtin(symbol_table, i, builtin_name(i));
+    }
+    return symbol_table;
+}
+
+void restore_global_state(symbol_table_t *symbol_table, vector_t *constants, int num_definitions, size_t num_constants){
+    symbol_forget_globals(symbol_table, num_definitions);
+    // A let can shadow a builtin, whose symbol it replaced
+    for (int i = 0; i < builtin_count(); i++){
+        if (symbol_resolve(symbol_table, builtin_name(i)) == NULL){
+            symbol_define_builtin(symbol_table, i, builtin_name(i));
+        }
+    }
+    constants->count = num_constants;
+}
+
+compiler_t *new_compiler_with_state(symbol_table_t *symbol_table, vector_t *constants){
+    compiler_t *compiler = malloc(sizeof(compiler_t));
+    if (compiler == NULL){
+        return NULL;
+    }
+    compiler->constants = constants;
+    compiler->symbol_table = symbol_table;
+    compiler->owns_state = false;
+    compiler->errors = create_vector();
+    compiler->program = NULL;
+    compiler->token = (token_t){0};
+    compiler->integer_constants = new_keyed_hash_table(same_key, NULL);
+
+    compiler->scopes_capacity = 8;
+    compiler->scopes = malloc(sizeof(compilation_scope_t) * compiler->scopes_capacity);
+    compiler->scope_index = 0;
+    compiler->scopes[0] = (compilation_scope_t){ .instructions = new_instructions() };
+    return compiler;
+}
+
+compiler_t *new_compiler(void){
+    compiler_t *compiler = new_compiler_with_state(new_global_symbol_table(), create_vector());
+    compiler->owns_state = true;
+    return compiler;
+}
+
+void free_compiler(compiler_t *compiler){
+    if (compiler == NULL){
+        return;
+    }
+    for (int i = 0; i <= compiler->scope_index; i++){
+        free_instructions(compiler->scopes[i].instructions);
+    }
+    free(compiler->scopes);
+    for (int i = 0; i < compiler->errors->count; i++){
+        free(compiler->errors->data[i]);
+    }
+    free_vector(compiler->errors);
+    free_hash(compiler->integer_constants);
+    if (compiler->owns_state){
+        free_symbol_table(compiler->symbol_table);
+        // Compiled functions are immortal, nothing else frees them or their instructions
+        for (size_t i = 0; i < compiler->constants->count; i++){
+            value_t constant = value_from_ptr(compiler->constants->data[i]);
+            if (value_is(constant, OBJECT_COMPILED_FUNCTION)){
+                free_instructions(value_as_object(constant)->compiled_function.instructions);
+                free(value_as_object(constant));
+            }
+        }
+        free_vector(compiler->constants);
+    }
+    free(compiler);
+}
+
+static compilation_scope_t *current_scope(compiler_t *compiler){
+    return &compiler->scopes[compiler->scope_index];
+}
+
+static instructions_t *current_instructions(compiler_t *compiler){
+    return current_scope(compiler)->instructions;
+}
+
+/*Heap constants are immortal, they live as long as the bytecode that refers to them*/
+static int add_constant(compiler_t *compiler, value_t constant){
+    append_vector(compiler->constants, value_to_ptr(constant));
+    return compiler->constants->count - 1;
+}
+
+static int add_integer_constant(compiler_t *compiler, value_t constant){
+    uint64_t hash = constant.bits * 0x9E3779B97F4A7C15ULL;
+    intptr_t index = (intptr_t)hash_get_hashed(compiler->integer_constants, value_to_ptr(constant), hash);
+    if (index == 0){
+        index = add_constant(compiler, constant) + 1;
+        hash_set_hashed(compiler->integer_constants, value_to_ptr(constant), hash, (void *)index);
+    }
+    return index - 1;
+}
+
+/*The error for an operand that doesn't fit, given the largest count the operand allows*/
+static void operand_error(compiler_t *compiler, opcode_t op, int operand_index, int limit){
+    switch (op){
+        case OP_CONSTANT:
+            compiler_error_at(compiler, compiler->token, "too many constants, at most %d", limit);
+            break;
+        case OP_CLOSURE:
+            if (operand_index == 0){
+                compiler_error_at(compiler, compiler->token, "too many constants, at most %d", limit);
+            } else {
+                compiler_error_at(compiler, compiler->token, "too many free variables in one closure, at most %d", limit - 1);
+            }
+            break;
+        case OP_JUMP:
+        case OP_JUMP_NOT_TRUTHY:
+            compiler_error_at(compiler, compiler->token, "function too long to jump within, at most %d bytes of bytecode", limit);
+            break;
+        case OP_GET_GLOBAL:
+        case OP_SET_GLOBAL:
+            compiler_error_at(compiler, compiler->token, "too many globals, at most %d", limit);
+            break;
+        case OP_GET_LOCAL:
+        case OP_SET_LOCAL:
+            compiler_error_at(compiler, compiler->token, "too many local bindings in one function, at most %d", limit);
+            break;
+        case OP_GET_BUILTIN:
+            compiler_error_at(compiler, compiler->token, "too many builtins, at most %d", limit);
+            break;
+        case OP_GET_FREE:
+            compiler_error_at(compiler, compiler->token, "too many free variables in one closure, at most %d", limit);
+            break;
+        case OP_ARRAY:
+            compiler_error_at(compiler, compiler->token, "too many elements in one array literal, at most %d", limit - 1);
+            break;
+        case OP_HASH:
+            compiler_error_at(compiler, compiler->token, "too many pairs in one hash literal, at most %d", (limit - 1) / 2);
+            break;
+        case OP_CALL:
+            compiler_error_at(compiler, compiler->token, "too many arguments in one call, at most %d", limit - 1);
+            break;
+        default:
+            compiler_error_at(compiler, compiler->token, "operand %d of %s out of range", operand_index, lookup_definition(op)->name);
+            break;
+    }
+}
+
+/*Operands are fixed width, so one that doesn't fit is an error instead of being silently truncated*/
+static bool check_operand(compiler_t *compiler, opcode_t op, int operand_index, int operand){
+    int limit = 1 << (8 * lookup_definition(op)->operand_widths[operand_index]);
+    if (operand >= 0 && operand < limit){
+        return true;
+    }
+    operand_error(compiler, op, operand_index, limit);
+    return false;
+}
+
+static size_t emit(compiler_t *compiler, opcode_t op, int operand_a, int operand_b){
+    compilation_scope_t *scope = current_scope(compiler);
+    const definition_t *def = lookup_definition(op);
+    int operands[MAX_OPERANDS] = {operand_a, operand_b};
+    for (int i = 0; i < def->operand_count; i++){
+        check_operand(compiler, op, i, operands[i]);
+    }
+    // So VM runtime errors can point at the node the instruction was compiled from
+    source_position_t source = token_position(compiler, compiler->token);
+    instructions_mark_position(scope->instructions, source.line, source.column);
+    size_t position = emit_instruction(scope->instructions, op, operand_a, operand_b);
+    scope->previous_instruction = scope->last_instruction;
+    scope->last_instruction = (emitted_instruction_t){ .opcode = op, .position = position };
+    return position;
+}
+
+static bool last_instruction_is(compiler_t *compiler, opcode_t op){
+    compilation_scope_t *scope = current_scope(compiler);
+    if (scope->instructions->len == 0){
+        return false;
+    }
+    return scope->last_instruction.opcode == op;
+}
+
+static void remove_last_pop(compiler_t *compiler){
+    compilation_scope_t *scope = current_scope(compiler);
+    scope->instructions->len = scope->last_instruction.position;
+    scope->last_instruction = scope->previous_instruction;
+}
+
+/*Jump targets are unknown until the branch is compiled, so patch the operand afterwards*/
+static bool change_operand(compiler_t *compiler, size_t position, int operand){
+    uint8_t *ins = current_instructions(compiler)->data + position;
+    if (!check_operand(compiler, ins[0], 0, operand)){
+        return false;
+    }
+    ins[1] = (uint8_t)((operand >> 8) & 0xff);
+    ins[2] = (uint8_t)(operand & 0xff);
+    return true;
+}
+
+static void enter_scope(compiler_t *compiler){
+    if (compiler->scope_index + 1 >= compiler->scopes_capacity){
+        compiler->scopes_capacity *= 2;
+        compiler->scopes = realloc(compiler->scopes, sizeof(compilation_scope_t) * compiler->scopes_capacity);
+    }
+    compiler->scope_index++;
+    compiler->scopes[compiler->scope_index] = (compilation_scope_t){ .instructions = new_instructions() };
+    compiler->symbol_table = new_enclosed_symbol_table(compiler->symbol_table);
+}
+
+/*Hands back the scope's instructions, the caller frees its symbol table once done with it*/
+static instructions_t *leave_scope(compiler_t *compiler){
+    instructions_t *instructions = current_instructions(compiler);
+    compiler->scope_index--;
+    compiler->symbol_table = compiler->symbol_table->outer;
+    return instructions;
+}
+
+/*Leaves a scope whose function failed to compile, so the compiler is back where it was*/
+static bool abandon_scope(compiler_t *compiler){
+    symbol_table_t *table = compiler->symbol_table;
+    free_instructions(leave_scope(compiler));
+    free_symbol_table(table);
+    return false;
+}
+
+static void load_symbol(compiler_t *compiler, symbol_t *symbol){
+    switch (symbol->scope){
+        case SCOPE_GLOBAL:
+            emit(compiler, OP_GET_GLOBAL, symbol->index, 0);
+            break;
+        case SCOPE_LOCAL:
+            emit(compiler, OP_GET_LOCAL, symbol->index, 0);
+            break;
+        case SCOPE_BUILTIN:
+            emit(compiler, OP_GET_BUILTIN, symbol->index, 0);
+            break;
+        case SCOPE_FREE:
+            emit(compiler, OP_GET_FREE, symbol->index, 0);
+            break;
+        case SCOPE_FUNCTION:
+            emit(compiler, OP_CURRENT_CLOSURE, 0, 0);
+            break;
+    }
+}
+
+static bool infix_opcode(TokenType op, opcode_t *out){
+    switch (op){
+        case PLUS: *out = OP_ADD; return true;
+        case MINUS: *out = OP_SUB; return true;
+        case ASTERISK: *out = OP_MUL; return true;
+        case SLASH: *out = OP_DIV; return true;
+        case GT: *out = OP_GREATER_THAN; return true;
+        case LT: *out = OP_LESS_THAN; return true;
+        case EQ: *out = OP_EQUAL; return true;
+        case NOT_EQ: *out = OP_NOT_EQUAL; return true;
+        default: return false;
+    }
+}
+
+bool compile_program(compiler_t *compiler, program_t *program){
+    bool compiled = true;
+    compiler->program = program;
+    stats_enter(PHASE_COMPILE);
+    // Top-level lets get their slots up front so functions can refer to globals defined after them
+    if (compiler->symbol_table->outer == NULL){
+        for (int i = 0; i < program->statements->count; i++){
+            statement_t *statement = program->statements->data[i];
+            if (statement->type == LET_STATEMENT){
+                symbol_define(compiler->symbol_table, statement->name.value);
+            }
+        }
+    }
+    for (int i = 0; i < program->statements->count && compiled; i++){
+        compiled = compile_statement(compiler, program->statements->data[i]);
+    }
+    stats_leave();
+    compiler->program = NULL;
+    return compiled;
+}
+
+static bool compile_block_statement(compiler_t *compiler, block_statement_t *block){
+    for (int i = 0; i < block->statements->count; i++){
+        if (!compile_statement(compiler, block->statements->data[i])){
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool compile_statement_node(compiler_t *compiler, statement_t *statement);
+
+/*
+ * emit and change_operand report operands that don't fit as errors without failing the
+ * call, so statements and expressions also fail if they added an error. The node's
+ * token is where those errors point.
+ */
+static bool compile_statement(compiler_t *compiler, statement_t *statement){
+    token_t enclosing = compiler->token;
+    int errors = compiler->errors->count;
+    compiler->token = statement->token;
+    bool compiled = compile_statement_node(compiler, statement) && compiler->errors->count == errors;
+    compiler->token = enclosing;
+    return compiled;
+}
+
+static bool compile_expression(compiler_t *compiler, expression_t *expression, const char *binding_name){
+    token_t enclosing = compiler->token;
+    int errors = compiler->errors->count;
+    if (expression != NULL){
+        compiler->token = expression->token;
+    }
+    bool compiled = compile_expression_node(compiler, expression, binding_name) && compiler->errors->count == errors;
+    compiler->token = enclosing;
+    return compiled;
+}
+
+static bool compile_statement_node(compiler_t *compiler, statement_t *statement){
+    switch (statement->type){
+        case EXPRESSION_STATEMENT:
+            if (!compile_expression(compiler, statement->value, NULL)){
+                return false;
+            }
+            emit(compiler, OP_POP, 0, 0);
+            return true;
+        case LET_STATEMENT: {
+            if (!compile_expression(compiler, statement->value, statement->name.value)){
+                return false;
+            }
+            symbol_t *symbol = symbol_define(compiler->symbol_table, statement->name.value);
+            if (symbol->scope == SCOPE_GLOBAL){
+                emit(compiler, OP_SET_GLOBAL, symbol->index, 0);
+            } else {
+                emit(compiler, OP_SET_LOCAL, symbol->index, 0);
+            }
+            return true;
+        }
+        case RETURN_STATEMENT:
+            if (!compile_expression(compiler, statement->value, NULL)){
+                return false;
+            }
+            emit(compiler, OP_RETURN_VALUE, 0, 0);
+            return true;
+    }
+    return true;
+}
+
+/*Blocks used as expressions must leave exactly one value on the stack*/
+static void leave_block_value(compiler_t *compiler){
+    if (last_instruction_is(compiler, OP_POP)){
+        remove_last_pop(compiler);
+    } else if (!last_instruction_is(compiler, OP_RETURN_VALUE)){
+        emit(compiler, OP_NULL, 0, 0);
+    }
+}
+
+static bool compile_if_expression(compiler_t *compiler, expression_t *expression){
+    if (!compile_expression(compiler, expression->if_expression.condition, NULL)){
+        return false;
+    }
+
+    size_t jump_not_truthy = emit(compiler, OP_JUMP_NOT_TRUTHY, 9999, 0);
+    if (!compile_block_statement(compiler, expression->if_expression.consequence)){
+        return false;
+    }
+    leave_block_value(compiler);
+
+    size_t jump = emit(compiler, OP_JUMP, 9999, 0);
+    if (!change_operand(compiler, jump_not_truthy, current_instructions(compiler)->len)){
+        return false;
+    }
+
+    if (expression->if_expression.alternative == NULL){
+        emit(compiler, OP_NULL, 0, 0);
+    } else {
+        if (!compile_block_statement(compiler, expression->if_expression.alternative)){
+            return false;
+        }
+        leave_block_value(compiler);
+    }
+    return change_operand(compiler, jump, current_instructions(compiler)->len);
+}
+
+static bool compile_function_literal(compiler_t *compiler, expression_t *expression, const char *binding_name){
+    function_literal_t *literal = &expression->function_literal;
+
+    enter_scope(compiler);
+    if (binding_name != NULL){
+        symbol_define_function_name(compiler->symbol_table, binding_name);
+    }
+    for (int i = 0; i < literal->parameters->count; i++){
+        identifier_t *param = literal->parameters->data[i];
+        symbol_define(compiler->symbol_table, param->value);
+    }
+
+    if (!compile_block_statement(compiler, literal->body)){
+        return abandon_scope(compiler);
+    }
+    if (last_instruction_is(compiler, OP_POP)){
+        compilation_scope_t *scope = current_scope(compiler);
+        scope->instructions->data[scope->last_instruction.position] = OP_RETURN_VALUE;
+        scope->last_instruction.opcode = OP_RETURN_VALUE;
+    }
+    if (!last_instruction_is(compiler, OP_RETURN_VALUE)){
+        emit(compiler, OP_RETURN, 0, 0);
+    }
+
+    symbol_table_t *table = compiler->symbol_table;
+    vector_t *free_symbols = table->free_symbols;
+    int num_locals = table->num_definitions;
+    int num_free = free_symbols->count;
+    instructions_t *instructions = leave_scope(compiler);
+
+    for (int i = 0; i < num_free; i++){
+        load_symbol(compiler, free_symbols->data[i]);
+    }
+    free_symbol_table(table);
+
+    object_t *fn = new_immortal_object(OBJECT_COMPILED_FUNCTION);
+    fn->compiled_function = (compiled_function_object_t){
+        .instructions = instructions,
+        .num_locals = num_locals,
+        .num_parameters = literal->parameters->count,
+        .name = literal->name,
+    };
+    emit(compiler, OP_CLOSURE, add_constant(compiler, value_from_object(fn)), num_free);
+    return true;
+}
+
+static bool compile_expression_list(compiler_t *compiler, vector_t *expressions){
+    for (int i = 0; i < expressions->count; i++){
+        if (!compile_expression(compiler, expressions->data[i], NULL)){
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool compile_expression_node(compiler_t *compiler, expression_t *expression, const char *binding_name){
+    if (expression == NULL){
+        compiler_error(compiler, "cannot compile incomplete expression");
+        return false;
+    }
+
+    switch (expression->type){
+        case INTEGER_LITERAL: {
+            emit(compiler, OP_CONSTANT, add_integer_constant(compiler, value_from_int(expression->integer)), 0);
+            return true;
+        }
+        case STRING_LITERAL: {
+            // Interned, so the constant outlives the program's arena
+            value_t string = interned_string_object(expression->string_literal->data);
+            emit(compiler, OP_CONSTANT, add_constant(compiler, string), 0);
+            return true;
+        }
+        case BOOLEAN_EXPR:
+            emit(compiler, expression->boolean ? OP_TRUE : OP_FALSE, 0, 0);
+            return true;
+        case PREFIX_EXPR: {
+            if (!compile_expression(compiler, expression->prefix_expression.right, NULL)){
+                return false;
+            }
+            TokenType op = expression->prefix_expression.op;
+            if (op == BANG){
+                emit(compiler, OP_BANG, 0, 0);
+            } else if (op == MINUS){
+                emit(compiler, OP_MINUS, 0, 0);
+            } else {
+                compiler_error(compiler, "unknown operator %s", operator_to_string(op));
+                return false;
+            }
+            return true;
+        }
+        case INFIX_EXPR: {
+            opcode_t opcode;
+            if (!infix_opcode(expression->infix_expression.op, &opcode)){
+                compiler_error(compiler, "unknown operator %s", operator_to_string(expression->infix_expression.op));
+                return false;
+            }
+            if (!compile_expression(compiler, expression->infix_expression.left, NULL)){
+                return false;
+            }
+            if (!compile_expression(compiler, expression->infix_expression.right, NULL)){
+                return false;
+            }
+            emit(compiler, opcode, 0, 0);
+            return true;
+        }
+        case IF_EXPR:
+            return compile_if_expression(compiler, expression);
+        case IDENT_EXPR: {
+            symbol_t *symbol = symbol_resolve(compiler->symbol_table, expression->ident.value);
+            if (symbol == NULL){
+                compiler_error_at(compiler, expression->token, "identifier not found: %s", expression->ident.value);
+                return false;
+            }
+            load_symbol(compiler, symbol);
+            return true;
+        }
+        case ARRAY_LITERAL:
+            if (!compile_expression_list(compiler, expression->array_literal.elements)){
+                return false;
+            }
+            emit(compiler, OP_ARRAY, expression->array_literal.elements->count, 0);
+            return true;
+        case HASH_LITERAL: {
+            parser_hash_literal_t *hash = &expression->hash_literal;
+            for (size_t i = 0; i < hash->pairs_len; i++){
+                if (!compile_expression(compiler, hash->pairs[i]->key, NULL)){
+                    return false;
+                }
+                if (!compile_expression(compiler, hash->pairs[i]->value, NULL)){
+                    return false;
+                }
+            }
+            emit(compiler, OP_HASH, hash->pairs_len * 2, 0);
+            return true;
+        }
+        case INDEX_EXPR:
+            if (!compile_expression(compiler, expression->index_expression.left, NULL)){
+                return false;
+            }
+            if (!compile_expression(compiler, expression->index_expression.index, NULL)){
+                return false;
+            }
+            emit(compiler, OP_INDEX, 0, 0);
+            return true;
+        case FUNCTION_LITERAL:
+            return compile_function_literal(compiler, expression, binding_name);
+        case CALL_EXPRESSION:
+            if (!compile_expression(compiler, expression->call_expression.function, NULL)){
+                return false;
+            }
+            if (!compile_expression_list(compiler, expression->call_expression.arguments)){
+                return false;
+            }
+            emit(compiler, OP_CALL, expression->call_expression.arguments->count, 0);
+            return true;
+    }
+
+    compiler_error(compiler, "cannot compile expression type %d", expression->type);
+    return false;
+}
+
+bytecode_t compiler_bytecode(compiler_t *compiler){
+    return (bytecode_t){
+        .instructions = current_instructions(compiler),
+        .constants = compiler->constants,
+        .symbol_table = compiler->symbol_table,
+    };
+}
+
+void print_compiler_errors(compiler_t *compiler){
+    printf("Whoops! Compilation failed:\n");
+    for (int i = 0; i < compiler->errors->count; i++){
+        printf("%s\n", (char *)compiler->errors->data[i]);
+    }
+}
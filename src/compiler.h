@@ -0,0 +1,57 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <stdbool.h>
+#include "ast.h"
+#include "code.h"
+#include "hashmap.h"
+#include "symbol_table.h"
+#include "vector.h"
+
+typedef struct EmittedInstruction {
+	opcode_t opcode;
+	size_t position;
+} emitted_instruction_t;
+
+/*One per function literal being compiled, the outermost is the program itself*/
+typedef struct CompilationScope {
+	instructions_t *instructions;
+	emitted_instruction_t last_instruction;
+	emitted_instruction_t previous_instruction;
+} compilation_scope_t;
+
+typedef struct Compiler {
+	vector_t *constants; // value_t entries, stored with value_to_ptr
+	symbol_table_t *symbol_table;
+	bool owns_state; // made by new_compiler, not passed in to persist across REPL lines
+
+	compilation_scope_t *scopes;
+	int scope_index;
+	int scopes_capacity;
+
+	vector_t *errors;
+	program_t *program; // Set while compile_program runs, for error positions
+	/*The innermost node being compiled, operand range errors are reported at it*/
+	token_t token;
+	/*Integer constant to index + 1, so repeated literals share one constant*/
+	hash_map_t *integer_constants;
+} compiler_t;
+
+typedef struct Bytecode {
+	instructions_t *instructions;
+	vector_t *constants;
+	symbol_table_t *symbol_table; // Names globals in runtime errors
+} bytecode_t;
+
+compiler_t *new_compiler(void);
+compiler_t *new_compiler_with_state(symbol_table_t *symbol_table, vector_t *constants);
+symbol_table_t *new_global_symbol_table(void);
+/*Undoes what a failed compile added to state passed to new_compiler_with_state*/
+void restore_global_state(symbol_table_t *symbol_table, vector_t *constants, int num_definitions, size_t num_constants);
+bool compile_program(compiler_t *compiler, program_t *program);
+bytecode_t compiler_bytecode(compiler_t *compiler);
+/*Frees the bytecode too, so the VM running it and any closures it made must be done with*/
+void free_compiler(compiler_t *compiler);
+void print_compiler_errors(compiler_t *compiler);
+
+#endif
@@ -44,13 +44,17 @@ void string_free(string_t *str) {
 }
 
 void string_append(string_t *str, const char *append) {
-    size_t append_len = strlen(append);
+    string_append_n(str, append, strlen(append));
+}
+
+void string_append_n(string_t *str, const char *append, size_t append_len) {
     size_t needed_cap = str->len + append_len + 1;
     if (needed_cap > str->cap) {
         string_grow(str, needed_cap);
     }
-    strcpy(str->data + str->len, append);
+    memcpy(str->data + str->len, append, append_len);
     str->len += append_len;
+    str->data[str->len] = '\0';
 }
 
 string_t *string_concat(string_t *str1, string_t *str2){
@@ -19,6 +19,7 @@ void string_free(string_t *str);
 
 // Core operations
 void string_append(string_t *str, const char *append);
+void string_append_n(string_t *str, const char *append, size_t append_len);
 void string_append_char(string_t *str, char ch);
 void string_clear(string_t *str);
 string_t *string_concat(string_t *str1, string_t *str2);
@@ -1,30 +1,175 @@
+#include <string.h>
 #include "environment.h"
 #include "evaluator.h"
+#include "gc.h"
 #include "hashmap.h"
 #include "object.h"
+#include "intern.h"
+#include "stats.h"
 
 environment_t *new_environment(){
-    environment_t *environment = malloc(sizeof(environment_t));
-    environment->table = new_hash_table(free_object);
-    environment->outer = NULL;
+    environment_t *environment = calloc(1, sizeof(environment_t));
+    environment->names = new_interned_hash_table(NULL);
+    gc_track_environment(environment);
+    stats.environments++;
     return environment;
 }
 
-bool env_set(environment_t *env, char *key, object_t *object){
-    object_t *copy = object_heap_copy(object);
-    return hash_set(env->table, key, copy);
+environment_t *new_enclosed_environment(environment_t *outer, int size){
+    // Call frames never grow, so the slots live in the same allocation
+    environment_t *environment = calloc(1, sizeof(environment_t) + size * sizeof(value_t));
+    environment->slots = (value_t *)(environment + 1);
+    environment->size = size;
+    environment->capacity = size;
+    environment->outer = outer;
+    gc_track_environment(environment);
+    stats.environments++;
+    return environment;
+}
+
+/*
+ * Frame stack, kept as a list of chunks so frames never move once pushed. Chunks are
+ * kept around after being emptied, so steady state recursion doesn't allocate.
+ */
+#define FRAME_CHUNK_SIZE (64 * 1024)
+
+typedef struct FrameChunk frame_chunk_t;
+typedef struct FrameChunk {
+    frame_chunk_t *prev;
+    frame_chunk_t *next;
+    size_t used;
+    size_t capacity;
+    _Alignas(16) char data[];
+} frame_chunk_t;
+
+static frame_chunk_t *frame_chunks = NULL;
+static frame_chunk_t *current_chunk = NULL;
+
+static size_t frame_bytes(int size){
+    size_t bytes = sizeof(environment_t) + size * sizeof(value_t);
+    return (bytes + 15) & ~(size_t)15;
+}
+
+/*Frames on the stack are live by definition, so they are all roots*/
+static void mark_frame_stack(void *context){
+    for (frame_chunk_t *chunk = frame_chunks; chunk != NULL; chunk = chunk->next){
+        size_t offset = 0;
+        while (offset < chunk->used){
+            environment_t *frame = (environment_t *)(chunk->data + offset);
+            for (int i = 0; i < frame->size; i++){
+                gc_mark_value(frame->slots[i]);
+            }
+            gc_mark_environment(frame->outer);
+            offset += frame_bytes(frame->capacity);
+        }
+        if (chunk == current_chunk){
+            break;
+        }
+    }
+}
+
+static frame_chunk_t *new_frame_chunk(frame_chunk_t *prev, size_t bytes){
+    size_t capacity = bytes > FRAME_CHUNK_SIZE ? bytes : FRAME_CHUNK_SIZE;
+    frame_chunk_t *chunk = malloc(sizeof(frame_chunk_t) + capacity);
+    chunk->prev = prev;
+    chunk->next = NULL;
+    chunk->used = 0;
+    chunk->capacity = capacity;
+    return chunk;
+}
+
+environment_t *push_frame(environment_t *outer, int size){
+    size_t bytes = frame_bytes(size);
+    if (current_chunk == NULL){
+        frame_chunks = current_chunk = new_frame_chunk(NULL, bytes);
+        gc_add_root_marker(mark_frame_stack, NULL);
+    }
+    if (current_chunk->used + bytes > current_chunk->capacity){
+        frame_chunk_t *next = current_chunk->next;
+        if (next != NULL && next->capacity < bytes){
+            // Too small for this frame, drop it and everything cached after it
+            while (next != NULL){
+                frame_chunk_t *after = next->next;
+                free(next);
+                next = after;
+            }
+        }
+        if (next == NULL){
+            next = new_frame_chunk(current_chunk, bytes);
+            current_chunk->next = next;
+        }
+        next->used = 0;
+        current_chunk = next;
+    }
+
+    environment_t *frame = (environment_t *)(current_chunk->data + current_chunk->used);
+    current_chunk->used += bytes;
+    *frame = (environment_t){
+        .slots = (value_t *)(frame + 1),
+        .size = size,
+        .capacity = size,
+        .outer = outer,
+        .on_stack = true,
+    };
+    memset(frame->slots, 0, size * sizeof(value_t));
+    stats.environments++;
+    return frame;
+}
+
+/*Frames must be popped in the reverse order they were pushed*/
+void pop_frame(environment_t *frame){
+    current_chunk->used = (char *)frame - current_chunk->data;
+    if (current_chunk->used == 0 && current_chunk->prev != NULL){
+        current_chunk = current_chunk->prev;
+    }
 }
 
-object_t *env_get(environment_t *env, char *key){
-    object_t *object = (object_t *)hash_get(env->table, key); 
-    if (object == NULL && env->outer != NULL){
-        object = env_get(env->outer, key);
+static environment_t *global_frame(environment_t *env){
+    while (env->outer != NULL){
+        env = env->outer;
     }
-    return object;
+    return env;
 }
 
-void free_object(void *object){
-    // TODO: free dynamically allocated unions in the object (eg. arrays, hashes...etc)
-    // TODO: move this into the object files
-    free((object_t *)(object));
+/*Returns the global slot for key, reserving a new one the first time it is seen*/
+int env_define(environment_t *env, const char *key){
+    env = global_frame(env);
+    intptr_t slot = (intptr_t)interned_get(env->names, key);
+    if (slot != 0){
+        return slot - 1;
+    }
+
+    if (env->size >= env->capacity){
+        int capacity = env->capacity == 0 ? 16 : env->capacity * 2;
+        env->slots = realloc(env->slots, capacity * sizeof(value_t));
+        memset(env->slots + env->capacity, 0, (capacity - env->capacity) * sizeof(value_t));
+        gc_track_resize(env->capacity * sizeof(value_t), capacity * sizeof(value_t));
+        env->capacity = capacity;
+    }
+    slot = env->size++;
+    interned_set(env->names, key, (void *)(slot + 1));
+    return slot;
+}
+
+bool env_set(environment_t *env, const char *key, value_t value){
+    int slot = env_define(env, key);
+    global_frame(env)->slots[slot] = value;
+    return true;
+}
+
+value_t env_get(environment_t *env, const char *key){
+    env = global_frame(env);
+    intptr_t slot = (intptr_t)interned_get(env->names, key);
+    if (slot == 0){
+        return VALUE_EMPTY;
+    }
+    return env->slots[slot - 1];
+}
+
+void free_environment(environment_t *env){
+    if (env->names != NULL){
+        free_hash(env->names);
+        free(env->slots);
+    }
+    free(env);
 }
@@ -2,22 +2,50 @@
 #define ENVIRONMENT_H
 
 #include "hashmap.h"
+#include <stdbool.h>
 #include <stdint.h>
+#include "value.h"
 
-// Forward declaration - see object.h
-struct Object;
-typedef struct Object object_t;
-
+/*
+ * Array backed frame. Identifiers are resolved ahead of time (see resolver.h) to a
+ * (depth, slot) pair, so a lookup walks depth outer links and indexes the slots.
+ * Only the global frame keeps names, so later programs (e.g. REPL lines) can resolve
+ * against it, and it grows as new globals are defined.
+ *
+ * Frames of functions that never create a closure can't outlive their call, so they are
+ * pushed onto a frame stack (push_frame/pop_frame) instead of going through the collector.
+ */
 typedef struct Environment environment_t;
 typedef struct Environment {
-	hash_map_t *table;
+	value_t *slots;
+	int size;
+	int capacity;
 	/*So that we can accomodate for closures*/
 	environment_t *outer;
+	/*Interned name to slot index + 1, NULL for call frames*/
+	hash_map_t *names;
+	/*Lives on the frame stack, the collector neither tracks nor sweeps it*/
+	bool on_stack;
+	/*Collector bookkeeping, see gc.h*/
+	bool marked;
+	environment_t *gc_next;
 } environment_t;
 
 environment_t *new_environment();
-bool env_set(environment_t *env, char *key, object_t *object);
-object_t *env_get(environment_t *env, char *key);
-void free_object(void *object);
+environment_t *new_enclosed_environment(environment_t *outer, int size);
+environment_t *push_frame(environment_t *outer, int size);
+void pop_frame(environment_t *frame);
+/*Keys are interned strings, see intern.h*/
+int env_define(environment_t *env, const char *key);
+bool env_set(environment_t *env, const char *key, value_t value);
+value_t env_get(environment_t *env, const char *key);
+void free_environment(environment_t *env);
+
+static inline value_t env_get_slot(environment_t *env, int depth, int slot){
+	while (depth-- > 0){
+		env = env->outer;
+	}
+	return env->slots[slot];
+}
 
 #endif
@@ -4,10 +4,16 @@
 #include "evaluator.h"
 #include "ast.h"
 #include "custom_string.h"
+#include "gc.h"
 #include "hashmap.h"
 #include "object.h"
+#include "resolver.h"
+#include "profiler.h"
+#include "stats.h"
 #include "vector.h"
 
+static value_t eval_tail_call(value_t function, expression_t *call, environment_t *env);
+
 char *object_type_to_string(object_type_t object_type){
     switch(object_type){
         case OBJECT_INTEGER:
@@ -30,12 +36,16 @@ char *object_type_to_string(object_type_t object_type){
             return "OBJECT_ARRAY";
         case OBJECT_HASH:
             return "OBJECT_HASH";
+        case OBJECT_COMPILED_FUNCTION:
+            return "OBJECT_COMPILED_FUNCTION";
+        case OBJECT_CLOSURE:
+            return "OBJECT_CLOSURE";
         default:
             return "";
     }
 }
 
-object_t *eval(void *node, node_type_t node_type, environment_t *env){
+value_t eval(void *node, node_type_t node_type, environment_t *env){
     switch(node_type){
         case NODE_PROGRAM:{
             program_t *program = (program_t *)node;
@@ -54,96 +64,150 @@ object_t *eval(void *node, node_type_t node_type, environment_t *env){
             return eval_block_statement(block_statement, env);
         }
         default:
-            return NULL;
+            return VALUE_EMPTY;
+    }
+}
+
+/*The program being run, so runtime errors can say where they happened*/
+static program_t *current_program = NULL;
+
+/*Writes "line:column: " for the token into buffer, or nothing if its position isn't known*/
+static int error_position(char *buffer, size_t size, token_t token){
+    source_position_t position = current_program == NULL
+        ? (source_position_t){0}
+        : program_position(current_program, token);
+    if (position.line == 0){
+        buffer[0] = '\0';
+        return 0;
+    }
+    return snprintf(buffer, size, "%u:%u: ", position.line, position.column);
+}
+
+/*Prefixes an error raised by the node with its token with that token's position*/
+static value_t error_at(token_t token, value_t result){
+    if (!value_is(result, OBJECT_ERROR)){
+        return result;
+    }
+    char error_msg[BUFSIZ];
+    int prefix = error_position(error_msg, BUFSIZ, token);
+    if (prefix == 0){
+        return result;
     }
+    snprintf(error_msg + prefix, BUFSIZ - prefix, "%s", value_as_object(result)->error_message->data);
+    return new_error(error_msg);
 }
 
-object_t *eval_program(program_t *program, environment_t *env){
-    object_t *result;
+value_t eval_program(program_t *program, environment_t *env){
+    value_t result = VALUE_NULL;
+    program_t *enclosing_program = current_program;
+    current_program = program;
+    stats_enter(PHASE_RESOLVE);
+    resolve_program(program, env);
+    stats_leave();
+    stats_enter(PHASE_EVAL);
+    size_t roots = gc_save_roots();
+    gc_push_env_root(env);
     for(int i = 0; i < program->statements->count; i++){
+        gc_safepoint();
         result = eval(program->statements->data[i], NODE_STATEMENT, env);
-        if (result->type == OBJECT_ERROR){
-            return result;
+        if (value_is(result, OBJECT_ERROR)){
+            break;
         }
-        if (result->type == OBJECT_RETURN){
-            return result->return_obj;
+        if (value_is(result, OBJECT_RETURN)){
+            result = value_as_object(result)->return_obj;
+            break;
         }
     }
+    gc_restore_roots(roots);
+    stats_leave();
+    current_program = enclosing_program;
     return result;
 }
 
-object_t *eval_statement(statement_t *statement, environment_t *env){
-    object_t *result = eval(statement->value, NODE_EXPRESSION, env);
-    if (result->type == OBJECT_ERROR){
+value_t eval_statement(statement_t *statement, environment_t *env){
+    value_t result = eval(statement->value, NODE_EXPRESSION, env);
+    if (value_is(result, OBJECT_ERROR)){
         return result;
-    } else if (statement->type == RETURN_STATEMENT){
+    } else if (statement->type == RETURN_STATEMENT && !value_same(result, VALUE_TAIL_CALL)){
         object_t *to_return = new_object(OBJECT_RETURN);
         to_return->return_obj = result;
-        return to_return;
+        return value_from_object(to_return);
     } else if (statement->type == LET_STATEMENT){
-        env_set(env, statement->name.value, result);
+        if (statement->name.slot == UNRESOLVED_SLOT){
+            env_set(env, statement->name.value, result);
+        } else {
+            env->slots[statement->name.slot] = result;
+        }
     }
     return result;
 }
 
-object_t *eval_block_statement(block_statement_t *block_statement, environment_t *env){
-    object_t *result;
+value_t eval_block_statement(block_statement_t *block_statement, environment_t *env){
+    value_t result = VALUE_NULL;
     vector_t *statements = block_statement->statements;
     for(int i = 0; i < statements->count; i++){
+         gc_safepoint();
          result = eval_statement(statements->data[i], env);
-         if (result->type == OBJECT_RETURN || result->type == OBJECT_ERROR){
+         if (value_is(result, OBJECT_RETURN) || value_is(result, OBJECT_ERROR) || value_same(result, VALUE_TAIL_CALL)){
             return result;
          }
     }
     return result;
 }
 
-object_t *eval_expression_node(expression_t *expression, environment_t *env){
+value_t eval_expression_node(expression_t *expression, environment_t *env){
     switch(expression->type){
         case INTEGER_LITERAL:{
-            object_t *integer_obj = new_object(OBJECT_INTEGER);
-            integer_obj->integer = expression->integer;
-            return integer_obj;
+            return value_from_int(expression->integer);
         }
         case BOOLEAN_EXPR:
             return native_bool_to_boolean(expression->boolean);
         case PREFIX_EXPR: {
-            object_t *right = eval(expression->prefix_expression.right, NODE_EXPRESSION, env);
-            if(right->type == OBJECT_ERROR){ return right; }
-            return eval_prefix_expression(expression->prefix_expression.op, right);
+            value_t right = eval(expression->prefix_expression.right, NODE_EXPRESSION, env);
+            if(value_is(right, OBJECT_ERROR)){ return right; }
+            return error_at(expression->token, eval_prefix_expression(expression->prefix_expression.op, right));
         }
         case INFIX_EXPR:{
-            object_t *right = eval(expression->infix_expression.right, NODE_EXPRESSION, env);
-            if(right->type == OBJECT_ERROR){ return right; }
+            value_t right = eval(expression->infix_expression.right, NODE_EXPRESSION, env);
+            if(value_is(right, OBJECT_ERROR)){ return right; }
 
-            object_t *left = eval(expression->infix_expression.left, NODE_EXPRESSION, env);
-            if(left->type == OBJECT_ERROR){ return left; }
+            size_t roots = gc_save_roots();
+            gc_push_root(right);
+            value_t left = eval(expression->infix_expression.left, NODE_EXPRESSION, env);
+            gc_restore_roots(roots);
+            if(value_is(left, OBJECT_ERROR)){ return left; }
 
-            return eval_infix_expression(expression->infix_expression.op, left, right);
+            return error_at(expression->token, eval_infix_expression(expression->infix_expression.op, left, right));
         }
         case IF_EXPR:{
-            object_t *condition = eval(expression->if_expression.condition, NODE_EXPRESSION, env);
-            if(condition->type == OBJECT_ERROR){ return condition; }
+            value_t condition = eval(expression->if_expression.condition, NODE_EXPRESSION, env);
+            if(value_is(condition, OBJECT_ERROR)){ return condition; }
 
             if (is_truthy(condition)){
-                object_t *result = eval(expression->if_expression.consequence, NODE_BLOCK_STATEMENT, env);
-                if (result->type == OBJECT_ERROR){ return result; }
+                value_t result = eval(expression->if_expression.consequence, NODE_BLOCK_STATEMENT, env);
+                if (value_is(result, OBJECT_ERROR)){ return result; }
                 return result;
             } else if (expression->if_expression.alternative != NULL){
                 return eval(expression->if_expression.alternative, NODE_BLOCK_STATEMENT, env);
             } else {
-                return global_null;
+                return VALUE_NULL;
             }
         }
         case IDENT_EXPR:{
-            object_t *value = env_get(env, expression->ident.value);
-
-            if (value == NULL){
-                value = get_builtin_by_name(expression->ident.value);
+            identifier_t *ident = &expression->ident;
+            value_t value = ident->slot == UNRESOLVED_SLOT
+                ? env_get(env, ident->value)
+                : env_get_slot(env, ident->depth, ident->slot);
+
+            if (value_is_empty(value)){
+                value = ident->builtin != 0
+                    ? get_builtin_by_index(ident->builtin - 1)
+                    : get_builtin_by_name(ident->value);
             }
-            if (value == NULL){
+            if (value_is_empty(value)){
                 char error_msg[BUFSIZ];
-                snprintf(error_msg, BUFSIZ, "identifier not found: %s", expression->ident.value);
+                int prefix = error_position(error_msg, BUFSIZ, expression->token);
+                snprintf(error_msg + prefix, BUFSIZ - prefix, "identifier not found: %s", expression->ident.value);
                 return new_error(error_msg);
             }
 
@@ -154,294 +218,451 @@ object_t *eval_expression_node(expression_t *expression, environment_t *env){
             obj->function = (function_object_t){
                     .parameters = expression->function_literal.parameters,
                     .body = expression->function_literal.body,
+                    .num_locals = expression->function_literal.num_locals,
+                    .frame_escapes = expression->function_literal.frame_escapes,
+                    .name = expression->function_literal.name,
+                    .program = current_program,
                     .env = env
             };
-            return obj;
+            return value_from_object(obj);
         }
         case CALL_EXPRESSION: {
-            object_t *function = eval_expression_node(expression->call_expression.function, env);
-            if (function->type == OBJECT_ERROR){ return function; }
-            if (function->type != OBJECT_FUNCTION && function->type != OBJECT_BUILTIN){
-                return new_error("not a function");
+            value_t function = eval_expression_node(expression->call_expression.function, env);
+            if (value_is(function, OBJECT_ERROR)){ return function; }
+            if (value_is(function, OBJECT_FUNCTION) && expression->call_expression.tail){
+                return eval_tail_call(function, expression, env);
             }
-            vector_t *args = eval_call_expressions(expression->call_expression.arguments, env);
-
-            if (args->count == 1 && ((object_t *)args->data[0])->type == OBJECT_ERROR){
-                return args->data[0];
+            if (value_is(function, OBJECT_FUNCTION)){
+                return eval_function_call(function, expression, env);
             }
-            if (function->type == OBJECT_FUNCTION && args->count != function->function.parameters->count) {
-                return new_error("wrong number of arguments");
+            if (!value_is(function, OBJECT_BUILTIN)){
+                return error_at(expression->token, new_error("not a function"));
             }
 
-            object_t *result = apply_function(function, args);
+            size_t roots = gc_save_roots();
+            gc_push_root(function);
+            vector_t *args = eval_call_expressions(expression->call_expression.arguments, env);
+
+            value_t result;
+            if (args->count > 0 && value_is(value_from_ptr(args->data[args->count - 1]), OBJECT_ERROR)){
+                result = value_from_ptr(args->data[args->count - 1]);
+            } else {
+                result = error_at(expression->token, apply_function(function, args));
+            }
 
-            //TODO: free the args vector
+            gc_restore_roots(roots);
+            free_vector(args);
             return result;
 
         }
-        case STRING_LITERAL: {
-            object_t *obj = new_object(OBJECT_STRING);
-            obj->string_literal = expression->string_literal;
-            return obj;
-        }
+        case STRING_LITERAL:
+            // Literal text is interned, so every evaluation shares one immortal object
+            return interned_string_object(expression->string_literal->data);
         case ARRAY_LITERAL: {
+            size_t roots = gc_save_roots();
             vector_t *elements = eval_call_expressions(expression->array_literal.elements, env);
-            if (elements->count == 1 && ((object_t *)elements->data[0])->type == OBJECT_ERROR){
-                return elements->data[0];
+            gc_restore_roots(roots);
+            if (elements->count > 0 && value_is(value_from_ptr(elements->data[elements->count - 1]), OBJECT_ERROR)){
+                value_t error = value_from_ptr(elements->data[elements->count - 1]);
+                free_vector(elements);
+                return error;
             }
 
-            object_t *obj = new_object(OBJECT_ARRAY);
+            object_t *obj = new_array_object(elements->count);
             if (obj == NULL) {
+                free_vector(elements);
                 return new_error("cannot allocate for array");
             }
-
-            obj->array.elements = elements;
-            return obj;
+            for (int i = 0; i < elements->count; i++){
+                array_append(obj, value_from_ptr(elements->data[i]));
+            }
+            free_vector(elements);
+            return value_from_object(obj);
         }
         case HASH_LITERAL: {
-            object_t *obj = new_object(OBJECT_HASH);
-            hash_map_t *pairs = new_hash_table(free_object);
+            object_t *obj = new_hash_object();
+            size_t roots = gc_save_roots();
+            gc_push_root(value_from_object(obj));
             for (int i = 0; i < expression->hash_literal.pairs_len; i++){
-                object_t *key = eval_expression_node(expression->hash_literal.pairs[i]->key, env);
-                if (key->type == OBJECT_ERROR){
+                value_t key = eval_expression_node(expression->hash_literal.pairs[i]->key, env);
+                if (value_is(key, OBJECT_ERROR)){
+                    gc_restore_roots(roots);
                     return key;
                 }
-                char *actual_key = object_to_key(key);
-                object_t *value = eval_expression_node(expression->hash_literal.pairs[i]->value, env);
-                if (value->type == OBJECT_ERROR){
+                hash_key_t hash_key;
+                if (!value_to_hash_key(key, &hash_key)){
+                    gc_restore_roots(roots);
+                    return error_at(expression->token, unusable_hash_key(key));
+                }
+                gc_push_root(key);
+                value_t value = eval_expression_node(expression->hash_literal.pairs[i]->value, env);
+                if (value_is(value, OBJECT_ERROR)){
+                    gc_restore_roots(roots);
                     return value;
                 }
-                hash_set(pairs, actual_key, value);
+                hash_object_set(&obj->hash, hash_key, value);
             }
-            obj->hash.pairs = pairs;
-            return obj;
+            gc_restore_roots(roots);
+            return value_from_object(obj);
         }
         case INDEX_EXPR: {
-            object_t *left = eval(expression->index_expression.left, NODE_EXPRESSION, env);
-            if (left->type == OBJECT_ERROR){ return left; }
+            value_t left = eval(expression->index_expression.left, NODE_EXPRESSION, env);
+            if (value_is(left, OBJECT_ERROR)){ return left; }
 
-            object_t *index = eval(expression->index_expression.index, NODE_EXPRESSION, env);
-            if (index->type == OBJECT_ERROR){ return index; }
+            size_t roots = gc_save_roots();
+            gc_push_root(left);
+            value_t index = eval(expression->index_expression.index, NODE_EXPRESSION, env);
+            gc_restore_roots(roots);
+            if (value_is(index, OBJECT_ERROR)){ return index; }
 
-            return eval_index_expression(left, index);
+            return error_at(expression->token, eval_index_expression(left, index));
 
         }
         default:
-            return NULL;
+            return VALUE_EMPTY;
     }
 }
 
-object_t *eval_index_expression(object_t *left, object_t *index){
-    if (left->type == OBJECT_ARRAY && index->type == OBJECT_INTEGER){
+value_t eval_index_expression(value_t left, value_t index){
+    if (value_is(left, OBJECT_ARRAY) && value_is(index, OBJECT_INTEGER)){
         return eval_array_index_expression(left, index);
     }
 
-    if (left->type == OBJECT_HASH){
+    if (value_is(left, OBJECT_HASH)){
         return eval_hash_index_expression(left, index);
     }
 
     char error_msg[BUFSIZ];
-    snprintf(error_msg, BUFSIZ, "index operator not supported: %s", object_type_to_string(left->type));
+    snprintf(error_msg, BUFSIZ, "index operator not supported: %s", object_type_to_string(value_type(left)));
     return new_error(error_msg);
 }
 
-object_t *eval_hash_index_expression(object_t *hash, object_t *index){
-    char key[BUFSIZ];
-    switch (index->type){
-        case OBJECT_STRING:{
-            snprintf(key, BUFSIZ, "OBJECT_STRING-%s", index->string_literal->data);
-            break;
-        }
-        case OBJECT_INTEGER:{
-            snprintf(key, BUFSIZ, "OBJECT_INTEGER-%d", index->integer);
-            break;
-        }
-        case OBJECT_BOOLEAN:{
-            snprintf(key, BUFSIZ, "OBJECT_BOOLEAN-%s", index->boolean ? "true" : "false");
-            break;
-        }
-        default:{
-            char error_msg[BUFSIZ];
-            snprintf(error_msg, BUFSIZ, "unuseable as hash key: %s", object_type_to_string(index->type));
-            return new_error(error_msg);
-        }
+value_t unusable_hash_key(value_t key){
+    char error_msg[BUFSIZ];
+    snprintf(error_msg, BUFSIZ, "unuseable as hash key: %s", object_type_to_string(value_type(key)));
+    return new_error(error_msg);
+}
 
+value_t eval_hash_index_expression(value_t hash, value_t index){
+    hash_key_t key;
+    if (!value_to_hash_key(index, &key)){
+        return unusable_hash_key(index);
     }
-    object_t *value = hash_get(hash->hash.pairs, key);
-    if (value == NULL){ return global_null; }
+    value_t value = hash_object_get(&value_as_object(hash)->hash, key);
+    if (value_is_empty(value)){ return VALUE_NULL; }
     return value;
 }
 
-object_t *eval_array_index_expression(object_t *array, object_t *index){
-    int idx = index->integer;
-    int max = array->array.elements->count;
-    if (idx < 0 || idx >= max){
-        return global_null;
+value_t eval_array_index_expression(value_t array, value_t index){
+    array_object_t *elements = &value_as_object(array)->array;
+    int idx = value_as_int(index);
+    if (idx < 0 || idx >= elements->count){
+        return VALUE_NULL;
     }
-    return (object_t *)array->array.elements->data[idx];
+    return array_get(elements, idx);
 }
 
+/*Each evaluated value is pushed as a gc root, callers restore the root stack when done with them*/
 vector_t *eval_call_expressions(vector_t *input_args, environment_t *env){
     vector_t *args = create_vector();
 
     for (int i = 0; i < input_args->count; i++){
-        object_t *arg = eval_expression_node(input_args->data[i], env);
+        value_t arg = eval_expression_node(input_args->data[i], env);
 
-        if (arg->type == OBJECT_ERROR){ 
-            append_vector(args, arg);
+        if (value_is(arg, OBJECT_ERROR)){ 
+            append_vector(args, value_to_ptr(arg));
             return args;
         }
 
-        append_vector(args, arg);
+        gc_push_root(arg);
+        append_vector(args, value_to_ptr(arg));
     }
     return args;
 }
 
-object_t *apply_function(object_t *fn, vector_t *args) {
-    switch (fn->type) {
-        case OBJECT_FUNCTION: {
-            environment_t* extended_env = new_environment();
-            extended_env->outer = fn->function.env;
+static environment_t *new_call_frame(function_object_t *fn, int argc){
+    int size = fn->num_locals > argc ? fn->num_locals : argc;
+    if (fn->frame_escapes){
+        return new_enclosed_environment(fn->env, size);
+    }
+    return push_frame(fn->env, size);
+}
 
-            for (int i = 0; i < fn->function.parameters->count; i++) {
-                identifier_t* param = fn->function.parameters->data[i];
-                object_t* arg = args->data[i];
-                env_set(extended_env, param->value, arg);
-            }
+/*
+ * A call in tail position evaluates its arguments here, then returns VALUE_TAIL_CALL up
+ * to the call_with_frame running its function, which releases that frame and runs the
+ * callee in its place. Calls made while evaluating the arguments stack their own on
+ * top, so a pending call's arguments are args[base..count).
+ */
+static struct {
+    value_t function;
+    int base;
+    value_t *args;
+    int count;
+    int capacity;
+} tail_call;
+
+static void mark_tail_call(void *context){
+    gc_mark_value(tail_call.function);
+    for (int i = 0; i < tail_call.count; i++){
+        gc_mark_value(tail_call.args[i]);
+    }
+}
+
+static void push_tail_arg(value_t arg){
+    if (tail_call.count == tail_call.capacity){
+        if (tail_call.args == NULL){
+            gc_add_root_marker(mark_tail_call, NULL);
+        }
+        tail_call.capacity = tail_call.capacity == 0 ? 16 : tail_call.capacity * 2;
+        tail_call.args = realloc(tail_call.args, tail_call.capacity * sizeof(value_t));
+    }
+    tail_call.args[tail_call.count++] = arg;
+}
+
+static value_t eval_tail_call(value_t function, expression_t *call, environment_t *env){
+    function_object_t *fn = &value_as_object(function)->function;
+    vector_t *arguments = call->call_expression.arguments;
+    size_t roots = gc_save_roots();
+    gc_push_root(function);
+    int base = tail_call.count;
+    value_t result = VALUE_TAIL_CALL;
+    for (int i = 0; i < arguments->count; i++){
+        value_t arg = eval_expression_node(arguments->data[i], env);
+        if (value_is(arg, OBJECT_ERROR)){
+            result = arg;
+            break;
+        }
+        push_tail_arg(arg);
+    }
+    if (value_same(result, VALUE_TAIL_CALL) && arguments->count != fn->parameters->count){
+        result = error_at(call->token, new_error("wrong number of arguments"));
+    }
+    gc_restore_roots(roots);
 
-            object_t* evaluated = eval(fn->function.body, NODE_BLOCK_STATEMENT, extended_env);
-            if (evaluated->type == OBJECT_RETURN) {
-                return evaluated->return_obj;
+    if (!value_same(result, VALUE_TAIL_CALL)){
+        tail_call.count = base;
+        return result;
+    }
+    tail_call.function = function;
+    tail_call.base = base;
+    return result;
+}
+
+/*Runs the body in a frame that already holds the arguments, then releases the frame*/
+static value_t call_with_frame(function_object_t *fn, environment_t *frame){
+    size_t roots = gc_save_roots();
+    // The body may come from another program, like a function defined on an earlier REPL line
+    program_t *caller_program = current_program;
+    for (;;){
+        gc_push_env_root(frame);
+        profiler_push(fn->name);
+        current_program = fn->program;
+        value_t evaluated = eval(fn->body, NODE_BLOCK_STATEMENT, frame);
+        current_program = caller_program;
+        profiler_pop();
+        gc_restore_roots(roots);
+        if (frame->on_stack){
+            pop_frame(frame);
+        }
+        if (!value_same(evaluated, VALUE_TAIL_CALL)){
+            if (value_is(evaluated, OBJECT_RETURN)) {
+                return value_as_object(evaluated)->return_obj;
             }
             return evaluated;
         }
+
+        // Trampoline: the tail call reuses this C frame, so iteration by recursion runs in constant stack
+        value_t function = tail_call.function;
+        int argc = tail_call.count - tail_call.base;
+        tail_call.function = VALUE_EMPTY;
+        gc_push_root(function);
+        fn = &value_as_object(function)->function;
+        frame = new_call_frame(fn, argc);
+        memcpy(frame->slots, tail_call.args + tail_call.base, argc * sizeof(value_t));
+        tail_call.count = tail_call.base;
+    }
+}
+
+/*Evaluates the arguments straight into the callee's frame, the resolver gives parameters the first slots*/
+value_t eval_function_call(value_t function, expression_t *call, environment_t *env){
+    function_object_t *fn = &value_as_object(function)->function;
+    vector_t *arguments = call->call_expression.arguments;
+    size_t roots = gc_save_roots();
+    gc_push_root(function);
+    environment_t *frame = new_call_frame(fn, arguments->count);
+    gc_push_env_root(frame);
+
+    value_t result = VALUE_EMPTY;
+    for (int i = 0; i < arguments->count; i++){
+        value_t arg = eval_expression_node(arguments->data[i], env);
+        if (value_is(arg, OBJECT_ERROR)){
+            result = arg;
+            break;
+        }
+        frame->slots[i] = arg;
+    }
+    if (value_is_empty(result) && arguments->count != fn->parameters->count){
+        result = error_at(call->token, new_error("wrong number of arguments"));
+    }
+
+    if (value_is_empty(result)){
+        result = call_with_frame(fn, frame);
+    } else if (frame->on_stack){
+        pop_frame(frame);
+    }
+    gc_restore_roots(roots);
+    return result;
+}
+
+value_t apply_function(value_t fn, vector_t *args) {
+    switch (value_type(fn)) {
+        case OBJECT_FUNCTION: {
+            function_object_t *function = &value_as_object(fn)->function;
+            environment_t *frame = new_call_frame(function, args->count);
+            for (int i = 0; i < args->count; i++) {
+                frame->slots[i] = value_from_ptr(args->data[i]);
+            }
+            return call_with_frame(function, frame);
+        }
         case OBJECT_BUILTIN:
-            return fn->builtin(args);
+            return value_as_object(fn)->builtin(args);
         default:{
             char error_msg[BUFSIZ];
-            snprintf(error_msg, BUFSIZ, "not a function: %s", object_type_to_string(fn->type));
+            snprintf(error_msg, BUFSIZ, "not a function: %s", object_type_to_string(value_type(fn)));
             return new_error(error_msg);
         }
     }
 }
 
-bool is_truthy(object_t *object){
-    if (object->type == OBJECT_NULL) return NULL;
-    return object->boolean;
+bool is_truthy(value_t value){
+    return !value_is_null(value) && !value_same(value, VALUE_FALSE);
 }
 
-object_t *native_bool_to_boolean(bool input){
-    return input ? global_true : global_false;
+value_t native_bool_to_boolean(bool input){
+    return value_from_bool(input);
 }
 
-object_t *eval_prefix_expression(char *op, object_t *right){
-    switch(op[0]){
-        case '!':
+value_t eval_prefix_expression(TokenType op, value_t right){
+    switch(op){
+        case BANG:
             return eval_bang_operator(right);
-        case '-':
+        case MINUS:
             return eval_minus_operator(right);
         default:{
             char error_msg[BUFSIZ];
-            snprintf(error_msg, BUFSIZ, "unknown operator: %s%s", op, object_type_to_string(right->type));
+            snprintf(error_msg, BUFSIZ, "unknown operator: %s%s", operator_to_string(op), object_type_to_string(value_type(right)));
             return new_error(error_msg);
         }
     }
 }
 
-object_t *eval_infix_expression(char *op, object_t *left, object_t *right){
-    if (left->type != right->type){
-        char error_msg[BUFSIZ];
-        snprintf(error_msg, BUFSIZ, "type mismatch: %s %s %s",object_type_to_string(left->type), op, object_type_to_string(right->type));
-        return new_error(error_msg);
-    } else if(left->type == OBJECT_INTEGER && right->type == OBJECT_INTEGER){
-        return eval_integer_infix_expression(op, left, right);
-    } else if (left->type == OBJECT_STRING && right->type == OBJECT_STRING){
-        return eval_string_infix_expression(op, left, right);
+static value_t integer_add(value_t left, value_t right){ return value_from_int(value_as_int(left) + value_as_int(right)); }
+static value_t integer_sub(value_t left, value_t right){ return value_from_int(value_as_int(left) - value_as_int(right)); }
+static value_t integer_mul(value_t left, value_t right){ return value_from_int(value_as_int(left) * value_as_int(right)); }
+static value_t integer_lt(value_t left, value_t right){ return value_from_bool(value_as_int(left) < value_as_int(right)); }
+static value_t integer_gt(value_t left, value_t right){ return value_from_bool(value_as_int(left) > value_as_int(right)); }
+
+static value_t integer_div(value_t left, value_t right){
+    if (value_as_int(right) == 0){
+        return new_error("division by zero");
     }
-    // TODO: this coincidentally works for both bools and integers - does this need to be disambiguiated? are there platforms where integers and booleans are encoded differently in the union?
-    if(strcmp(op, "==") == 0){
-        return native_bool_to_boolean(left->integer == right->integer);
+    return value_from_int(value_as_int(left) / value_as_int(right));
+}
+
+static value_t string_add(value_t left, value_t right){
+    return concat_string_objects(value_as_object(left), value_as_object(right));
+}
+
+// Inline values compare by value, heap objects by identity
+static value_t value_eq(value_t left, value_t right){ return value_from_bool(value_same(left, right)); }
+static value_t value_not_eq(value_t left, value_t right){ return value_from_bool(!value_same(left, right)); }
+
+// Equal literals share one interned object, so identity settles most comparisons
+static bool strings_equal(value_t left, value_t right){
+    if (value_same(left, right)){
+        return true;
     }
-    if(strcmp(op, "!=") == 0){
-        return native_bool_to_boolean(left->integer != right->integer);
+    object_t *a = value_as_object(left);
+    object_t *b = value_as_object(right);
+    if (a->string_literal->len != b->string_literal->len){
+        return false;
     }
-
-    char error_msg[BUFSIZ];
-    snprintf(error_msg, BUFSIZ, "unknown operator: %s %s %s",object_type_to_string(right->type), op, object_type_to_string(right->type));
-    return new_error(error_msg);
+    return memcmp(object_string(a)->data, object_string(b)->data, a->string_literal->len) == 0;
 }
 
-object_t *eval_string_infix_expression(char *op, object_t *left, object_t *right){
-    if (strcmp(op, "+") != 0){
+static value_t string_eq(value_t left, value_t right){ return value_from_bool(strings_equal(left, right)); }
+static value_t string_not_eq(value_t left, value_t right){ return value_from_bool(!strings_equal(left, right)); }
+
+typedef value_t (*infix_handler_t)(value_t left, value_t right);
+
+#define EQUALITY_HANDLERS { [EQ] = value_eq, [NOT_EQ] = value_not_eq }
+
+/*Indexed by operand type then operator, a NULL entry is an unknown operator for that type*/
+static const infix_handler_t INFIX_HANDLERS[OBJECT_TYPE_COUNT][TOKEN_TYPE_COUNT] = {
+    [OBJECT_INTEGER] = {
+        [PLUS] = integer_add,
+        [MINUS] = integer_sub,
+        [ASTERISK] = integer_mul,
+        [SLASH] = integer_div,
+        [LT] = integer_lt,
+        [GT] = integer_gt,
+        [EQ] = value_eq,
+        [NOT_EQ] = value_not_eq,
+    },
+    [OBJECT_STRING] = {
+        [PLUS] = string_add,
+        [EQ] = string_eq,
+        [NOT_EQ] = string_not_eq,
+    },
+    [OBJECT_BOOLEAN] = EQUALITY_HANDLERS,
+    [OBJECT_NULL] = EQUALITY_HANDLERS,
+    [OBJECT_FUNCTION] = EQUALITY_HANDLERS,
+    [OBJECT_BUILTIN] = EQUALITY_HANDLERS,
+    [OBJECT_ARRAY] = EQUALITY_HANDLERS,
+    [OBJECT_HASH] = EQUALITY_HANDLERS,
+    [OBJECT_COMPILED_FUNCTION] = EQUALITY_HANDLERS,
+    [OBJECT_CLOSURE] = EQUALITY_HANDLERS,
+};
+
+value_t eval_infix_expression(TokenType op, value_t left, value_t right){
+    if (value_type(left) != value_type(right)){
         char error_msg[BUFSIZ];
-        snprintf(error_msg, BUFSIZ, "unknown operator: %s %s %s",object_type_to_string(right->type), op, object_type_to_string(right->type));
+        snprintf(error_msg, BUFSIZ, "type mismatch: %s %s %s",object_type_to_string(value_type(left)), operator_to_string(op), object_type_to_string(value_type(right)));
         return new_error(error_msg);
     }
 
-    object_t *obj = new_object(OBJECT_STRING);
-    obj->string_literal = string_concat(left->string_literal, right->string_literal);
-    return obj;
-}
-
-object_t *eval_integer_infix_expression(char *op, object_t *left, object_t *right){
-    int left_value = left->integer;
-    int right_value = right->integer;
-
-    if(strcmp(op, "+") == 0){
-            object_t *obj = new_object(OBJECT_INTEGER);
-            obj->integer = left_value + right_value;
-            return obj;
-    } else if(strcmp(op, "-") == 0){
-            object_t *obj = new_object(OBJECT_INTEGER);
-            obj->integer = left_value - right_value;
-            return obj;
-    } else if(strcmp(op, "*") == 0){
-            object_t *obj = new_object(OBJECT_INTEGER);
-            obj->integer = left_value * right_value;
-            return obj;
-    } else if(strcmp(op, "/") == 0){
-            object_t *obj = new_object(OBJECT_INTEGER);
-            obj->integer = left_value / right_value;
-            return obj;
-    } else if(strcmp(op, "<") == 0){
-            return native_bool_to_boolean(left_value < right_value);
-    } else if(strcmp(op, ">") == 0){
-            return native_bool_to_boolean(left_value > right_value);
-    } else if(strcmp(op, "==") == 0){
-            return native_bool_to_boolean(left_value == right_value);
-    } else if(strcmp(op, "!=") == 0){
-            return native_bool_to_boolean(left_value != right_value);
+    infix_handler_t handler = INFIX_HANDLERS[value_type(left)][op];
+    if (handler != NULL){
+        return handler(left, right);
     }
 
     char error_msg[BUFSIZ];
-    snprintf(error_msg, BUFSIZ, "unknown operator: %s %s %s",object_type_to_string(right->type), op, object_type_to_string(right->type));
+    snprintf(error_msg, BUFSIZ, "unknown operator: %s %s %s",object_type_to_string(value_type(right)), operator_to_string(op), object_type_to_string(value_type(right)));
     return new_error(error_msg);
 }
 
-object_t *eval_bang_operator(object_t *right){
-    if (right->type == OBJECT_NULL) {
-        return global_true;
+value_t eval_bang_operator(value_t right){
+    if (value_is(right, OBJECT_NULL)) {
+        return VALUE_TRUE;
     }
-    else if (right->type == OBJECT_BOOLEAN && !right->boolean) {
-        return global_true;
+    else if (value_same(right, VALUE_FALSE)) {
+        return VALUE_TRUE;
     }
-    return global_false;
+    return VALUE_FALSE;
 }
 
-object_t *eval_minus_operator(object_t *right){
-    if(right->type != OBJECT_INTEGER){
+value_t eval_minus_operator(value_t right){
+    if(!value_is(right, OBJECT_INTEGER)){
         char error_msg[BUFSIZ];
-        snprintf(error_msg, BUFSIZ, "unknown operator: -%s ",object_type_to_string(right->type));
+        snprintf(error_msg, BUFSIZ, "unknown operator: -%s ",object_type_to_string(value_type(right)));
         return new_error(error_msg);
     }
-    int value = right->integer;
-    object_t *obj = new_object(OBJECT_INTEGER);
-    obj->integer = -value;
-    return obj;
+    return value_from_int(-value_as_int(right));
 }
 
-object_t *new_error(char *format){
+value_t new_error(char *format){
     object_t *obj = new_object(OBJECT_ERROR);
     obj->error_message = string_from(format);
-    return obj;
+    return value_from_object(obj);
 }
@@ -9,24 +9,24 @@
 typedef struct Environment environment_t;
 
 char *object_type_to_string(object_type_t object_type);
-object_t* eval(void *node, node_type_t node_type, environment_t *env);
-object_t* eval_program(program_t *program, environment_t *env);
-object_t* eval_expression_node(expression_t *expression, environment_t *env);
-object_t* eval_infix_expression(char *op, object_t *left, object_t *right);
-object_t* eval_integer_infix_expression(char *op, object_t *left, object_t *right); 
-object_t *eval_string_infix_expression(char *op, object_t *left, object_t *right);
-object_t* native_bool_to_boolean(bool input);
-object_t* eval_prefix_expression(char *op, object_t *right);
-object_t* eval_bang_operator(object_t *right);
-object_t* eval_minus_operator(object_t *right);
-bool is_truthy(object_t *object);
-object_t* eval_statement(statement_t *statement, environment_t *env);
-object_t* eval_block_statement(block_statement_t *statement, environment_t *env);
-object_t* new_error(char *format);
+value_t eval(void *node, node_type_t node_type, environment_t *env);
+value_t eval_program(program_t *program, environment_t *env);
+value_t eval_expression_node(expression_t *expression, environment_t *env);
+value_t eval_infix_expression(TokenType op, value_t left, value_t right);
+value_t native_bool_to_boolean(bool input);
+value_t eval_prefix_expression(TokenType op, value_t right);
+value_t eval_bang_operator(value_t right);
+value_t eval_minus_operator(value_t right);
+bool is_truthy(value_t object);
+value_t eval_statement(statement_t *statement, environment_t *env);
+value_t eval_block_statement(block_statement_t *statement, environment_t *env);
+value_t new_error(char *format);
 vector_t *eval_call_expressions(vector_t *input_args, environment_t *env);
-object_t *apply_function(object_t *fn, vector_t *args);
-object_t* eval_index_expression(object_t *left, object_t *index);
-object_t *eval_array_index_expression(object_t *array, object_t *index);
-object_t *eval_hash_index_expression(object_t *hash, object_t *index);
+value_t eval_function_call(value_t fn, expression_t *call, environment_t *env);
+value_t apply_function(value_t fn, vector_t *args);
+value_t eval_index_expression(value_t left, value_t index);
+value_t eval_array_index_expression(value_t array, value_t index);
+value_t eval_hash_index_expression(value_t hash, value_t index);
+value_t unusable_hash_key(value_t key);
 
 #endif
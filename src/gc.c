@@ -0,0 +1,303 @@
+#include <stdlib.h>
+#include <string.h>
+#include "gc.h"
+#include "environment.h"
+#include "hashmap.h"
+#include "object.h"
+#include "stats.h"
+
+typedef enum {
+    ROOT_OBJECT,
+    ROOT_ENVIRONMENT,
+} gc_root_kind_t;
+
+typedef struct GcRoot {
+    gc_root_kind_t kind;
+    union {
+        value_t value;
+        environment_t *env;
+    };
+} gc_root_t;
+
+typedef struct GcRootMarker {
+    gc_root_marker_t marker;
+    void *context;
+} gc_root_marker_entry_t;
+
+typedef struct Gc {
+    object_t *objects;
+    environment_t *environments;
+    size_t live_objects;
+    size_t live_environments;
+    size_t bytes_allocated;
+    size_t next_collection;
+    size_t collections;
+
+    gc_root_t *roots;
+    size_t roots_count;
+    size_t roots_capacity;
+
+    gc_root_marker_entry_t *markers;
+    size_t markers_count;
+    size_t markers_capacity;
+
+    /*Grey sets, kept as explicit stacks so deep structures don't recurse on the C stack*/
+    object_t **grey_objects;
+    size_t grey_objects_count;
+    size_t grey_objects_capacity;
+    environment_t **grey_envs;
+    size_t grey_envs_count;
+    size_t grey_envs_capacity;
+} gc_t;
+
+static gc_t gc = {
+    .next_collection = GC_INITIAL_THRESHOLD,
+};
+
+static size_t environment_bytes(environment_t *env){
+    return sizeof(environment_t) + env->capacity * sizeof(value_t);
+}
+
+static void *grow_array(void *data, size_t *capacity, size_t elem_size){
+    *capacity = *capacity == 0 ? 64 : *capacity * 2;
+    return realloc(data, *capacity * elem_size);
+}
+
+object_t *gc_alloc_object(void){
+    object_t *object = calloc(1, sizeof(object_t));
+    if (object == NULL){
+        return NULL;
+    }
+    object->gc_next = gc.objects;
+    gc.objects = object;
+    gc.live_objects++;
+    gc.bytes_allocated += sizeof(object_t);
+    stats.bytes_allocated += sizeof(object_t);
+    return object;
+}
+
+void gc_track_environment(environment_t *env){
+    env->marked = false;
+    env->gc_next = gc.environments;
+    gc.environments = env;
+    gc.live_environments++;
+    gc.bytes_allocated += environment_bytes(env);
+    stats.bytes_allocated += environment_bytes(env);
+}
+
+void gc_track_resize(size_t old_size, size_t new_size){
+    gc.bytes_allocated += new_size - old_size;
+    if (new_size > old_size){
+        stats.bytes_allocated += new_size - old_size;
+    }
+}
+
+void gc_push_root(value_t value){
+    if (gc.roots_count >= gc.roots_capacity){
+        gc.roots = grow_array(gc.roots, &gc.roots_capacity, sizeof(gc_root_t));
+    }
+    gc.roots[gc.roots_count++] = (gc_root_t){ .kind = ROOT_OBJECT, .value = value };
+}
+
+void gc_push_env_root(environment_t *env){
+    if (gc.roots_count >= gc.roots_capacity){
+        gc.roots = grow_array(gc.roots, &gc.roots_capacity, sizeof(gc_root_t));
+    }
+    gc.roots[gc.roots_count++] = (gc_root_t){ .kind = ROOT_ENVIRONMENT, .env = env };
+}
+
+size_t gc_save_roots(void){
+    return gc.roots_count;
+}
+
+void gc_restore_roots(size_t saved){
+    gc.roots_count = saved;
+}
+
+void gc_add_root_marker(gc_root_marker_t marker, void *context){
+    if (gc.markers_count >= gc.markers_capacity){
+        gc.markers = grow_array(gc.markers, &gc.markers_capacity, sizeof(gc_root_marker_entry_t));
+    }
+    gc.markers[gc.markers_count++] = (gc_root_marker_entry_t){ .marker = marker, .context = context };
+}
+
+void gc_remove_root_marker(gc_root_marker_t marker, void *context){
+    for (size_t i = 0; i < gc.markers_count; i++){
+        if (gc.markers[i].marker == marker && gc.markers[i].context == context){
+            gc.markers[i] = gc.markers[--gc.markers_count];
+            return;
+        }
+    }
+}
+
+void gc_mark_object(object_t *object){
+    if (object == NULL || object->immortal || object->marked){
+        return;
+    }
+    object->marked = true;
+    if (gc.grey_objects_count >= gc.grey_objects_capacity){
+        gc.grey_objects = grow_array(gc.grey_objects, &gc.grey_objects_capacity, sizeof(object_t *));
+    }
+    gc.grey_objects[gc.grey_objects_count++] = object;
+}
+
+void gc_mark_value(value_t value){
+    if (value_is_object(value)){
+        gc_mark_object(value_as_object(value));
+    }
+}
+
+void gc_mark_environment(environment_t *env){
+    // Frame stack entries are traced by the frame stack's own root marker
+    if (env == NULL || env->marked || env->on_stack){
+        return;
+    }
+    env->marked = true;
+    if (gc.grey_envs_count >= gc.grey_envs_capacity){
+        gc.grey_envs = grow_array(gc.grey_envs, &gc.grey_envs_capacity, sizeof(environment_t *));
+    }
+    gc.grey_envs[gc.grey_envs_count++] = env;
+}
+
+static void mark_hash_pair(void *key, void *value){
+    gc_mark_value(value_from_ptr(key));
+    gc_mark_value(value_from_ptr(value));
+}
+
+static void trace_object(object_t *object){
+    switch (object->type){
+        case OBJECT_RETURN:
+            gc_mark_value(object->return_obj);
+            break;
+        case OBJECT_FUNCTION:
+            gc_mark_environment(object->function.env);
+            break;
+        case OBJECT_STRING:
+            if (object->rope_left != NULL){
+                gc_mark_object(object->rope_left);
+                gc_mark_object(object->rope_right);
+            }
+            break;
+        case OBJECT_ARRAY: {
+            // Only this array's slice, slots outside it may belong to arrays already swept
+            array_object_t *array = &object->array;
+            for (size_t i = 0; array->buffer != NULL && i < array->count; i++){
+                gc_mark_value(array_get(array, i));
+            }
+            break;
+        }
+        case OBJECT_HASH:
+            // Versions of a hash share trie nodes, each node is only walked once a collection
+            hamt_visit(&object->hash.pairs, gc.collections, mark_hash_pair);
+            break;
+        case OBJECT_CLOSURE:
+            gc_mark_object(object->closure.fn);
+            for (int i = 0; i < object->closure.num_free; i++){
+                gc_mark_value(object->closure.free[i]);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void trace_environment(environment_t *env){
+    for (int i = 0; i < env->size; i++){
+        gc_mark_value(env->slots[i]);
+    }
+    gc_mark_environment(env->outer);
+}
+
+static void mark_roots(void){
+    for (size_t i = 0; i < gc.roots_count; i++){
+        if (gc.roots[i].kind == ROOT_OBJECT){
+            gc_mark_value(gc.roots[i].value);
+        } else {
+            gc_mark_environment(gc.roots[i].env);
+        }
+    }
+    for (size_t i = 0; i < gc.markers_count; i++){
+        gc.markers[i].marker(gc.markers[i].context);
+    }
+}
+
+static void trace_references(void){
+    while (gc.grey_objects_count > 0 || gc.grey_envs_count > 0){
+        while (gc.grey_objects_count > 0){
+            trace_object(gc.grey_objects[--gc.grey_objects_count]);
+        }
+        while (gc.grey_envs_count > 0){
+            trace_environment(gc.grey_envs[--gc.grey_envs_count]);
+        }
+    }
+}
+
+static void sweep(void){
+    object_t **object = &gc.objects;
+    while (*object != NULL){
+        if ((*object)->marked){
+            (*object)->marked = false;
+            object = &(*object)->gc_next;
+            continue;
+        }
+        object_t *unreached = *object;
+        *object = unreached->gc_next;
+        free_object(unreached);
+        gc.live_objects--;
+        gc.bytes_allocated -= sizeof(object_t);
+    }
+
+    environment_t **env = &gc.environments;
+    while (*env != NULL){
+        if ((*env)->marked){
+            (*env)->marked = false;
+            env = &(*env)->gc_next;
+            continue;
+        }
+        environment_t *unreached = *env;
+        *env = unreached->gc_next;
+        gc.live_environments--;
+        gc.bytes_allocated -= environment_bytes(unreached);
+        free_environment(unreached);
+    }
+}
+
+void gc_collect(void){
+    stats_enter(PHASE_GC);
+    gc.collections++;
+    mark_roots();
+    trace_references();
+    sweep();
+    stats_leave();
+
+    gc.next_collection = gc.bytes_allocated * GC_GROWTH_FACTOR;
+    if (gc.next_collection < GC_INITIAL_THRESHOLD){
+        gc.next_collection = GC_INITIAL_THRESHOLD;
+    }
+}
+
+void gc_safepoint(void){
+#ifdef GC_STRESS
+    gc_collect();
+#else
+    if (gc.bytes_allocated >= gc.next_collection){
+        gc_collect();
+    }
+#endif
+}
+
+size_t gc_live_objects(void){
+    return gc.live_objects;
+}
+
+size_t gc_live_environments(void){
+    return gc.live_environments;
+}
+
+size_t gc_bytes_allocated(void){
+    return gc.bytes_allocated;
+}
+
+size_t gc_collections(void){
+    return gc.collections;
+}
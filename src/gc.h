@@ -0,0 +1,50 @@
+#ifndef GC_H
+#define GC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "value.h"
+
+/*
+ * Mark and sweep collector that owns every object_t and environment_t.
+ *
+ * Collection only ever happens at gc_safepoint(), which the evaluator calls between
+ * statements and the VM calls on function calls and pops. Anything a caller is still
+ * holding in a C local across a safepoint has to be reachable from a root: the
+ * environment chain, the root stack below, or a registered root marker (the VM uses
+ * one for its stack, globals and frames).
+ *
+ * Build with -DGC_STRESS to collect at every safepoint.
+ */
+
+struct Environment;
+typedef struct Environment environment_t;
+
+#define GC_INITIAL_THRESHOLD (1024 * 1024)
+#define GC_GROWTH_FACTOR 2
+
+typedef void (*gc_root_marker_t)(void *context);
+
+object_t *gc_alloc_object(void);
+void gc_track_environment(environment_t *env);
+void gc_track_resize(size_t old_size, size_t new_size);
+
+void gc_push_root(value_t value);
+void gc_push_env_root(environment_t *env);
+size_t gc_save_roots(void);
+void gc_restore_roots(size_t saved);
+void gc_add_root_marker(gc_root_marker_t marker, void *context);
+void gc_remove_root_marker(gc_root_marker_t marker, void *context);
+
+void gc_mark_object(object_t *object);
+void gc_mark_value(value_t value);
+void gc_mark_environment(environment_t *env);
+
+void gc_safepoint(void);
+void gc_collect(void);
+size_t gc_live_objects(void);
+size_t gc_live_environments(void);
+size_t gc_bytes_allocated(void);
+size_t gc_collections(void);
+
+#endif
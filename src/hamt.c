@@ -0,0 +1,325 @@
+#include "hamt.h"
+#include <stdlib.h>
+#include <string.h>
+
+static hamt_node_t *alloc_node(uint32_t size){
+    hamt_node_t *node = malloc(sizeof(hamt_node_t) + sizeof(hamt_slot_t) * size);
+    if (node == NULL){
+        return NULL;
+    }
+    node->refs = 1;
+    node->bitmap = 0;
+    node->size = size;
+    node->visited = 0;
+    return node;
+}
+
+static void release_node(hamt_node_t *node){
+    if (node == NULL || --node->refs > 0){
+        return;
+    }
+    for (uint32_t i = 0; i < node->size; i++){
+        if (node->slots[i].key == NULL){
+            release_node(node->slots[i].child);
+        }
+    }
+    free(node);
+}
+
+/*
+ * The node to write into, with grow slots opened (1) or closed (-1) at pos. That is the
+ * node itself when it can change in place, otherwise a copy sharing its children.
+ */
+static hamt_node_t *writable(hamt_node_t *node, bool in_place, uint32_t pos, int grow){
+    if (in_place && grow == 0){
+        return node;
+    }
+    hamt_node_t *copy = alloc_node(node->size + grow);
+    if (copy == NULL){
+        return NULL;
+    }
+    copy->bitmap = node->bitmap;
+    memcpy(copy->slots, node->slots, sizeof(hamt_slot_t) * pos);
+    if (grow >= 0){
+        memcpy(copy->slots + pos + grow, node->slots + pos, sizeof(hamt_slot_t) * (node->size - pos));
+    } else {
+        memcpy(copy->slots + pos, node->slots + pos + 1, sizeof(hamt_slot_t) * (node->size - pos - 1));
+    }
+
+    if (in_place){
+        // The slots moved over with their references, only the old block goes
+        free(node);
+        return copy;
+    }
+    for (uint32_t i = 0; i < copy->size; i++){
+        if (copy->slots[i].key == NULL && !(grow > 0 && i == pos)){
+            copy->slots[i].child->refs++;
+        }
+    }
+    return copy;
+}
+
+static uint32_t slot_bit(uint64_t hash, unsigned shift){
+    return 1u << ((hash >> shift) & HAMT_MASK);
+}
+
+static uint32_t slot_pos(hamt_node_t *node, uint32_t bit){
+    return __builtin_popcount(node->bitmap & (bit - 1));
+}
+
+/*In place, the caller hands over its only reference to node, otherwise node is left alone*/
+static hamt_node_t *node_set(hamt_node_t *node, bool in_place, unsigned shift, hamt_slot_t entry,
+                             key_equals_t key_equals, bool *added){
+    if (shift >= HAMT_MAX_SHIFT){
+        for (uint32_t i = 0; i < node->size; i++){
+            if (key_equals(node->slots[i].key, entry.key)){
+                hamt_node_t *target = writable(node, in_place, i, 0);
+                if (target != NULL){
+                    target->slots[i] = entry;
+                }
+                return target;
+            }
+        }
+        hamt_node_t *target = writable(node, in_place, node->size, 1);
+        if (target != NULL){
+            target->slots[target->size - 1] = entry;
+            *added = true;
+        }
+        return target;
+    }
+
+    uint32_t bit = slot_bit(entry.hash, shift);
+    uint32_t pos = slot_pos(node, bit);
+    if (!(node->bitmap & bit)){
+        hamt_node_t *target = writable(node, in_place, pos, 1);
+        if (target != NULL){
+            target->bitmap |= bit;
+            target->slots[pos] = entry;
+            *added = true;
+        }
+        return target;
+    }
+
+    hamt_slot_t slot = node->slots[pos];
+    hamt_slot_t replacement = entry;
+    bool child_in_place = false;
+    if (slot.key == NULL){
+        child_in_place = in_place && slot.child->refs == 1;
+        replacement = (hamt_slot_t){ .child = node_set(slot.child, child_in_place, shift + HAMT_BITS, entry, key_equals, added) };
+        if (replacement.child == NULL){
+            return NULL;
+        }
+    } else if (slot.hash != entry.hash || !key_equals(slot.key, entry.key)){
+        // Two keys want this slot, move both one level down
+        hamt_node_t *child = alloc_node(0);
+        bool ignored = false;
+        child = child == NULL ? NULL : node_set(child, true, shift + HAMT_BITS, slot, key_equals, &ignored);
+        child = child == NULL ? NULL : node_set(child, true, shift + HAMT_BITS, entry, key_equals, &ignored);
+        if (child == NULL){
+            return NULL;
+        }
+        replacement = (hamt_slot_t){ .child = child };
+        *added = true;
+    }
+
+    hamt_node_t *target = writable(node, in_place, pos, 0);
+    if (target == NULL){
+        return NULL;
+    }
+    if (slot.key == NULL && !child_in_place){
+        // Drop the reference to the child being replaced, the old version keeps its own
+        release_node(slot.child);
+    }
+    target->slots[pos] = replacement;
+    return target;
+}
+
+/*Returns node itself when the key isn't there, and NULL when the node ends up empty*/
+static hamt_node_t *node_delete(hamt_node_t *node, unsigned shift, void *key, uint64_t hash,
+                                key_equals_t key_equals, bool *removed){
+    if (shift >= HAMT_MAX_SHIFT){
+        for (uint32_t i = 0; i < node->size; i++){
+            if (key_equals(node->slots[i].key, key)){
+                *removed = true;
+                return node->size == 1 ? NULL : writable(node, false, i, -1);
+            }
+        }
+        return node;
+    }
+
+    uint32_t bit = slot_bit(hash, shift);
+    if (!(node->bitmap & bit)){
+        return node;
+    }
+    uint32_t pos = slot_pos(node, bit);
+    hamt_slot_t slot = node->slots[pos];
+    hamt_slot_t replacement;
+    if (slot.key != NULL){
+        if (slot.hash != hash || !key_equals(slot.key, key)){
+            return node;
+        }
+        *removed = true;
+        replacement = (hamt_slot_t){0};
+    } else {
+        hamt_node_t *child = node_delete(slot.child, shift + HAMT_BITS, key, hash, key_equals, removed);
+        if (!*removed){
+            return node;
+        }
+        replacement = (hamt_slot_t){ .child = child };
+        if (child != NULL && child->size == 1 && child->slots[0].key != NULL){
+            // A lone entry moves back up, so lookups stay as short as for a fresh trie
+            replacement = child->slots[0];
+            release_node(child);
+        }
+    }
+
+    if (replacement.key == NULL && replacement.child == NULL){
+        if (node->size == 1){
+            return NULL;
+        }
+        hamt_node_t *target = writable(node, false, pos, -1);
+        if (target != NULL){
+            target->bitmap &= ~bit;
+        }
+        return target;
+    }
+    hamt_node_t *target = writable(node, false, pos, 0);
+    if (target != NULL){
+        release_node(slot.child);
+        target->slots[pos] = replacement;
+    }
+    return target;
+}
+
+hamt_t new_hamt(key_equals_t key_equals){
+    return (hamt_t){ .key_equals = key_equals };
+}
+
+void *hamt_get(const hamt_t *map, void *key, uint64_t hash){
+    hamt_node_t *node = map->root;
+    hash_stats.hamt_lookups++;
+    for (unsigned shift = 0; node != NULL; shift += HAMT_BITS){
+        hash_stats.hamt_levels++;
+        if (shift >= HAMT_MAX_SHIFT){
+            for (uint32_t i = 0; i < node->size; i++){
+                if (map->key_equals(node->slots[i].key, key)){
+                    return node->slots[i].value;
+                }
+            }
+            return NULL;
+        }
+        uint32_t bit = slot_bit(hash, shift);
+        if (!(node->bitmap & bit)){
+            return NULL;
+        }
+        hamt_slot_t *slot = &node->slots[slot_pos(node, bit)];
+        if (slot->key == NULL){
+            node = slot->child;
+            continue;
+        }
+        return slot->hash == hash && map->key_equals(slot->key, key) ? slot->value : NULL;
+    }
+    return NULL;
+}
+
+bool hamt_insert(hamt_t *map, void *key, uint64_t hash, void *value){
+    hamt_node_t *root = map->root != NULL ? map->root : alloc_node(0);
+    if (root == NULL){
+        return false;
+    }
+    bool in_place = root->refs == 1;
+    bool added = false;
+    hamt_slot_t entry = { .key = key, .value = value, .hash = hash };
+    hamt_node_t *updated = node_set(root, in_place, 0, entry, map->key_equals, &added);
+    if (updated == NULL){
+        return false;
+    }
+    if (!in_place){
+        // This version's reference moves from the shared root to its new one
+        release_node(root);
+    }
+    map->root = updated;
+    map->count += added;
+    return true;
+}
+
+bool hamt_set(const hamt_t *map, void *key, uint64_t hash, void *value, hamt_t *out){
+    *out = *map;
+    if (out->root != NULL){
+        out->root->refs++;
+    }
+    return hamt_insert(out, key, hash, value);
+}
+
+bool hamt_delete(const hamt_t *map, void *key, uint64_t hash, hamt_t *out){
+    *out = *map;
+    bool removed = false;
+    hamt_node_t *root = map->root == NULL ? NULL : node_delete(map->root, 0, key, hash, map->key_equals, &removed);
+    if (!removed){
+        if (out->root != NULL){
+            out->root->refs++;
+        }
+        return false;
+    }
+    out->root = root;
+    out->count--;
+    return true;
+}
+
+void hamt_release(hamt_t *map){
+    release_node(map->root);
+    map->root = NULL;
+    map->count = 0;
+}
+
+hamt_iter_t hamt_iter(const hamt_t *map){
+    hamt_iter_t iter = {0};
+    if (map->root != NULL){
+        iter.nodes[0] = map->root;
+        iter.depth = 1;
+    }
+    return iter;
+}
+
+bool hamt_next(hamt_iter_t *iter){
+    while (iter->depth > 0){
+        int top = iter->depth - 1;
+        hamt_node_t *node = iter->nodes[top];
+        if (iter->index[top] == node->size){
+            iter->depth--;
+            continue;
+        }
+        hamt_slot_t *slot = &node->slots[iter->index[top]++];
+        if (slot->key == NULL){
+            iter->nodes[iter->depth] = slot->child;
+            iter->index[iter->depth] = 0;
+            iter->depth++;
+            continue;
+        }
+        iter->key = slot->key;
+        iter->value = slot->value;
+        return true;
+    }
+    return false;
+}
+
+static void visit_node(hamt_node_t *node, size_t epoch, hamt_visit_t visit){
+    // Shared subtrees are walked once per epoch however many versions hold them
+    if (node->visited == epoch){
+        return;
+    }
+    node->visited = epoch;
+    for (uint32_t i = 0; i < node->size; i++){
+        if (node->slots[i].key == NULL){
+            visit_node(node->slots[i].child, epoch, visit);
+        } else {
+            visit(node->slots[i].key, node->slots[i].value);
+        }
+    }
+}
+
+void hamt_visit(const hamt_t *map, size_t epoch, hamt_visit_t visit){
+    if (map->root != NULL){
+        visit_node(map->root, epoch, visit);
+    }
+}
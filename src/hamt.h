@@ -0,0 +1,75 @@
+#ifndef HAMT_H
+#define HAMT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "hashmap.h"
+
+/*
+ * Hash array mapped trie, a persistent map. Each level uses HAMT_BITS bits of the hash
+ * to pick one of 32 slots, and a node only stores the slots it uses, located through a
+ * bitmap. An update copies the nodes on the path to the changed slot and shares all the
+ * others, so earlier versions stay valid. Nodes are reference counted across versions.
+ *
+ * Iteration follows the hash bits, so the order depends on the keys and not on the
+ * order they were inserted in.
+ */
+#define HAMT_BITS 5
+#define HAMT_MASK 31
+/*Past this shift the hash is used up, keys with identical hashes share a list node*/
+#define HAMT_MAX_SHIFT 64
+#define HAMT_MAX_DEPTH 14
+
+typedef struct HamtNode hamt_node_t;
+
+typedef struct HamtSlot {
+	void *key; // NULL when the slot holds a child node
+	union {
+		void *value;
+		hamt_node_t *child;
+	};
+	uint64_t hash;
+} hamt_slot_t;
+
+struct HamtNode {
+	int refs;
+	uint32_t bitmap; // unused in list nodes
+	uint32_t size;
+	size_t visited; // last epoch passed to hamt_visit
+	hamt_slot_t slots[];
+};
+
+/*A version of the map. Copy it with hamt_set/hamt_delete, not by assignment*/
+typedef struct Hamt {
+	hamt_node_t *root;
+	size_t count;
+	key_equals_t key_equals;
+} hamt_t;
+
+typedef struct HamtIter {
+	hamt_node_t *nodes[HAMT_MAX_DEPTH];
+	uint32_t index[HAMT_MAX_DEPTH];
+	int depth;
+	void *key;
+	void *value;
+} hamt_iter_t;
+
+typedef void (*hamt_visit_t)(void *key, void *value);
+
+hamt_t new_hamt(key_equals_t key_equals);
+void *hamt_get(const hamt_t *map, void *key, uint64_t hash);
+/*Updates map itself, only copying nodes that another version still shares*/
+bool hamt_insert(hamt_t *map, void *key, uint64_t hash, void *value);
+/*Make a new version in out and leave map as it was*/
+bool hamt_set(const hamt_t *map, void *key, uint64_t hash, void *value, hamt_t *out);
+bool hamt_delete(const hamt_t *map, void *key, uint64_t hash, hamt_t *out);
+void hamt_release(hamt_t *map);
+
+hamt_iter_t hamt_iter(const hamt_t *map);
+bool hamt_next(hamt_iter_t *iter);
+
+/*Calls visit for entries in nodes not already visited with this epoch, epochs start at 1*/
+void hamt_visit(const hamt_t *map, size_t epoch, hamt_visit_t visit);
+
+#endif
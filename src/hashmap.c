@@ -3,45 +3,183 @@
 #include <string.h>
 #include <stdbool.h>
 
+hash_stats_t hash_stats;
+
 hash_map_t *new_hash_table(free_value_t free_fn){
-    hash_map_t *hash_map = malloc(sizeof(hash_map_t));
-    hash_map->table = calloc(TABLE_SIZE, sizeof(hash_entry_t*));
+    // The entry array is allocated on first insert, so empty maps cost one small struct
+    hash_map_t *hash_map = calloc(1, sizeof(hash_map_t));
     hash_map->free_value = free_fn;
     return hash_map;
 }
 
-bool hash_set(hash_map_t *hash_map, char *key, void *value){
-    uint64_t idx = fnv1a_hash(key) % TABLE_SIZE;
-    hash_entry_t *curr_entry = hash_map->table[idx];
-    while(curr_entry != NULL){
-        if(strcmp(curr_entry->key, key) == 0){
-            curr_entry->value = value;
-            return true;
+hash_map_t *new_keyed_hash_table(key_equals_t key_equals, free_value_t free_fn){
+    hash_map_t *hash_map = new_hash_table(free_fn);
+    hash_map->key_equals = key_equals;
+    return hash_map;
+}
+
+static bool keys_equal(hash_map_t *hash_map, void *a, void *b){
+    if (hash_map->key_equals != NULL){
+        return hash_map->key_equals(a, b);
+    }
+    return strcmp(a, b) == 0;
+}
+
+static size_t probe_distance(hash_map_t *hash_map, hash_entry_t *entry, size_t idx){
+    return (idx - (entry->hash & (hash_map->capacity - 1))) & (hash_map->capacity - 1);
+}
+
+/*Robin Hood insert of a key that isn't in the table yet, the entry already owns its key*/
+static void insert_entry(hash_map_t *hash_map, hash_entry_t entry){
+    size_t mask = hash_map->capacity - 1;
+    size_t idx = entry.hash & mask;
+    size_t dist = 0;
+    for (;;){
+        hash_entry_t *slot = &hash_map->entries[idx];
+        if (slot->key == NULL){
+            *slot = entry;
+            hash_map->count++;
+            return;
+        }
+        size_t slot_dist = probe_distance(hash_map, slot, idx);
+        if (slot_dist < dist){
+            // Take the slot from the richer entry and keep placing that one instead
+            hash_entry_t displaced = *slot;
+            *slot = entry;
+            entry = displaced;
+            dist = slot_dist;
         }
-        curr_entry = curr_entry->next;
+        idx = (idx + 1) & mask;
+        dist++;
     }
+}
 
-    hash_entry_t *entry = malloc(sizeof(hash_entry_t));
-    if (entry == NULL){
+static bool grow(hash_map_t *hash_map){
+    size_t old_capacity = hash_map->capacity;
+    hash_entry_t *old_entries = hash_map->entries;
+    size_t capacity = old_capacity == 0 ? HASH_MIN_CAPACITY : old_capacity * 2;
+
+    hash_entry_t *entries = calloc(capacity, sizeof(hash_entry_t));
+    if (entries == NULL){
         return false;
     }
-    entry->key = strdup(key);
-    entry->value = value;
-    entry->next = hash_map->table[idx];
-    hash_map->table[idx] = entry;
+    hash_map->entries = entries;
+    hash_map->capacity = capacity;
+    hash_map->count = 0;
+    for (size_t i = 0; i < old_capacity; i++){
+        if (old_entries[i].key != NULL){
+            insert_entry(hash_map, old_entries[i]);
+        }
+    }
+    free(old_entries);
     return true;
 }
 
+static void count_probes(size_t dist){
+    hash_stats.probes += dist;
+    if (dist > hash_stats.longest_probe){
+        hash_stats.longest_probe = dist;
+    }
+}
+
+static hash_entry_t *find_entry(hash_map_t *hash_map, void *key, uint64_t hash){
+    hash_stats.lookups++;
+    if (hash_map->count == 0){
+        return NULL;
+    }
+    size_t mask = hash_map->capacity - 1;
+    size_t idx = hash & mask;
+    for (size_t dist = 0;; dist++){
+        hash_entry_t *slot = &hash_map->entries[idx];
+        // Past the point where the key would have displaced this entry, so it's absent
+        if (slot->key == NULL || probe_distance(hash_map, slot, idx) < dist){
+            count_probes(dist);
+            return NULL;
+        }
+        if (slot->hash == hash && keys_equal(hash_map, slot->key, key)){
+            count_probes(dist);
+            return slot;
+        }
+        idx = (idx + 1) & mask;
+    }
+}
+
+bool hash_set_hashed(hash_map_t *hash_map, void *key, uint64_t hash, void *value){
+    hash_entry_t *existing = find_entry(hash_map, key, hash);
+    if (existing != NULL){
+        existing->value = value;
+        return true;
+    }
+
+    if ((hash_map->count + 1) * 100 > hash_map->capacity * HASH_MAX_LOAD && !grow(hash_map)){
+        return false;
+    }
+    void *owned_key = hash_map->key_equals == NULL ? strdup(key) : key;
+    if (owned_key == NULL){
+        return false;
+    }
+    insert_entry(hash_map, (hash_entry_t){ .key = owned_key, .value = value, .hash = hash });
+    return true;
+}
+
+bool hash_set(hash_map_t *hash_map, char *key, void *value){
+    return hash_set_hashed(hash_map, key, fnv1a_hash(key), value);
+}
+
+void *hash_get_hashed(hash_map_t *hash_map, void *key, uint64_t hash){
+    hash_entry_t *entry = find_entry(hash_map, key, hash);
+    return entry == NULL ? NULL : entry->value;
+}
+
 void *hash_get(hash_map_t *hash_map, char *key){
-    uint64_t idx = fnv1a_hash(key) % TABLE_SIZE;
-    hash_entry_t *curr_entry = hash_map->table[idx];
-    while(curr_entry != NULL){
-        if(strcmp(curr_entry->key, key) == 0){
-            return curr_entry->value;
+    return hash_get_hashed(hash_map, key, fnv1a_hash(key));
+}
+
+bool hash_delete_hashed(hash_map_t *hash_map, void *key, uint64_t hash){
+    hash_entry_t *entry = find_entry(hash_map, key, hash);
+    if (entry == NULL){
+        return false;
+    }
+    if (hash_map->key_equals == NULL){
+        free(entry->key);
+    }
+    if (hash_map->free_value != NULL){
+        hash_map->free_value(entry->value);
+    }
+
+    // Backward shift: pull the rest of the run one slot closer to home
+    size_t mask = hash_map->capacity - 1;
+    size_t idx = entry - hash_map->entries;
+    size_t next = (idx + 1) & mask;
+    while (hash_map->entries[next].key != NULL && probe_distance(hash_map, &hash_map->entries[next], next) > 0){
+        hash_map->entries[idx] = hash_map->entries[next];
+        idx = next;
+        next = (next + 1) & mask;
+    }
+    hash_map->entries[idx] = (hash_entry_t){0};
+    hash_map->count--;
+    return true;
+}
+
+bool hash_delete(hash_map_t *hash_map, char *key){
+    return hash_delete_hashed(hash_map, key, fnv1a_hash(key));
+}
+
+hash_iter_t hash_iter(hash_map_t *hash_map){
+    return (hash_iter_t){ .map = hash_map };
+}
+
+bool hash_next(hash_iter_t *iter){
+    hash_map_t *hash_map = iter->map;
+    while (hash_map != NULL && iter->index < hash_map->capacity){
+        hash_entry_t *entry = &hash_map->entries[iter->index++];
+        if (entry->key != NULL){
+            iter->key = entry->key;
+            iter->value = entry->value;
+            return true;
         }
-        curr_entry = curr_entry->next;
     }
-    return NULL;
+    return false;
 }
 
 uint64_t fnv1a_hash(const char* str) {
@@ -53,20 +191,29 @@ uint64_t fnv1a_hash(const char* str) {
     return hash;
 }
 
+uint64_t fnv1a_hash_n(const char *str, size_t length){
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; i++){
+        hash ^= (uint64_t)str[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
 void free_hash(hash_map_t *hash_map){
     if (hash_map == NULL) return;
-    for(int i = 0; i < TABLE_SIZE; i++){
-        hash_entry_t *curr_entry = hash_map->table[i];
-        while(curr_entry != NULL){
-            hash_entry_t *next = curr_entry->next;
-            free(curr_entry->key);
-            if (hash_map->free_value != NULL){
-                hash_map->free_value(curr_entry->value);
-            }
-            free(curr_entry);
-            curr_entry = next;
+    for (size_t i = 0; i < hash_map->capacity; i++){
+        hash_entry_t *entry = &hash_map->entries[i];
+        if (entry->key == NULL){
+            continue;
+        }
+        if (hash_map->key_equals == NULL){
+            free(entry->key);
+        }
+        if (hash_map->free_value != NULL){
+            hash_map->free_value(entry->value);
         }
     }
-    free(hash_map->table);
+    free(hash_map->entries);
     free(hash_map);
 }
@@ -5,25 +5,69 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-// TODO: Implement dynamic sizing here too
-#define TABLE_SIZE 128
+/*
+ * Open addressing with Robin Hood probing. Entries live inline in one array whose
+ * capacity is a power of two, the table doubles once it is more than HASH_MAX_LOAD
+ * percent full. Deletion shifts the following run back by one, so there are no tombstones.
+ */
+#define HASH_MIN_CAPACITY 8
+#define HASH_MAX_LOAD 80
 
-typedef struct HashEntry hash_entry_t;
 typedef struct HashEntry{
-	char *key;
+	void *key; // NULL marks an empty slot
 	void *value;
-	hash_entry_t *next;
+	uint64_t hash;
 } hash_entry_t;
 
 typedef void (*free_value_t)(void *);
+typedef bool (*key_equals_t)(void *, void *);
 typedef struct HashMap{
-	hash_entry_t **table;
+	hash_entry_t *entries;
+	size_t capacity;
+	size_t count;
 	free_value_t free_value;
+	/*NULL for string keys, which the map copies and owns. Other keys are borrowed*/
+	key_equals_t key_equals;
 } hash_map_t;
 
+typedef struct HashIter{
+	hash_map_t *map;
+	size_t index;
+	void *key;
+	void *value;
+} hash_iter_t;
+
 hash_map_t *new_hash_table(free_value_t free_fn);
 bool hash_set(hash_map_t *hash_map, char *key, void *value);
 void *hash_get(hash_map_t *hash_map, char *key);
+bool hash_delete(hash_map_t *hash_map, char *key);
+void free_hash(hash_map_t *hash_map);
 uint64_t fnv1a_hash(const char* str);
+uint64_t fnv1a_hash_n(const char *str, size_t length);
+
+/*Maps over caller defined keys, the caller supplies the hash so it can be cached*/
+hash_map_t *new_keyed_hash_table(key_equals_t key_equals, free_value_t free_fn);
+bool hash_set_hashed(hash_map_t *hash_map, void *key, uint64_t hash, void *value);
+void *hash_get_hashed(hash_map_t *hash_map, void *key, uint64_t hash);
+bool hash_delete_hashed(hash_map_t *hash_map, void *key, uint64_t hash);
+
+/*
+ * Lookup counters for --stats. The table counters cover hash_map_t, the interpreter's
+ * own tables, and a probe is one slot past the key's home slot. Monkey hashes are HAMTs
+ * and count separately, a level is one trie node visited.
+ */
+typedef struct HashStats{
+	size_t lookups;
+	size_t probes;
+	size_t longest_probe;
+	size_t hamt_lookups;
+	size_t hamt_levels;
+} hash_stats_t;
+
+extern hash_stats_t hash_stats;
+
+/*Visits entries in table order, which is stable as long as the map isn't modified*/
+hash_iter_t hash_iter(hash_map_t *hash_map);
+bool hash_next(hash_iter_t *iter);
 
 #endif
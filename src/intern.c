@@ -0,0 +1,100 @@
+#include "intern.h"
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct Interned {
+    uint64_t hash;
+    size_t length;
+    char data[];
+} interned_t;
+
+/*Linear probing over a power of two table, entries are never removed*/
+typedef struct InternPool {
+    interned_t **entries;
+    size_t capacity;
+    size_t count;
+    arena_t *strings;
+} intern_pool_t;
+
+static intern_pool_t pool;
+
+static interned_t *header(const char *interned){
+    return (interned_t *)(interned - offsetof(interned_t, data));
+}
+
+static void grow_pool(void){
+    size_t capacity = pool.capacity == 0 ? INTERN_MIN_CAPACITY : pool.capacity * 2;
+    interned_t **entries = calloc(capacity, sizeof(interned_t *));
+    for (size_t i = 0; i < pool.capacity; i++){
+        interned_t *entry = pool.entries[i];
+        if (entry == NULL){
+            continue;
+        }
+        size_t idx = entry->hash & (capacity - 1);
+        while (entries[idx] != NULL){
+            idx = (idx + 1) & (capacity - 1);
+        }
+        entries[idx] = entry;
+    }
+    free(pool.entries);
+    pool.entries = entries;
+    pool.capacity = capacity;
+}
+
+const char *intern(const char *str, size_t length){
+    // Kept under half full so probe runs stay short
+    if ((pool.count + 1) * 2 > pool.capacity){
+        grow_pool();
+    }
+    uint64_t hash = fnv1a_hash_n(str, length);
+    size_t idx = hash & (pool.capacity - 1);
+    for (interned_t *entry; (entry = pool.entries[idx]) != NULL; idx = (idx + 1) & (pool.capacity - 1)){
+        if (entry->hash == hash && entry->length == length && memcmp(entry->data, str, length) == 0){
+            return entry->data;
+        }
+    }
+
+    if (pool.strings == NULL){
+        pool.strings = new_arena();
+    }
+    interned_t *entry = arena_alloc(pool.strings, sizeof(interned_t) + length + 1);
+    entry->hash = hash;
+    entry->length = length;
+    memcpy(entry->data, str, length);
+    pool.entries[idx] = entry;
+    pool.count++;
+    return entry->data;
+}
+
+const char *intern_string(const char *str){
+    return intern(str, strlen(str));
+}
+
+uint64_t interned_hash(const char *interned){
+    return header(interned)->hash;
+}
+
+size_t interned_length(const char *interned){
+    return header(interned)->length;
+}
+
+size_t intern_count(void){
+    return pool.count;
+}
+
+static bool interned_equals(void *a, void *b){
+    return a == b;
+}
+
+hash_map_t *new_interned_hash_table(free_value_t free_fn){
+    return new_keyed_hash_table(interned_equals, free_fn);
+}
+
+void *interned_get(hash_map_t *map, const char *key){
+    return hash_get_hashed(map, (void *)key, interned_hash(key));
+}
+
+bool interned_set(hash_map_t *map, const char *key, void *value){
+    return hash_set_hashed(map, (void *)key, interned_hash(key), value);
+}
@@ -0,0 +1,29 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "hashmap.h"
+
+/*
+ * Process wide pool of immutable strings. Each distinct string is stored once, next to
+ * its length and hash, so two interned strings are equal exactly when their pointers
+ * are. Identifiers and string literals are interned by the parser, and the maps keyed
+ * by names (environments, the resolver, symbol tables) expect interned keys.
+ * Interned strings live as long as the process.
+ */
+#define INTERN_MIN_CAPACITY 256
+
+const char *intern(const char *str, size_t length);
+const char *intern_string(const char *str);
+uint64_t interned_hash(const char *interned);
+size_t interned_length(const char *interned);
+size_t intern_count(void);
+
+/*Maps keyed by interned strings, keys compare by pointer and bring their own hash*/
+hash_map_t *new_interned_hash_table(free_value_t free_fn);
+void *interned_get(hash_map_t *map, const char *key);
+bool interned_set(hash_map_t *map, const char *key, void *value);
+
+#endif
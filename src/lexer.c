@@ -1,153 +1,158 @@
 #include "lexer.h"
 #include "token.h"
+#include "stats.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <stdio.h>
 
-token_t *lexer_next_token(lexer_t *lexer){
-	token_t *tok;
+enum {
+	CHAR_SPACE = 1,
+	CHAR_LETTER = 2,
+	CHAR_DIGIT = 4,
+};
+
+static const unsigned char CHAR_CLASS[256] = {
+	[' '] = CHAR_SPACE, ['\t'] = CHAR_SPACE, ['\n'] = CHAR_SPACE, ['\r'] = CHAR_SPACE,
+	['a' ... 'z'] = CHAR_LETTER, ['A' ... 'Z'] = CHAR_LETTER, ['_'] = CHAR_LETTER,
+	['0' ... '9'] = CHAR_DIGIT,
+};
+
+/*Skips the run of characters in char_class starting at the current one, scanning the buffer directly*/
+static void skip_run(lexer_t *l, unsigned char char_class){
+	const char *p = l->input + l->position;
+	const char *end = l->input + l->length;
+	while (p < end && (CHAR_CLASS[(unsigned char)*p] & char_class)){
+		p++;
+	}
+	l->read_position = p - l->input;
+	read_char(l);
+}
+
+static token_t next_token(lexer_t *lexer){
+	TokenType type;
 	skip_whitespace(lexer);
+	int position = lexer->position;
 
 	switch (lexer->ch){
 		case '=':
 			if (peek_char(lexer) == '='){
 				read_char(lexer);
-				tok = new_token(EQ, "==");
-
+				type = EQ;
 			} else {
-				tok = new_token(ASSIGN, "=");
+				type = ASSIGN;
 			}
 			break;
 		case ';':
-			tok = new_token(SEMICOLON, ";");
+			type = SEMICOLON;
 			break;
 		case '(':
-			tok = new_token(LPAREN, "(");
+			type = LPAREN;
 			break;
 		case ')':
-			tok = new_token(RPAREN, ")");
+			type = RPAREN;
 			break;
 		case ',':
-			tok = new_token(COMMA, ",");
+			type = COMMA;
 			break;
 		case '+':
-			tok = new_token(PLUS, "+");
+			type = PLUS;
 			break;
 		case '-':
-			tok = new_token(MINUS, "-");
+			type = MINUS;
 			break;
 		case '!':
 			if (peek_char(lexer) == '='){
 				read_char(lexer);
-				tok = new_token(NOT_EQ, "!=");
+				type = NOT_EQ;
 			} else {
-				tok = new_token(BANG, "!");
+				type = BANG;
 			}
 			break;
 		case '/':
-			tok = new_token(SLASH, "/");
+			type = SLASH;
 			break;
 		case '*':
-			tok = new_token(ASTERISK, "*");
+			type = ASTERISK;
 			break;
 		case '<':
-			tok = new_token(LT, "<");
+			type = LT;
 			break;
 		case '>':
-			tok = new_token(GT, ">");
+			type = GT;
 			break;
 		case '{':
-			tok = new_token(LBRACE, "{");
+			type = LBRACE;
 			break;
 		case '}':
-			tok = new_token(RBRACE, "}");
+			type = RBRACE;
 			break;
 		case '"':
-			tok = new_token(STRING, read_string(lexer));
-			break;
+			return read_string(lexer);
 		case '[':
-			tok = new_token(LBRACKET, "{");
+			type = LBRACKET;
 			break;
 		case ']':
-			tok = new_token(RBRACKET, "}");
+			type = RBRACKET;
 			break;
 		case ':':
-			tok = new_token(COLON, ":");
+			type = COLON;
 			break;
 		case 0:
-			tok = new_token(EOF_TOKEN, "");
-			break;
+			// Stay put, the parser keeps asking for tokens past the end
+			return new_token(EOF_TOKEN, position, 0);
 		default:
 			if (is_letter(lexer->ch)){
-				char *literal = read_identifier(lexer);
-				return new_token(lookup_ident(literal), literal);
+				return read_identifier(lexer);
 			} else if (is_digit(lexer->ch)){
-				char *literal = read_number(lexer);
-				return new_token(INT, literal);
+				return read_number(lexer);
 			} else {
-				char str[2];
-				str[0] = lexer->ch;
-				str[1] = '\0';
-				tok = new_token(ILLEGAL, strdup(str));
+				type = ILLEGAL;
 			}
 	}
 	read_char(lexer);
-	return tok;
+	return new_token(type, position, lexer->position - position);
 }
 
-char *read_string(lexer_t *l){
+token_t lexer_next_token(lexer_t *lexer){
+	if (!stats.enabled){
+		return next_token(lexer);
+	}
+	uint64_t start = stats_cycles();
+	token_t token = next_token(lexer);
+	stats.lex_cycles += stats_cycles() - start;
+	stats.phase_calls[PHASE_LEX]++;
+	return token;
+}
+
+token_t read_string(lexer_t *l){
 	int position = l->position+1;
+	// memchr is vectorised by libc, which matters for long string literals
+	const char *close = memchr(l->input + position, '"', l->length - position);
+	l->read_position = close != NULL ? close - l->input : l->length;
 	read_char(l);
-	while(l->ch != '"' && l->ch != 0){
+	token_t token = new_token(STRING, position, l->position - position);
+	if (l->ch == '"'){
 		read_char(l);
 	}
-	size_t length = l->position - position;
-	char *result_string = malloc(length + 1);
-	if (result_string == NULL) {
-		return NULL;
-	}
-
-	strncpy(result_string, l->input + position, length);
-	result_string[length] = '\0';
-	return result_string;
+	return token;
 }
 
-char *read_identifier(lexer_t *l){
+token_t read_identifier(lexer_t *l){
 	int position = l->position;
-	while(is_letter(l->ch)){
-		read_char(l);
-	}
-	size_t length = l->position - position;
-	char *result_string = malloc(length + 1);
-	if (result_string == NULL) {
-		return NULL;
-	}
-
-	strncpy(result_string, l->input + position, length);
-	result_string[length] = '\0';
-	return result_string;
+	skip_run(l, CHAR_LETTER);
+	int length = l->position - position;
+	return new_token(lookup_ident(l->input + position, length), position, length);
 }
 
-char *read_number(lexer_t *l){
+token_t read_number(lexer_t *l){
 	int position = l->position;
-	while(is_digit(l->ch)){
-		read_char(l);
-	}
-	size_t length = l->position - position;
-	char *result_string = malloc(length + 1);
-	if (result_string == NULL) {
-		return NULL;
-	}
-
-	strncpy(result_string, l->input + position, length);
-	result_string[length] = '\0';
-	return result_string;
+	skip_run(l, CHAR_DIGIT);
+	return new_token(INT, position, l->position - position);
 }
 
 void read_char(lexer_t *l){
-	//TODO: store length of input once?
-	if (l->read_position >= strlen(l->input)){
+	if (l->read_position >= l->length){
 		l->ch = 0;
 	} else {
 		l->ch = l->input[l->read_position];
@@ -157,7 +162,7 @@ void read_char(lexer_t *l){
 }
 
 char peek_char(lexer_t *l){
-	if (l->read_position >= strlen(l->input)){
+	if (l->read_position >= l->length){
 		return 0;
 	} else {
 		return l->input[l->read_position];
@@ -165,49 +170,59 @@ char peek_char(lexer_t *l){
 }
 
 void skip_whitespace(lexer_t *l){
-	while (l->ch == ' ' || l->ch == '\t' || l->ch =='\n' || l->ch == '\r'){
-		read_char(l);
+	if (CHAR_CLASS[(unsigned char)l->ch] & CHAR_SPACE){
+		skip_run(l, CHAR_SPACE);
 	}
 }
 
-TokenType lookup_ident(char *literal){
-	if (strcmp(literal, "fn") == 0){
-		return FUNCTION;
-	} else if (strcmp(literal, "let") == 0){
-		return LET;
-	} else if (strcmp(literal, "true") == 0){
-		return TRUE;
-	} else if (strcmp(literal, "false") == 0){
-		return FALSE;
-	} else if (strcmp(literal, "if") == 0){
-		return IF;
-	} else if (strcmp(literal, "else") == 0){
-		return ELSE;
-	} else if (strcmp(literal, "return") == 0){
-		return RETURN;
-	} else {
-		return IDENT;
+static const struct {
+	const char *literal;
+	TokenType type;
+} KEYWORDS[] = {
+	{"fn", FUNCTION},
+	{"let", LET},
+	{"true", TRUE},
+	{"false", FALSE},
+	{"if", IF},
+	{"else", ELSE},
+	{"return", RETURN},
+};
+
+TokenType lookup_ident(const char *literal, int length){
+	for (int i = 0; i < sizeof(KEYWORDS) / sizeof(KEYWORDS[0]); i++){
+		if (strncmp(KEYWORDS[i].literal, literal, length) == 0 && KEYWORDS[i].literal[length] == '\0'){
+			return KEYWORDS[i].type;
+		}
 	}
+	return IDENT;
 }
 
 
 bool is_letter(unsigned char ch) {
-    return ((ch >= 'a' && ch <= 'z') ||
-            (ch >= 'A' && ch <= 'Z') ||
-            (ch == '_'));
+	return CHAR_CLASS[ch] & CHAR_LETTER;
 }
 
 bool is_digit(unsigned char ch) {
-	return (('0' <= ch) && (ch <= '9'));
+	return CHAR_CLASS[ch] & CHAR_DIGIT;
 }
 
-lexer_t *new_lexer(char *input){
+lexer_t *new_lexer(const char *input){
+	return new_lexer_n(input, strlen(input));
+}
+
+lexer_t *new_lexer_n(const char *input, int length){
 	lexer_t *lexer = malloc(sizeof(lexer_t));
 	if (lexer == NULL){
 		return NULL;
 	}
-	lexer->input = strdup(input);
+	lexer->input = input;
+	lexer->length = length;
 	lexer->read_position = 0;
 	read_char(lexer);
 	return lexer;
 }
+
+/*The input is the caller's, tokens point into it so it has to outlive the AST*/
+void free_lexer(lexer_t *lexer){
+	free(lexer);
+}
@@ -5,22 +5,25 @@
 #include "token.h"
 
 typedef struct Lexer {
-	char	*input;
+	const char	*input; // borrowed from the caller, may not be NUL terminated
+	int	length;
 	int	position;
 	int	read_position;
 	char    ch;
 } lexer_t;
 
-lexer_t *new_lexer(char *input);
+lexer_t *new_lexer(const char *input);
+lexer_t *new_lexer_n(const char *input, int length);
+void free_lexer(lexer_t *lexer);
 void read_char(lexer_t *l);
 char peek_char(lexer_t *l);
 void skip_whitespace(lexer_t *l);
-token_t *lexer_next_token(lexer_t *l);
-char *read_identifier(lexer_t *l);
-char *read_number(lexer_t *l);
+token_t lexer_next_token(lexer_t *l);
+token_t read_identifier(lexer_t *l);
+token_t read_number(lexer_t *l);
 bool is_letter(unsigned char ch);
 bool is_digit(unsigned char ch);
-TokenType lookup_ident(char *literal);
-char *read_string(lexer_t *l);
+TokenType lookup_ident(const char *literal, int length);
+token_t read_string(lexer_t *l);
 
 #endif
@@ -1,7 +1,60 @@
 #include <stdio.h>
+#include <string.h>
 #include "repl.h"
+#include "script.h"
+#include "profiler.h"
+#include "stats.h"
 
-int main(){
-	printf("Hello! Welcome to C Monkeys!\n");
-	repl_start(stdin, stdout);
+static void usage(const char *program){
+	fprintf(stderr, "usage: %s [--engine=vm|eval] [--stats] [--profile=out.folded] [script.mk]\n", program);
+}
+
+int main(int argc, char *argv[]){
+	engine_t engine = ENGINE_VM;
+	const char *script = NULL;
+	const char *profile = NULL;
+	for (int i = 1; i < argc; i++){
+		if (strcmp(argv[i], "--engine=vm") == 0){
+			engine = ENGINE_VM;
+		} else if (strcmp(argv[i], "--engine=eval") == 0){
+			engine = ENGINE_EVAL;
+		} else if (strcmp(argv[i], "--stats") == 0){
+			stats_enable();
+		} else if (strncmp(argv[i], "--profile=", 10) == 0){
+			profile = argv[i] + 10;
+		} else if (argv[i][0] != '-' && script == NULL){
+			script = argv[i];
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (profile != NULL && !profiler_start()){
+		fprintf(stderr, "could not start the profiler\n");
+		return 1;
+	}
+
+	int status = 0;
+	if (script != NULL){
+		status = run_script(script, engine);
+	} else {
+		printf("Hello! Welcome to C Monkeys!\n");
+		repl_start(stdin, stdout, engine);
+	}
+	// On stderr, so it doesn't mix with what the program prints
+	if (stats.enabled){
+		stats_print(stderr);
+	}
+	if (profile != NULL){
+		profiler_stop();
+		FILE *out = fopen(profile, "w");
+		if (out == NULL){
+			fprintf(stderr, "could not write profile to %s\n", profile);
+			return 1;
+		}
+		profiler_write_folded(out);
+		fclose(out);
+	}
+	return status;
 }
@@ -5,323 +5,688 @@
 #include "stdarg.h"
 #include "custom_string.h"
 #include "evaluator.h"
+#include "gc.h"
+#include "intern.h"
+#include "stats.h"
 #include "vector.h"
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
-object_t *global_true;
-object_t *global_false;
-object_t *global_null;
-
-void init_globals(void) {
-    global_true = new_object(OBJECT_BOOLEAN);
-    global_true->boolean = true;
-
-    global_false = new_object(OBJECT_BOOLEAN);
-    global_false->boolean = false;
-
-    global_null = new_object(OBJECT_NULL);
+object_t *new_object(object_type_t obj_type){
+    object_t *obj = gc_alloc_object();
+    if (obj == NULL){
+        return NULL;
+    }
+    obj->type = obj_type;
+    stats.objects[obj_type]++;
+    return obj;
 }
 
-object_t *new_object(object_type_t obj_type){
+/*For singletons and compiled constants that live as long as the process*/
+object_t *new_immortal_object(object_type_t obj_type){
     object_t *obj = calloc(1, sizeof(object_t));
     if (obj == NULL){
         return NULL;
     }
     obj->type = obj_type;
+    obj->immortal = true;
+    stats.objects[obj_type]++;
     return obj;
 }
 
-void inspect_object(object_t object, char *buff_out){
-    switch(object.type){
-        case OBJECT_INTEGER:
-            snprintf(buff_out, BUFSIZ, "%d", object.integer);
+/*One immortal object per interned string, so evaluating a literal allocates nothing*/
+value_t interned_string_object(const char *interned){
+    static hash_map_t *objects;
+    if (objects == NULL){
+        objects = new_interned_hash_table(NULL);
+    }
+    object_t *string = interned_get(objects, interned);
+    if (string != NULL){
+        return value_from_object(string);
+    }
+
+    string = new_immortal_object(OBJECT_STRING);
+    if (string == NULL){
+        return new_error("cannot allocate for string");
+    }
+    // Borrows the pooled bytes, immortal objects are never freed
+    string->string_literal = malloc(sizeof(string_t));
+    string->string_literal->data = (char *)interned;
+    string->string_literal->len = interned_length(interned);
+    string->string_literal->cap = 0;
+    string->string_hash = interned_hash(interned) | 1;
+    interned_set(objects, interned, string);
+    return value_from_object(string);
+}
+
+value_t concat_string_objects(object_t *left, object_t *right){
+    size_t length = left->string_literal->len + right->string_literal->len;
+    object_t *string = new_object(OBJECT_STRING);
+    if (string == NULL){
+        return new_error("cannot allocate for string");
+    }
+    if (length < ROPE_MIN_LENGTH){
+        string->string_literal = string_concat(object_string(left), object_string(right));
+        return value_from_object(string);
+    }
+
+    string->string_literal = malloc(sizeof(string_t));
+    string->string_literal->data = NULL;
+    string->string_literal->len = length;
+    string->string_literal->cap = 0;
+    string->rope_left = left;
+    string->rope_right = right;
+    return value_from_object(string);
+}
+
+/*Contiguous contents of a string object, a concatenation is flattened on first use*/
+string_t *object_string(object_t *string){
+    if (string->rope_left == NULL){
+        return string->string_literal;
+    }
+
+    string_t *flat = string->string_literal;
+    flat->cap = flat->len + 1;
+    flat->data = malloc(flat->cap);
+    char *out = flat->data;
+
+    // Walk the leaves left to right with an explicit stack, ropes built in a loop are as deep as the loop is long
+    size_t capacity = 64, count = 0;
+    object_t **pending = malloc(sizeof(object_t *) * capacity);
+    pending[count++] = string;
+    while (count > 0){
+        object_t *node = pending[--count];
+        if (node->rope_left == NULL){
+            memcpy(out, node->string_literal->data, node->string_literal->len);
+            out += node->string_literal->len;
+            continue;
+        }
+        if (count + 2 > capacity){
+            capacity *= 2;
+            pending = realloc(pending, sizeof(object_t *) * capacity);
+        }
+        pending[count++] = node->rope_right;
+        pending[count++] = node->rope_left;
+    }
+    free(pending);
+    *out = '\0';
+
+    // The halves are no longer needed here, the collector can take them if nothing else holds them
+    string->rope_left = NULL;
+    string->rope_right = NULL;
+    return flat;
+}
+
+static array_buffer_t *new_array_buffer(size_t capacity){
+    array_buffer_t *buffer = malloc(sizeof(array_buffer_t));
+    if (buffer == NULL){
+        return NULL;
+    }
+    buffer->items = malloc(sizeof(value_t) * (capacity > 0 ? capacity : 1));
+    if (buffer->items == NULL){
+        free(buffer);
+        return NULL;
+    }
+    buffer->length = 0;
+    buffer->capacity = capacity;
+    buffer->refs = 0;
+    gc_track_resize(0, sizeof(value_t) * capacity);
+    return buffer;
+}
+
+static void release_array_buffer(array_buffer_t *buffer){
+    if (buffer == NULL || --buffer->refs > 0){
+        return;
+    }
+    gc_track_resize(sizeof(value_t) * buffer->capacity, 0);
+    free(buffer->items);
+    free(buffer);
+}
+
+static bool reserve_array_buffer(array_buffer_t *buffer, size_t capacity){
+    if (capacity <= buffer->capacity){
+        return true;
+    }
+    // Other arrays only hold the buffer, never items, so moving the items is safe
+    value_t *items = realloc(buffer->items, sizeof(value_t) * capacity);
+    if (items == NULL){
+        return false;
+    }
+    gc_track_resize(sizeof(value_t) * buffer->capacity, sizeof(value_t) * capacity);
+    buffer->items = items;
+    buffer->capacity = capacity;
+    return true;
+}
+
+static object_t *new_array_view(array_buffer_t *buffer, size_t offset, size_t count){
+    object_t *array = new_object(OBJECT_ARRAY);
+    if (array == NULL){
+        return NULL;
+    }
+    buffer->refs++;
+    array->array.buffer = buffer;
+    array->array.offset = offset;
+    array->array.count = count;
+    return array;
+}
+
+object_t *new_array_object(size_t capacity){
+    array_buffer_t *buffer = new_array_buffer(capacity);
+    if (buffer == NULL){
+        return NULL;
+    }
+    object_t *array = new_array_view(buffer, 0, 0);
+    if (array == NULL){
+        release_array_buffer(buffer);
+    }
+    return array;
+}
+
+/*Only for filling in an array that hasn't been handed out yet*/
+void array_append(object_t *array, value_t value){
+    array_object_t *view = &array->array;
+    array_buffer_t *buffer = view->buffer;
+    if (buffer->length == buffer->capacity && !reserve_array_buffer(buffer, buffer->capacity * 2 + 4)){
+        return;
+    }
+    buffer->items[buffer->length++] = value;
+    view->count++;
+}
+
+value_t array_rest(object_t *array){
+    array_object_t *view = &array->array;
+    if (view->count == 0){
+        return value_from_object(new_array_object(0));
+    }
+    return value_from_object(new_array_view(view->buffer, view->offset + 1, view->count - 1));
+}
+
+value_t array_push(object_t *array, value_t value){
+    array_object_t *view = &array->array;
+    array_buffer_t *buffer = view->buffer;
+    size_t end = view->offset + view->count;
+
+    // Nothing has been written past this array yet, so the next slot is free to claim
+    if (end == buffer->length){
+        if (buffer->length < buffer->capacity || reserve_array_buffer(buffer, buffer->capacity * 2 + 4)){
+            buffer->items[buffer->length++] = value;
+            return value_from_object(new_array_view(buffer, view->offset, view->count + 1));
+        }
+    }
+
+    object_t *copy = new_array_object(view->count * 2 + 4);
+    if (copy == NULL){
+        return new_error("cannot allocate for array");
+    }
+    memcpy(copy->array.buffer->items, buffer->items + view->offset, sizeof(value_t) * view->count);
+    copy->array.buffer->items[view->count] = value;
+    copy->array.buffer->length = view->count + 1;
+    copy->array.count = view->count + 1;
+    return value_from_object(copy);
+}
+
+void free_object(void *ptr){
+    object_t *object = ptr;
+    switch(object->type){
+        case OBJECT_STRING:
+            if (object->string_literal != NULL){
+                string_free(object->string_literal);
+            }
             break;
-        case OBJECT_BOOLEAN:
-            snprintf(buff_out, BUFSIZ, "%s", object.boolean ? "true" : "false");
+        case OBJECT_ERROR:
+            if (object->error_message != NULL){
+                string_free(object->error_message);
+            }
             break;
-        case OBJECT_NULL:
-            snprintf(buff_out, BUFSIZ, "NULL");
+        case OBJECT_ARRAY:
+            release_array_buffer(object->array.buffer);
             break;
+        case OBJECT_HASH:
+            hamt_release(&object->hash.pairs);
+            break;
+        case OBJECT_CLOSURE:
+            free(object->closure.free);
+            break;
+        default:
+            break;
+    }
+    free(object);
+}
+
+/*Inspect output goes either into a growable string or straight to a stream*/
+typedef struct ValueWriter {
+    string_t *string;
+    FILE *file;
+} value_writer_t;
+
+static void write_n(value_writer_t *writer, const char *data, size_t length){
+    if (writer->file != NULL){
+        fwrite(data, 1, length, writer->file);
+    } else {
+        string_append_n(writer->string, data, length);
+    }
+}
+
+static void write_str(value_writer_t *writer, const char *data){
+    write_n(writer, data, strlen(data));
+}
+
+static void write_format(value_writer_t *writer, const char *format, ...){
+    char small[64];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(small, sizeof(small), format, args);
+    va_end(args);
+    write_n(writer, small, length < sizeof(small) ? length : sizeof(small) - 1);
+}
+
+/*One pass, nested values only cost a few words of stack per level*/
+static void write_value(value_writer_t *writer, value_t value){
+    if (value_is_int(value)){
+        write_format(writer, "%d", value_as_int(value));
+        return;
+    }
+    if (value_is_bool(value)){
+        write_str(writer, value_as_bool(value) ? "true" : "false");
+        return;
+    }
+    if (value_is_null(value)){
+        write_str(writer, "NULL");
+        return;
+    }
+
+    object_t *object = value_as_object(value);
+    switch(object->type){
         case OBJECT_FUNCTION:{
-           string_t *params = string_new();
-           for (int i = 0; i < object.function.parameters->count; i++) {
-               identifier_t *param = object.function.parameters->data[i];
-               string_append(params, param->value);
-               if (i < object.function.parameters->count - 1) {
-                   string_append(params, ", ");
-               }
-           }
-
-           string_t *body_str = string_new();
-           format_block_statement(body_str, object.function.body);
-
-           snprintf(buff_out, BUFSIZ, "fn(%s) %s", params->data, body_str->data);
-
-           string_free(params);
-           string_free(body_str);
-           break;
+            write_str(writer, "fn(");
+            for (int i = 0; i < object->function.parameters->count; i++) {
+                identifier_t *param = object->function.parameters->data[i];
+                if (i > 0) {
+                    write_str(writer, ", ");
+                }
+                write_str(writer, param->value);
+            }
+            write_str(writer, ") ");
+
+            string_t *body_str = string_new();
+            format_block_statement(body_str, object->function.body);
+            write_n(writer, body_str->data, body_str->len);
+            string_free(body_str);
+            break;
         }
         case OBJECT_STRING:{
-            snprintf(buff_out, BUFSIZ, "%s", object.string_literal->data);
+            string_t *string = object_string(object);
+            write_n(writer, string->data, string->len);
             break;
         }
         case OBJECT_ERROR:{
-            snprintf(buff_out, BUFSIZ, "%s", object.error_message->data);
+            write_n(writer, object->error_message->data, object->error_message->len);
             break;
         }
         case OBJECT_ARRAY:{
-            string_t *temp = string_new();
-            string_append(temp, "[");
-            for (int i = 0; i < object.array.elements->count; i++){
-                object_t *element = object.array.elements->data[i];
-                char element_str[BUFSIZ];
-                inspect_object(*element, element_str);
-                string_append(temp, element_str);
-                if (i < object.array.elements->count - 1){
-                    string_append(temp, ", ");
+            write_str(writer, "[");
+            for (size_t i = 0; i < object->array.count; i++){
+                if (i > 0){
+                    write_str(writer, ", ");
                 }
+                write_value(writer, array_get(&object->array, i));
             }
-            string_append(temp, "]");
-            snprintf(buff_out, BUFSIZ, "%s", temp->data);
-            string_free(temp);
+            write_str(writer, "]");
             break;
         }
         case OBJECT_HASH: {
-            string_t *temp = string_new();
-            string_append(temp, "{");
+            write_str(writer, "{");
             bool first = true;
-
-            // Iterate through all buckets in the hash table
-            for (int i = 0; i < TABLE_SIZE; i++) {
-                hash_entry_t *entry = object.hash.pairs->table[i];
-                // Iterate through all entries in this bucket
-                while (entry != NULL) {
-                    if (!first) {
-                        string_append(temp, ", ");
-                    }
-                    first = false;
-
-                    // Add the key
-                    string_append(temp, strip_object_prefix(entry->key));
-                    string_append(temp, ": ");
-
-                    // Add the value
-                    char value_str[BUFSIZ];
-                    inspect_object(*(object_t*)entry->value, value_str);
-                    string_append(temp, value_str);
-
-                    entry = entry->next;
+            hamt_iter_t iter = hamt_iter(&object->hash.pairs);
+            while (hamt_next(&iter)) {
+                if (!first) {
+                    write_str(writer, ", ");
                 }
+                first = false;
+                write_value(writer, value_from_ptr(iter.key));
+                write_str(writer, ": ");
+                write_value(writer, value_from_ptr(iter.value));
             }
-            string_append(temp, "}");
-            snprintf(buff_out, BUFSIZ, "%s", temp->data);
-            string_free(temp);
+            write_str(writer, "}");
             break;
         }
-        case OBJECT_BUILTIN: {
-            snprintf(buff_out, BUFSIZ, "builtin function");
+        case OBJECT_BUILTIN:
+            write_str(writer, "builtin function");
+            break;
+        case OBJECT_COMPILED_FUNCTION:
+            write_format(writer, "CompiledFunction[%p]", (void *)object->compiled_function.instructions);
+            break;
+        case OBJECT_CLOSURE:
+            write_format(writer, "Closure[%p]", (void *)object->closure.fn);
+            break;
+        default:
+            write_str(writer, "Unknown object type");
             break;
-        }
-       break;
-            default:
-                snprintf(buff_out, BUFSIZ, "Unknown object type");
-                break;
-        }
-}
-
-object_t *object_heap_copy(const object_t *source) {
-    object_t *new_obj = malloc(sizeof(object_t));
-    if (!new_obj) return NULL;
-
-    memcpy(new_obj, source, sizeof(object_t));
-
-    if (source->type == OBJECT_ERROR && source->error_message) {
-        new_obj->error_message = string_clone(source->error_message);
-        if (!new_obj->error_message) {
-            free(new_obj);
-            return NULL;
-        }
     }
+}
 
-    return new_obj;
+void inspect_value(value_t value, string_t *out){
+    value_writer_t writer = { .string = out };
+    stats_enter(PHASE_INSPECT);
+    write_value(&writer, value);
+    stats_leave();
 }
 
-object_t *get_builtin_function(builtin_function_t builtin_function){
-    object_t *builtin = new_object(OBJECT_BUILTIN);
-    builtin->builtin = builtin_function;
-    return builtin;
+void print_value(value_t value, FILE *out){
+    value_writer_t writer = { .file = out };
+    stats_enter(PHASE_INSPECT);
+    write_value(&writer, value);
+    stats_leave();
 }
 
-object_t *len_builtin(vector_t *args){
+value_t len_builtin(vector_t *args){
     if (args->count != 1){
         return new_error("wrong number of arguments");
     }
-    object_t *arg = args->data[0];
-    switch(arg->type){
-        case OBJECT_STRING:{
-            object_t *obj = new_object(OBJECT_INTEGER);
-            obj->integer = arg->string_literal->len;
-            return obj;
-        }
-        case OBJECT_ARRAY:{
-            object_t *obj = new_object(OBJECT_INTEGER);
-            obj->integer = arg->array.elements->count;
-            return obj;
-        }
+    value_t arg = value_from_ptr(args->data[0]);
+    switch(value_type(arg)){
+        case OBJECT_STRING:
+            return value_from_int(value_as_object(arg)->string_literal->len);
+        case OBJECT_ARRAY:
+            return value_from_int(value_as_object(arg)->array.count);
         default:{
             char error_msg[BUFSIZ];
-            snprintf(error_msg, BUFSIZ, "argument to `len` not supported, got %s", object_type_to_string(arg->type));
+            snprintf(error_msg, BUFSIZ, "argument to `len` not supported, got %s", object_type_to_string(value_type(arg)));
             return new_error(error_msg);
         }
     }
 }
 
 
-object_t *first_builtin(vector_t *args){
+value_t first_builtin(vector_t *args){
     if (args->count != 1){
         return new_error("wrong number of arguments");
     }
-    object_t *arg = args->data[0];
-    if (arg->type != OBJECT_ARRAY){
+    value_t arg = value_from_ptr(args->data[0]);
+    if (!value_is(arg, OBJECT_ARRAY)){
         char error_msg[BUFSIZ];
-        snprintf(error_msg, BUFSIZ, "argument to `first` must be an array, got %s", object_type_to_string(arg->type));
+        snprintf(error_msg, BUFSIZ, "argument to `first` must be an array, got %s", object_type_to_string(value_type(arg)));
         return new_error(error_msg);
     }
 
-    if (arg->array.elements->count > 0){
-        return arg->array.elements->data[0];
+    array_object_t *array = &value_as_object(arg)->array;
+    if (array->count > 0){
+        return array_get(array, 0);
     }
 
-    return global_null;
+    return VALUE_NULL;
 }
 
-object_t *last_builtin(vector_t *args){
+value_t last_builtin(vector_t *args){
     if (args->count != 1){
         return new_error("wrong number of arguments");
     }
-    object_t *arg = args->data[0];
-    if (arg->type != OBJECT_ARRAY){
+    value_t arg = value_from_ptr(args->data[0]);
+    if (!value_is(arg, OBJECT_ARRAY)){
         char error_msg[BUFSIZ];
-        snprintf(error_msg, BUFSIZ, "argument to `last` must be an array, got %s", object_type_to_string(arg->type));
+        snprintf(error_msg, BUFSIZ, "argument to `last` must be an array, got %s", object_type_to_string(value_type(arg)));
         return new_error(error_msg);
     }
 
-    int count = arg->array.elements->count;
-    if (count > 0){
-        return arg->array.elements->data[count - 1];
+    array_object_t *array = &value_as_object(arg)->array;
+    if (array->count > 0){
+        return array_get(array, array->count - 1);
     }
 
-    return global_null;
+    return VALUE_NULL;
 }
 
-object_t *rest_builtin(vector_t *args){
+value_t rest_builtin(vector_t *args){
     if (args->count != 1){
         return new_error("wrong number of arguments");
     }
-    object_t *arg = args->data[0];
-    if (arg->type != OBJECT_ARRAY){
+    value_t arg = value_from_ptr(args->data[0]);
+    if (!value_is(arg, OBJECT_ARRAY)){
         char error_msg[BUFSIZ];
-        snprintf(error_msg, BUFSIZ, "argument to `rest` must be an array, got %s", object_type_to_string(arg->type));
+        snprintf(error_msg, BUFSIZ, "argument to `rest` must be an array, got %s", object_type_to_string(value_type(arg)));
         return new_error(error_msg);
     }
 
-    object_t *new_array = object_heap_copy(arg);
-    new_array->array.elements = create_vector();
-    for(int i = 1; i < arg->array.elements->count; i++){
-        append_vector(new_array->array.elements, object_heap_copy(arg->array.elements->data[i]));
-    }
-
-    return new_array;
+    return array_rest(value_as_object(arg));
 }
 
 
-object_t *push_builtin(vector_t *args){
+value_t push_builtin(vector_t *args){
     if (args->count != 2){
         return new_error("wrong number of arguments");
     }
-    object_t *arg = args->data[0];
-    if (arg->type != OBJECT_ARRAY){
+    value_t arg = value_from_ptr(args->data[0]);
+    if (!value_is(arg, OBJECT_ARRAY)){
         char error_msg[BUFSIZ];
-        snprintf(error_msg, BUFSIZ, "argument to `rest` must be an array, got %s", object_type_to_string(arg->type));
+        snprintf(error_msg, BUFSIZ, "argument to `rest` must be an array, got %s", object_type_to_string(value_type(arg)));
         return new_error(error_msg);
     }
 
-    object_t *new_array = object_heap_copy(arg);
-    new_array->array.elements = create_vector();
-    for(int i = 0; i < arg->array.elements->count; i++){
-        append_vector(new_array->array.elements, object_heap_copy(arg->array.elements->data[i]));
+    return array_push(value_as_object(arg), value_from_ptr(args->data[1]));
+}
+
+/*Checks the hash and key arguments shared by set and delete*/
+static value_t hash_update_arguments(vector_t *args, const char *name, hash_key_t *key){
+    value_t hash = value_from_ptr(args->data[0]);
+    value_t key_value = value_from_ptr(args->data[1]);
+    char error_msg[BUFSIZ];
+    if (!value_is(hash, OBJECT_HASH)){
+        snprintf(error_msg, BUFSIZ, "argument to `%s` must be a hash, got %s", name, object_type_to_string(value_type(hash)));
+        return new_error(error_msg);
+    }
+    if (!value_to_hash_key(key_value, key)){
+        snprintf(error_msg, BUFSIZ, "unuseable as hash key: %s", object_type_to_string(value_type(key_value)));
+        return new_error(error_msg);
     }
+    return hash;
+}
 
-    append_vector(new_array->array.elements, object_heap_copy(args->data[1]));
+/*set(hash, key, value) is a new hash, hash itself is left as it was*/
+value_t set_builtin(vector_t *args){
+    if (args->count != 3){
+        return new_error("wrong number of arguments");
+    }
+    hash_key_t key;
+    value_t hash = hash_update_arguments(args, "set", &key);
+    if (value_is(hash, OBJECT_ERROR)){
+        return hash;
+    }
+    return hash_object_with(&value_as_object(hash)->hash, key, value_from_ptr(args->data[2]));
+}
 
-    return new_array;
+value_t delete_builtin(vector_t *args){
+    if (args->count != 2){
+        return new_error("wrong number of arguments");
+    }
+    hash_key_t key;
+    value_t hash = hash_update_arguments(args, "delete", &key);
+    if (value_is(hash, OBJECT_ERROR)){
+        return hash;
+    }
+    return hash_object_without(&value_as_object(hash)->hash, key);
 }
 
-object_t *puts_builtin(vector_t *args){
-    char buf[BUFSIZ];
+value_t puts_builtin(vector_t *args){
     for (int i = 0; i < args->count; i++){
-        inspect_object(*(object_t *)args->data[i], buf);
-    }
-    printf("%s\n", buf);
-    return global_null;
-}
-
-
-object_t *get_builtin_by_name(const char *name) {
-    if (strcmp(name, "len") == 0) {
-        object_t *built_in_obj = new_object(OBJECT_BUILTIN);
-        built_in_obj->builtin = len_builtin;
-        return built_in_obj;
-    } else if (strcmp(name, "first") == 0) {
-        object_t *built_in_obj = new_object(OBJECT_BUILTIN);
-        built_in_obj->builtin = first_builtin;
-        return built_in_obj;
-    } else if(strcmp(name, "last") == 0){
-        object_t *built_in_obj = new_object(OBJECT_BUILTIN);
-        built_in_obj->builtin = last_builtin;
-        return built_in_obj;
-    } else if(strcmp(name, "rest") == 0){
-        object_t *built_in_obj = new_object(OBJECT_BUILTIN);
-        built_in_obj->builtin = rest_builtin;
-        return built_in_obj;
-    } else if(strcmp(name, "push") == 0){
-        object_t *built_in_obj = new_object(OBJECT_BUILTIN);
-        built_in_obj->builtin = push_builtin;
-        return built_in_obj;
-    } else if(strcmp(name, "puts") == 0){
-        object_t *built_in_obj = new_object(OBJECT_BUILTIN);
-        built_in_obj->builtin = puts_builtin;
-        return built_in_obj;
-    }
-
-    return NULL;
-}
-
-char *object_to_key(object_t *object){
-    char buf[128];
-    char *object_type = object_type_to_string(object->type);
-    switch(object->type){
-        case OBJECT_STRING:
-            snprintf(buf, sizeof(buf), "%s-%s", object_type, object->string_literal->data);
-            break;
+        print_value(value_from_ptr(args->data[i]), stdout);
+        putchar('\n');
+    }
+    return VALUE_NULL;
+}
+
+
+/*Compiled programs refer to these by index, so only ever append to this*/
+static const builtin_definition_t CORE_BUILTINS[] = {
+    {"len", len_builtin},
+    {"first", first_builtin},
+    {"last", last_builtin},
+    {"rest", rest_builtin},
+    {"push", push_builtin},
+    {"puts", puts_builtin},
+    {"set", set_builtin},
+    {"delete", delete_builtin},
+};
+
+typedef struct BuiltinRegistry {
+    object_t **objects;
+    const char **names;
+    int count;
+    int capacity;
+    /*Interned name to index + 1*/
+    hash_map_t *indexes;
+} builtin_registry_t;
+
+static builtin_registry_t registry;
+
+static int add_builtin(const char *name, builtin_function_t fn){
+    name = intern_string(name);
+    intptr_t existing = (intptr_t)interned_get(registry.indexes, name);
+    if (existing != 0){
+        registry.objects[existing - 1]->builtin = fn;
+        return existing - 1;
+    }
+
+    if (registry.count == registry.capacity){
+        registry.capacity *= 2;
+        registry.objects = realloc(registry.objects, sizeof(object_t *) * registry.capacity);
+        registry.names = realloc(registry.names, sizeof(char *) * registry.capacity);
+    }
+    object_t *builtin = new_immortal_object(OBJECT_BUILTIN);
+    builtin->builtin = fn;
+    registry.objects[registry.count] = builtin;
+    registry.names[registry.count] = name;
+    interned_set(registry.indexes, name, (void *)(intptr_t)(registry.count + 1));
+    return registry.count++;
+}
+
+static void ensure_registry(void){
+    if (registry.indexes != NULL){
+        return;
+    }
+    int core = sizeof(CORE_BUILTINS) / sizeof(CORE_BUILTINS[0]);
+    registry.capacity = core * 2;
+    registry.objects = malloc(sizeof(object_t *) * registry.capacity);
+    registry.names = malloc(sizeof(char *) * registry.capacity);
+    registry.indexes = new_interned_hash_table(NULL);
+    for (int i = 0; i < core; i++){
+        add_builtin(CORE_BUILTINS[i].name, CORE_BUILTINS[i].fn);
+    }
+}
+
+int register_builtin(const char *name, builtin_function_t fn){
+    ensure_registry();
+    return add_builtin(name, fn);
+}
+
+int builtin_count(void){
+    ensure_registry();
+    return registry.count;
+}
+
+const char *builtin_name(int index){
+    ensure_registry();
+    return index < 0 || index >= registry.count ? NULL : registry.names[index];
+}
+
+int builtin_index(const char *interned_name){
+    ensure_registry();
+    return (intptr_t)interned_get(registry.indexes, interned_name) - 1;
+}
+
+value_t get_builtin_by_index(int index){
+    ensure_registry();
+    if (index < 0 || index >= registry.count){
+        return VALUE_EMPTY;
+    }
+    return value_from_object(registry.objects[index]);
+}
+
+value_t get_builtin_by_name(const char *interned_name){
+    return get_builtin_by_index(builtin_index(interned_name));
+}
+
+static bool hash_keys_equal(void *a, void *b){
+    value_t left = value_from_ptr(a);
+    value_t right = value_from_ptr(b);
+    if (value_same(left, right)){
+        return true;
+    }
+    return value_is(left, OBJECT_STRING) && value_is(right, OBJECT_STRING)
+        && string_equals(object_string(value_as_object(left)), object_string(value_as_object(right)));
+}
+
+object_t *new_hash_object(void){
+    object_t *hash = new_object(OBJECT_HASH);
+    if (hash == NULL){
+        return NULL;
+    }
+    hash->hash.pairs = new_hamt(hash_keys_equal);
+    return hash;
+}
+
+/*Finalizer from splitmix64, spreads small integers across the whole table*/
+static uint64_t mix_hash(uint64_t x){
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+bool value_to_hash_key(value_t value, hash_key_t *key){
+    key->value = value;
+    key->type = value_type(value);
+    switch (key->type){
+        case OBJECT_STRING: {
+            object_t *string = value_as_object(value);
+            if (string->string_hash == 0){
+                // Strings are immutable, so the hash is only ever computed once
+                string->string_hash = fnv1a_hash(object_string(string)->data) | 1;
+            }
+            key->hash = string->string_hash;
+            return true;
+        }
         case OBJECT_INTEGER:
-            snprintf(buf, sizeof(buf), "%s-%d", object_type, object->integer);
-            break;
         case OBJECT_BOOLEAN:
-            snprintf(buf, sizeof(buf), "%s-%s", object_type, object->boolean ? "true" : "false");
-            break;
+            key->hash = mix_hash(value.bits);
+            return true;
         default:
-            printf("WARNING: INVALID OBJECT PASSED AS KEY\n");
+            return false;
     }
-    return strdup(buf);
 }
 
-const char *strip_object_prefix(const char *key) {
-    const char *sep = strchr(key, '-');
-    if (sep != NULL && sep[1] != '\0')
-        return sep + 1;  // Skip the ':' delimiter.
-    return key;
+bool hash_object_set(hash_object_t *hash, hash_key_t key, value_t value){
+    return hamt_insert(&hash->pairs, value_to_ptr(key.value), key.hash, value_to_ptr(value));
+}
+
+value_t hash_object_get(hash_object_t *hash, hash_key_t key){
+    return value_from_ptr(hamt_get(&hash->pairs, value_to_ptr(key.value), key.hash));
 }
 
+/*Wraps a version made by hamt_set or hamt_delete, releasing it if there's no object for it*/
+static value_t new_hash_version(hamt_t *pairs){
+    object_t *updated = new_object(OBJECT_HASH);
+    if (updated == NULL){
+        hamt_release(pairs);
+        return new_error("cannot allocate for hash");
+    }
+    updated->hash.pairs = *pairs;
+    return value_from_object(updated);
+}
+
+value_t hash_object_with(hash_object_t *hash, hash_key_t key, value_t value){
+    hamt_t pairs;
+    if (!hamt_set(&hash->pairs, value_to_ptr(key.value), key.hash, value_to_ptr(value), &pairs)){
+        return new_error("cannot allocate for hash");
+    }
+    return new_hash_version(&pairs);
+}
+
+value_t hash_object_without(hash_object_t *hash, hash_key_t key){
+    hamt_t pairs;
+    // A missing key still gives a version, sharing the whole trie
+    hamt_delete(&hash->pairs, value_to_ptr(key.value), key.hash, &pairs);
+    return new_hash_version(&pairs);
+}
@@ -3,10 +3,13 @@
 
 #include <stdbool.h>
 #include "ast.h"
+#include "code.h"
 #include "custom_string.h"
 #include "hashmap.h"
+#include "hamt.h"
 #include "vector.h"
 #include "environment.h"
+#include "value.h"
 
 typedef enum ObjectType {
 	OBJECT_INTEGER,
@@ -19,52 +22,161 @@ typedef enum ObjectType {
 	OBJECT_BUILTIN,
 	OBJECT_ARRAY,
 	OBJECT_HASH,
+	OBJECT_COMPILED_FUNCTION,
+	OBJECT_CLOSURE,
+
+	OBJECT_TYPE_COUNT,
 } object_type_t;
 
+/*
+ * Arrays are views onto a shared, append only buffer. rest() is a view that starts one
+ * element later, and push() writes in place when the array ends where the buffer's
+ * written slots do. Slots visible to some array are never rewritten, so arrays keep
+ * value semantics while rest is O(1) and push amortised O(1).
+ */
+typedef struct ArrayBuffer{
+	value_t *items;
+	size_t length; // slots written so far, push only appends past this
+	size_t capacity;
+	int refs; // arrays viewing the buffer, the last one to be freed frees it
+} array_buffer_t;
+
 typedef struct Array{
-	vector_t *elements;
+	array_buffer_t *buffer;
+	size_t offset;
+	size_t count;
 } array_object_t;
 
 typedef struct Function{
 	environment_t *env;
 	vector_t *parameters;
 	block_statement_t *body;
+	int num_locals;
+	bool frame_escapes;
+	const char *name; // interned, for the profiler
+	program_t *program; // whose source the body's tokens are offsets into
 } function_object_t;
 
+/*Persistent, so updated copies of a hash share everything but the changed path*/
 typedef struct Hash{
-	hash_map_t *pairs;
+	hamt_t pairs;
 } hash_object_t;
 
-typedef object_t *(*builtin_function_t)(vector_t *args);
-typedef struct Object object_t;
+/*Strings compare by contents, integers and booleans by value*/
+typedef struct HashKey{
+	value_t value;
+	object_type_t type;
+	uint64_t hash;
+} hash_key_t;
+
+/*Function body lowered to bytecode by the compiler, see compiler.h*/
+typedef struct CompiledFunction{
+	instructions_t *instructions;
+	int num_locals;
+	int num_parameters;
+	const char *name; // interned, for the profiler
+} compiled_function_object_t;
+
+typedef struct Closure{
+	object_t *fn;
+	value_t *free;
+	int num_free;
+} closure_object_t;
+
+typedef value_t (*builtin_function_t)(vector_t *args);
+/*Heap allocated values, integers, booleans and null are encoded inline, see value.h*/
 typedef struct Object {
 	object_type_t type;
+	/*Collector bookkeeping, see gc.h. Immortal objects are never traced or swept*/
+	bool marked;
+	bool immortal;
+	object_t *gc_next;
 	union {
-		int integer;
-		bool boolean;
-		void *null;
 		string_t *error_message;
 		function_object_t function;	
-		object_t *return_obj;
-		string_t *string_literal;
+		value_t return_obj;
+		/*
+		 * A long concatenation is kept as its two halves and only copied into one
+		 * buffer when something needs the bytes, see object_string. Until then
+		 * string_literal has the length but no data.
+		 */
+		struct {
+			string_t *string_literal;
+			uint64_t string_hash; // 0 until the string is first used as a hash key
+			object_t *rope_left; // NULL once the string is flat
+			object_t *rope_right;
+		};
 		builtin_function_t builtin;
 		array_object_t array;
 		hash_object_t hash;
+		compiled_function_object_t compiled_function;
+		closure_object_t closure;
 	};
 } object_t;
 
-extern object_t *global_true;
-extern object_t *global_false;
-extern object_t *global_null;
+static inline object_type_t value_type(value_t value){
+	if (value_is_int(value)){
+		return OBJECT_INTEGER;
+	}
+	if (value_is_object(value)){
+		return value_as_object(value)->type;
+	}
+	return value_is_null(value) ? OBJECT_NULL : OBJECT_BOOLEAN;
+}
+
+static inline bool value_is(value_t value, object_type_t type){
+	return value_type(value) == type;
+}
+
+typedef struct BuiltinDefinition {
+	const char *name;
+	builtin_function_t fn;
+} builtin_definition_t;
 
-void init_globals();
 object_t *new_object(object_type_t obj_type);
-void inspect_object(object_t object, char *buff_out);
-object_t *object_heap_copy(const object_t *source);
-object_t *get_builtin_by_name(const char *name);
+object_t *new_immortal_object(object_type_t obj_type);
+void free_object(void *object);
+/*Appends the printed form to out, or streams it, with no length limit*/
+void inspect_value(value_t value, string_t *out);
+void print_value(value_t value, FILE *out);
+
+/*
+ * Builtins registry. Each builtin is one immortal object, so referencing one never
+ * allocates. Indexes are the VM's OP_GET_BUILTIN operand and never change, the core
+ * builtins come first. A host can add native functions with register_builtin, which
+ * returns the index. Registering an existing name swaps the function in place.
+ * Register before creating compilers, their symbol tables copy the registry.
+ */
+int register_builtin(const char *name, builtin_function_t fn);
+int builtin_count(void);
+const char *builtin_name(int index); // interned
+int builtin_index(const char *interned_name); // -1 when there is no such builtin
+value_t get_builtin_by_name(const char *interned_name);
+value_t get_builtin_by_index(int index);
+
+/*Shorter results are copied straight away, building a rope wouldn't pay for itself*/
+#define ROPE_MIN_LENGTH 256
+
+value_t interned_string_object(const char *interned);
+value_t concat_string_objects(object_t *left, object_t *right);
+string_t *object_string(object_t *string);
+
+object_t *new_array_object(size_t capacity);
+void array_append(object_t *array, value_t value);
+value_t array_rest(object_t *array);
+value_t array_push(object_t *array, value_t value);
+
+static inline value_t array_get(const array_object_t *array, size_t index){
+	return array->buffer->items[array->offset + index];
+}
 
-char *object_to_key(object_t *object);
-char *object_to_formattable_key(object_t *object);
-const char *strip_object_prefix(const char *key);
+object_t *new_hash_object(void);
+bool value_to_hash_key(value_t value, hash_key_t *key);
+/*Only for filling in a hash that hasn't been handed out yet*/
+bool hash_object_set(hash_object_t *hash, hash_key_t key, value_t value);
+value_t hash_object_get(hash_object_t *hash, hash_key_t key);
+/*New hashes that differ from hash by one key, hash itself is unchanged*/
+value_t hash_object_with(hash_object_t *hash, hash_key_t key, value_t value);
+value_t hash_object_without(hash_object_t *hash, hash_key_t key);
 
 #endif
@@ -8,6 +8,8 @@
 #include "token.h"
 #include "vector.h"
 #include "object.h"
+#include "intern.h"
+#include "stats.h"
 
 parser_t *new_parser(lexer_t *lexer){
 	parser_t *parser = malloc(sizeof(parser_t));
@@ -16,14 +18,26 @@ parser_t *new_parser(lexer_t *lexer){
 	}
 	parser->lexer = lexer;
 	parser->errors = create_vector();
-	parser->curr_token = *lexer_next_token(parser->lexer);
-	parser->peek_token = *lexer_next_token(parser->lexer);
+	parser->arena = new_arena();
+	parser->has_function_literals = false;
+	parser->lines = new_line_table(lexer->input, lexer->length);
+	parser->curr_token = lexer_next_token(parser->lexer);
+	parser->peek_token = lexer_next_token(parser->lexer);
 	return parser;
 }
 
+source_position_t parser_position(parser_t *parser, token_t token){
+	return line_table_position(&parser->lines, parser->arena, token);
+}
+
+/*Tokens only hold offsets, the text is in the lexer's input*/
+static const char *intern_token(parser_t *parser, token_t token){
+	return intern(token_start(parser->lexer->input, token), token.length);
+}
+
 void parser_next_token(parser_t *parser){
-	copy_token(&parser->curr_token, &parser->peek_token);
-	parser->peek_token = *lexer_next_token(parser->lexer);
+	parser->curr_token = parser->peek_token;
+	parser->peek_token = lexer_next_token(parser->lexer);
 }
 
 statement_t *parse_statement(parser_t *parser){
@@ -42,15 +56,12 @@ statement_t *parse_statement(parser_t *parser){
 }
 
 statement_t *parse_return_statement(parser_t *parser){
-	statement_t * statement = new_statement(RETURN_STATEMENT);
+	statement_t * statement = new_statement(parser->arena, RETURN_STATEMENT);
 	if (statement == NULL){
 		return NULL;
 	}
 
-	token_t token = {
-			.type = parser->curr_token.type,
-			.literal = strdup(parser->curr_token.literal)
-		};
+	token_t token = parser->curr_token;
 	statement->token = token;
 
 	parser_next_token(parser);
@@ -67,7 +78,7 @@ statement_t *parse_return_statement(parser_t *parser){
 }
 
 statement_t *parse_let_statement(parser_t *parser){
-	statement_t *statement = new_statement(LET_STATEMENT);
+	statement_t *statement = new_statement(parser->arena, LET_STATEMENT);
 	if (statement == NULL){
 		return NULL;
 	}
@@ -79,7 +90,8 @@ statement_t *parse_let_statement(parser_t *parser){
 	}
 
 	statement->name.token = parser->curr_token;
-	statement->name.value = parser->curr_token.literal;
+	statement->name.value = intern_token(parser, parser->curr_token);
+	statement->name.slot = UNRESOLVED_SLOT;
 
 	if (!(expect_peek(parser, ASSIGN))){
 		return NULL;
@@ -87,6 +99,9 @@ statement_t *parse_let_statement(parser_t *parser){
 
 	parser_next_token(parser);
 	statement->value = parse_expression(parser, PRECEDENCE_LOWEST);
+	if (statement->value != NULL && statement->value->type == FUNCTION_LITERAL){
+		statement->value->function_literal.name = statement->name.value;
+	}
 
 	if (!(curr_token_is(parser, SEMICOLON))){
 		parser_next_token(parser);
@@ -96,7 +111,7 @@ statement_t *parse_let_statement(parser_t *parser){
 }
 
 statement_t *parse_expression_statement(parser_t *parser){
-	statement_t *statement = new_statement(EXPRESSION_STATEMENT);
+	statement_t *statement = new_statement(parser->arena, EXPRESSION_STATEMENT);
 	if (statement == NULL){
 		return NULL;
 	}
@@ -116,7 +131,7 @@ expression_t *parse_expression(parser_t *parser, precedence_t precedence){
 		char error[100];
 		snprintf(error, sizeof(error), "no prefix parse function for %s found",
 			token_type_to_string(parser->curr_token.type));
-		append_error(parser, error);
+		append_error_at(parser, parser->curr_token, error);
 		return NULL;
 	}
 
@@ -161,13 +176,37 @@ void peek_error(parser_t *parser, TokenType token_type){
 	const char *expected = token_type_to_string(token_type);
 	char buffer[128];
 	snprintf(buffer, sizeof(buffer), "expected next token to be %s, got %s instead", expected, received);
-	append_error(parser, buffer);
+	append_error_at(parser, parser->peek_token, buffer);
 }
 
 void append_error(parser_t *parser, const char *error){
 	append_vector(parser->errors, strdup(error));
 }
 
+/*Prefixes the error with the token's line:column, like a compiler would*/
+void append_error_at(parser_t *parser, token_t token, const char *error){
+	source_position_t position = parser_position(parser, token);
+	if (position.line == 0){
+		append_error(parser, error);
+		return;
+	}
+	char buffer[256];
+	snprintf(buffer, sizeof(buffer), "%u:%u: %s", position.line, position.column, error);
+	append_error(parser, buffer);
+}
+
+void free_parser(parser_t *parser){
+	if (parser == NULL){
+		return;
+	}
+	for (int i = 0; i < parser->errors->count; i++){
+		free(parser->errors->data[i]);
+	}
+	free_vector(parser->errors);
+	free_arena(parser->arena);
+	free(parser);
+}
+
 void print_errors(parser_t *parser){
 	vector_t *errors = parser->errors;
 	printf("Whoops, we ran into some monkey business here!\n");
@@ -177,21 +216,28 @@ void print_errors(parser_t *parser){
 	}
 }
 
-program_t *new_program(){
-	program_t *program = malloc(sizeof(program_t));
-	program->statements = create_vector();
+program_t *new_program(arena_t *arena){
+	program_t *program = arena_alloc(arena, sizeof(program_t));
+	program->statements = create_arena_vector(arena);
 	program->node_type = NODE_PROGRAM;
+	program->arena = arena;
+	program->has_function_literals = false;
+	program->lines = (line_table_t){0};
 	return program;
 }
 
-program_t *parse_program(parser_t *parser){
-	static bool globals_initialized = false;
-	if (!globals_initialized) {
-		init_globals();
-		globals_initialized = true;
+void free_program(program_t *program){
+	if (program == NULL){
+		return;
 	}
-	program_t *program = new_program();
+	// The program struct lives in its own arena
+	free_arena(program->arena);
+}
+
+program_t *parse_program(parser_t *parser){
+	program_t *program = new_program(parser->arena);
 
+	stats_enter(PHASE_PARSE);
 	while (parser->curr_token.type != EOF_TOKEN){
 		statement_t *statement = parse_statement(parser);
 		if (statement != NULL){
@@ -199,6 +245,11 @@ program_t *parse_program(parser_t *parser){
 		}
 		parser_next_token(parser);
 	}
+	stats_leave();
+	program->has_function_literals = parser->has_function_literals;
+	program->lines = parser->lines;
+	// The program owns the arena from here on
+	parser->arena = NULL;
 	return program;
 }
 
@@ -250,13 +301,10 @@ infix_parser parser_infix_fns(TokenType token_type){
 }
 
 expression_t *parse_index_expression(parser_t *parser, expression_t *left){
-	token_t token = {
-			.type = parser->curr_token.type,
-			.literal = strdup(parser->curr_token.literal)
-		};
+	token_t token = parser->curr_token;
 
 	parser_next_token(parser);
-	expression_t *expression = new_expression(INDEX_EXPR, token);
+	expression_t *expression = new_expression(parser->arena, INDEX_EXPR, token);
 	expression->index_expression.left = left;
 	expression->index_expression.index = parse_expression(parser, PRECEDENCE_LOWEST);
 
@@ -267,15 +315,12 @@ expression_t *parse_index_expression(parser_t *parser, expression_t *left){
 }
 
 expression_t *parse_array_literal(parser_t *parser){
-	token_t token = {
-		.type = LBRACKET,
-		.literal = strdup("[")
-	};
+	token_t token = parser->curr_token;
 
-	expression_t *array = new_expression(ARRAY_LITERAL, token);
+	expression_t *array = new_expression(parser->arena, ARRAY_LITERAL, token);
 	if (peek_token_is(parser, RBRACKET)) {
 		parser_next_token(parser);
-		array->array_literal.elements = create_vector();
+		array->array_literal.elements = create_arena_vector(parser->arena);
 		return array;
 	}
 	vector_t *list = parse_expression_list(parser, RBRACKET);
@@ -285,11 +330,8 @@ expression_t *parse_array_literal(parser_t *parser){
 }
 
 expression_t *parse_hash_literal(parser_t *parser) {
-	token_t token = {
-		.type = LBRACE,
-		.literal = strdup("{")
-	};
-	expression_t *hash = new_expression(HASH_LITERAL, token);
+	token_t token = parser->curr_token;
+	expression_t *hash = new_expression(parser->arena, HASH_LITERAL, token);
 	hash->hash_literal.pairs = NULL;
 	hash->hash_literal.pairs_len = 0;
 	hash->hash_literal.pairs_capacity = 0;
@@ -315,12 +357,16 @@ expression_t *parse_hash_literal(parser_t *parser) {
 			if (hash->hash_literal.pairs_len >= hash->hash_literal.pairs_capacity) {
 				size_t new_capacity = (hash->hash_literal.pairs_capacity == 0) ? 
 				    8 : hash->hash_literal.pairs_capacity * 2;
-				hash->hash_literal.pairs = realloc(hash->hash_literal.pairs, 
+				parser_hash_pair_t **pairs = arena_alloc(parser->arena,
 				    new_capacity * sizeof(parser_hash_pair_t*));
+				if (hash->hash_literal.pairs_len > 0) {
+					memcpy(pairs, hash->hash_literal.pairs, hash->hash_literal.pairs_len * sizeof(parser_hash_pair_t*));
+				}
+				hash->hash_literal.pairs = pairs;
 				hash->hash_literal.pairs_capacity = new_capacity;
 			}
 
-			parser_hash_pair_t *pair = malloc(sizeof(parser_hash_pair_t));
+			parser_hash_pair_t *pair = arena_alloc(parser->arena, sizeof(parser_hash_pair_t));
 			pair->key = key;
 			pair->value = value;
 			hash->hash_literal.pairs[hash->hash_literal.pairs_len++] = pair;
@@ -345,33 +391,31 @@ expression_t *parse_hash_literal(parser_t *parser) {
 }
 
 expression_t *parse_identifier(parser_t *parser){
-	token_t token = {
-			.type = IDENT,
-			.literal = parser->curr_token.literal
-		};
-	expression_t *expression = new_expression(IDENT_EXPR, token);
+	token_t token = parser->curr_token;
+	expression_t *expression = new_expression(parser->arena, IDENT_EXPR, token);
 	expression->ident.token = token;
-	expression->ident.value = token.literal;
+	expression->ident.value = intern_token(parser, token);
+	expression->ident.slot = UNRESOLVED_SLOT;
 	return expression;
 };
 
 expression_t *parse_integer_literal(parser_t *parser){
-	token_t token = {
-			.type = INT,
-			.literal = parser->curr_token.literal
-		};
-	expression_t *expression = new_expression(INTEGER_LITERAL, token);
-	expression->integer = atoi(token.literal);
+	token_t token = parser->curr_token;
+	expression_t *expression = new_expression(parser->arena, INTEGER_LITERAL, token);
+	// The lexer only puts digits in INT tokens
+	const char *digits = token_start(parser->lexer->input, token);
+	int value = 0;
+	for (int i = 0; i < token.length; i++){
+		value = value * 10 + (digits[i] - '0');
+	}
+	expression->integer = value;
 	return expression;
 };
 
 expression_t *parse_prefix_expression(parser_t *parser){
-	token_t token = {
-			.type = parser->curr_token.type,
-			.literal = strdup(parser->curr_token.literal)
-		};
-	expression_t *expression = new_expression(PREFIX_EXPR, token);
-	expression->prefix_expression.op = strdup(token.literal);
+	token_t token = parser->curr_token;
+	expression_t *expression = new_expression(parser->arena, PREFIX_EXPR, token);
+	expression->prefix_expression.op = token.type;
 	parser_next_token(parser);
 
 	expression->prefix_expression.right = parse_expression(parser, PRECEDENCE_PREFIX);
@@ -380,28 +424,18 @@ expression_t *parse_prefix_expression(parser_t *parser){
 }
 
 expression_t *parse_boolean(parser_t *parser){
-	token_t token = {
-			.type = parser->curr_token.type,
-			.literal = strdup(parser->curr_token.literal)
-	};
-
-	expression_t *expression = new_expression(BOOLEAN_EXPR, token);
-	if (strcmp(expression->token.literal, "true") == 0){
-		expression->boolean = true;
-	} else {
-		expression->boolean = false;
-	}
+	token_t token = parser->curr_token;
+
+	expression_t *expression = new_expression(parser->arena, BOOLEAN_EXPR, token);
+	expression->boolean = token.type == TRUE;
 	return expression;
 
 }
 
 expression_t *parse_infix_expression(parser_t *parser, expression_t *left){
-	token_t token = {
-			.type = parser->curr_token.type,
-			.literal = strdup(parser->curr_token.literal)
-		};
-	expression_t *expression = new_expression(INFIX_EXPR, token);
-	expression->infix_expression.op = token.literal;
+	token_t token = parser->curr_token;
+	expression_t *expression = new_expression(parser->arena, INFIX_EXPR, token);
+	expression->infix_expression.op = token.type;
 	expression->infix_expression.left = left;
 	precedence_t precedence = curr_precedence(parser);
 	parser_next_token(parser);
@@ -410,18 +444,16 @@ expression_t *parse_infix_expression(parser_t *parser, expression_t *left){
 }
 
 expression_t *parse_call_expression(parser_t *parser, expression_t *left){
-	token_t token = {
-			.type = parser->curr_token.type,
-			.literal = strdup(parser->curr_token.literal)
-		};
-	expression_t *expression = new_expression(CALL_EXPRESSION, token);
+	token_t token = parser->curr_token;
+	expression_t *expression = new_expression(parser->arena, CALL_EXPRESSION, token);
 	expression->call_expression.function = left;
 	expression->call_expression.arguments = parse_expression_list(parser, RPAREN);
+	expression->call_expression.tail = false;
 	return expression;
 }
 
 vector_t *parse_expression_list(parser_t *parser, TokenType end){
-	vector_t *arguments = create_vector();
+	vector_t *arguments = create_arena_vector(parser->arena);
 
 	if (peek_token_is(parser, RPAREN)){
 		parser_next_token(parser);
@@ -454,11 +486,8 @@ expression_t *parse_group_expression(parser_t *parser){
 }
 
 expression_t *parse_if_expression(parser_t *parser){
-	token_t token = {
-			.type = parser->curr_token.type,
-			.literal = strdup(parser->curr_token.literal)
-		};
-	expression_t *expression = new_expression(IF_EXPR, token);
+	token_t token = parser->curr_token;
+	expression_t *expression = new_expression(parser->arena, IF_EXPR, token);
 	if (!expect_peek(parser, LPAREN)){
 		return NULL;
 	}
@@ -486,11 +515,13 @@ expression_t *parse_if_expression(parser_t *parser){
 }
 
 expression_t *parse_function_literal(parser_t *parser){
-	token_t token = {
-			.type = parser->curr_token.type,
-			.literal = strdup(parser->curr_token.literal)
-		};
-	expression_t *expression = new_expression(FUNCTION_LITERAL, token);
+	token_t token = parser->curr_token;
+	expression_t *expression = new_expression(parser->arena, FUNCTION_LITERAL, token);
+	parser->has_function_literals = true;
+	char name[32];
+	source_position_t position = parser_position(parser, token);
+	snprintf(name, sizeof(name), "fn@%u:%u", position.line, position.column);
+	expression->function_literal.name = intern_string(name);
 	if (!expect_peek(parser, LPAREN)){
 		return NULL;
 	}
@@ -505,13 +536,18 @@ expression_t *parse_function_literal(parser_t *parser){
 }
 
 expression_t *parse_string_literal(parser_t*parser){
-	expression_t *expression = new_expression(STRING_LITERAL, parser->curr_token);
-	expression->string_literal = string_from(parser->curr_token.literal);
+	expression_t *expression = new_expression(parser->arena, STRING_LITERAL, parser->curr_token);
+	// The text is interned, so equal literals share it. Never appended to or freed
+	string_t *string = arena_alloc(parser->arena, sizeof(string_t));
+	string->data = (char *)intern_token(parser, parser->curr_token);
+	string->len = parser->curr_token.length;
+	string->cap = string->len + 1;
+	expression->string_literal = string;
 	return expression;
 }
 
 vector_t *parse_function_parameters(parser_t *parser) {
-	vector_t *parameters = create_vector();  // Initialize vector if not already done
+	vector_t *parameters = create_arena_vector(parser->arena);
 
 	if (peek_token_is(parser, RPAREN)) {
 		parser_next_token(parser);
@@ -521,10 +557,11 @@ vector_t *parse_function_parameters(parser_t *parser) {
 	parser_next_token(parser);
 
 	// Allocate identifier and add to vector
-	identifier_t *identifier = malloc(sizeof(identifier_t));
-	identifier->value = strdup(parser->curr_token.literal);
-	identifier->token.type = parser->curr_token.type;
-	identifier->token.literal = strdup(parser->curr_token.literal);
+	identifier_t *identifier = arena_alloc(parser->arena, sizeof(identifier_t));
+	identifier->value = intern_token(parser, parser->curr_token);
+	identifier->token = parser->curr_token;
+	identifier->depth = 0;
+	identifier->slot = UNRESOLVED_SLOT;
 	append_vector(parameters, identifier);
 
 	// Parse any additional parameters
@@ -532,10 +569,11 @@ vector_t *parse_function_parameters(parser_t *parser) {
 		parser_next_token(parser);  // consume comma
 		parser_next_token(parser);  // consume comma
 
-		identifier_t *identifier = malloc(sizeof(identifier_t));
-		identifier->value = strdup(parser->curr_token.literal);
-		identifier->token.type = parser->curr_token.type;
-		identifier->token.literal = strdup(parser->curr_token.literal);
+		identifier_t *identifier = arena_alloc(parser->arena, sizeof(identifier_t));
+		identifier->value = intern_token(parser, parser->curr_token);
+		identifier->token = parser->curr_token;
+		identifier->depth = 0;
+		identifier->slot = UNRESOLVED_SLOT;
 		append_vector(parameters, identifier);
 	}
 
@@ -546,11 +584,8 @@ vector_t *parse_function_parameters(parser_t *parser) {
 }
 
 block_statement_t *parse_block_statement(parser_t *parser){
-	block_statement_t *block_statement = new_block_statement();
-	token_t token = {
-			.type = parser->curr_token.type,
-			.literal = strdup(parser->curr_token.literal)
-		};
+	block_statement_t *block_statement = new_block_statement(parser->arena);
+	token_t token = parser->curr_token;
 	block_statement->token = token;
 
 	parser_next_token(parser);
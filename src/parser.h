@@ -14,6 +14,12 @@ typedef struct Parser {
 	token_t	peek_token;
 
 	vector_t *errors;
+
+	/*Every node is allocated from here, parse_program hands it to the program*/
+	arena_t *arena;
+	bool has_function_literals;
+	/*Lives in the arena too, so the program takes it over along with the nodes*/
+	line_table_t lines;
 } parser_t;
 
 typedef struct ParserError {
@@ -33,9 +39,12 @@ typedef enum {
 } precedence_t;
 
 void parser_next_token(parser_t *parser);
-program_t *new_program();
+source_position_t parser_position(parser_t *parser, token_t token);
+program_t *new_program(arena_t *arena);
 program_t *parse_program(parser_t *parser);
+void free_program(program_t *program);
 parser_t *new_parser(lexer_t *lexer);
+void free_parser(parser_t *parser);
 program_t *push_to_program(statement_t *statement, program_t *program);
 statement_t *parse_let_statement(parser_t *parser);
 statement_t *parse_return_statement(parser_t *parser);
@@ -71,6 +80,7 @@ bool expect_peek(parser_t *parser, TokenType token_type);
 bool peek_token_is(parser_t *parser, TokenType token_type);
 bool curr_token_is(parser_t *parser, TokenType token_type);
 void append_error(parser_t *parser, const char *error);
+void append_error_at(parser_t *parser, token_t token, const char *error);
 void peek_error(parser_t *parser, TokenType token_type);
 void print_errors(parser_t *parser);
 bool expressions_equal(expression_t *a, expression_t *b);
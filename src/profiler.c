@@ -0,0 +1,84 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "profiler.h"
+#include "custom_string.h"
+#include "hashmap.h"
+
+profiler_t profiler;
+
+/*Each sample is its frame count, negated when frames were cut off, then the names outermost first*/
+static const char **samples = NULL;
+static size_t samples_used = 0;
+static volatile sig_atomic_t samples_dropped = 0;
+
+static void take_sample(int signal){
+    int depth = profiler.depth;
+    int last = depth < PROFILER_STACK_SIZE ? depth : PROFILER_STACK_SIZE;
+    int first = last > PROFILER_MAX_SAMPLE_DEPTH ? last - PROFILER_MAX_SAMPLE_DEPTH : 0;
+    int count = last - first;
+    if (samples_used + count + 1 > PROFILER_BUFFER_SIZE){
+        samples_dropped++;
+        return;
+    }
+    samples[samples_used++] = (const char *)(intptr_t)(first > 0 ? -count : count);
+    memcpy(&samples[samples_used], &profiler.stack[first], count * sizeof(char *));
+    samples_used += count;
+}
+
+bool profiler_start(void){
+    samples = malloc(PROFILER_BUFFER_SIZE * sizeof(char *));
+    if (samples == NULL){
+        return false;
+    }
+    struct sigaction action = { .sa_handler = take_sample, .sa_flags = SA_RESTART };
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, NULL) < 0){
+        return false;
+    }
+    profiler.enabled = true;
+    // ITIMER_PROF counts CPU time, so a script blocked on I/O isn't sampled
+    struct itimerval timer = {
+        .it_interval = { .tv_usec = 1000000 / PROFILER_HZ },
+        .it_value = { .tv_usec = 1000000 / PROFILER_HZ },
+    };
+    return setitimer(ITIMER_PROF, &timer, NULL) == 0;
+}
+
+void profiler_stop(void){
+    struct itimerval timer = {0};
+    setitimer(ITIMER_PROF, &timer, NULL);
+    signal(SIGPROF, SIG_IGN);
+    profiler.enabled = false;
+}
+
+void profiler_write_folded(FILE *out){
+    hash_map_t *counts = new_hash_table(NULL);
+    string_t *folded = string_new();
+    size_t i = 0;
+    while (i < samples_used){
+        intptr_t count = (intptr_t)samples[i++];
+        string_clear(folded);
+        string_append(folded, "main");
+        if (count < 0){
+            string_append(folded, ";...");
+            count = -count;
+        }
+        for (intptr_t j = 0; j < count; j++, i++){
+            string_append_char(folded, ';');
+            string_append(folded, samples[i]);
+        }
+        hash_set(counts, folded->data, (void *)((intptr_t)hash_get(counts, folded->data) + 1));
+    }
+
+    hash_iter_t iter = hash_iter(counts);
+    while (hash_next(&iter)){
+        fprintf(out, "%s %ld\n", (char *)iter.key, (long)(intptr_t)iter.value);
+    }
+    if (samples_dropped > 0){
+        fprintf(stderr, "profiler: sample buffer full, dropped %d samples\n", (int)samples_dropped);
+    }
+    string_free(folded);
+    free_hash(counts);
+}
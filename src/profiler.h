@@ -0,0 +1,53 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * Sampling profiler for Monkey functions. Calls push the callee's name (see
+ * function_literal_t) onto a shadow stack. A SIGPROF timer copies that stack into a
+ * buffer allocated up front, so the handler never allocates. profiler_write_folded
+ * then sums identical stacks into folded lines ("main;outer;inner 12"), the input
+ * flamegraph.pl, inferno and speedscope take.
+ *
+ * Only the innermost PROFILER_MAX_SAMPLE_DEPTH frames of a sample are kept, deeper
+ * recursion shows up under a "..." frame.
+ */
+#define PROFILER_HZ 1000
+#define PROFILER_STACK_SIZE (1 << 16)
+#define PROFILER_MAX_SAMPLE_DEPTH 128
+#define PROFILER_BUFFER_SIZE (1 << 22)
+
+typedef struct Profiler {
+	bool enabled;
+	volatile sig_atomic_t depth;
+	const char *stack[PROFILER_STACK_SIZE];
+} profiler_t;
+
+extern profiler_t profiler;
+
+bool profiler_start(void);
+void profiler_stop(void);
+void profiler_write_folded(FILE *out);
+
+static inline void profiler_push(const char *name){
+	if (profiler.enabled){
+		if (profiler.depth < PROFILER_STACK_SIZE){
+			profiler.stack[profiler.depth] = name;
+		}
+		// The handler must never see the new depth before the name under it
+		atomic_signal_fence(memory_order_release);
+		profiler.depth++;
+	}
+}
+
+static inline void profiler_pop(void){
+	if (profiler.enabled){
+		profiler.depth--;
+	}
+}
+
+#endif
@@ -4,12 +4,24 @@
 #include "ast.h"
 #include "evaluator.h"
 #include "environment.h"
+#include "compiler.h"
+#include "vm.h"
+#include "gc.h"
+#include "repl.h"
+#include "stats.h"
 #include "string.h"
 
-void repl_start(FILE *in, FILE *out){
+void repl_start(FILE *in, FILE *out, engine_t engine){
 	char input[1024] = { '\0' };
 
 	environment_t *env = new_environment();
+	gc_push_env_root(env);
+
+	/*VM state that has to survive between lines so earlier lets stay visible*/
+	symbol_table_t *symbol_table = new_global_symbol_table();
+	vector_t *constants = create_vector();
+	value_t *globals = new_vm_globals();
+
 	while(true){
 		printf(">> ");
 		if (fgets(input, sizeof(input), in) == NULL){
@@ -18,21 +30,59 @@ void repl_start(FILE *in, FILE *out){
 		if (input[0] == '\n' || input[0] == '\0') {
 			continue;
 		}
+		if (strcmp(input, ":stats\n") == 0) {
+			stats_print(out);
+			continue;
+		}
 
-		lexer_t *lexer = new_lexer(input);
+		// The next line reuses input, the tree's tokens need a copy that lives as long as it does
+		char *source = strdup(input);
+		lexer_t *lexer = new_lexer(source);
 		parser_t *parser = new_parser(lexer);
 		program_t *program = parse_program(parser);
 
 		if (parser->errors->count > 0){
 			print_errors(parser);
+			free_program(program);
+			free_parser(parser);
+			free_lexer(lexer);
+			free(source);
 			continue;
 		}
-	
-		char buff_out[BUFSIZ] = {'\0'};
-		object_t *evaluated = eval(program, NODE_PROGRAM, env);
-		//TODO: write a format wrapper so that new lines and spaces can be handled
-		inspect_object(*evaluated, buff_out);
-		printf("%s\n", buff_out);
+		free_parser(parser);
+
+		value_t evaluated;
+		if (engine == ENGINE_EVAL){
+			evaluated = eval(program, NODE_PROGRAM, env);
+		} else {
+			int num_definitions = symbol_table->num_definitions;
+			size_t num_constants = constants->count;
+			compiler_t *compiler = new_compiler_with_state(symbol_table, constants);
+			if (!compile_program(compiler, program)){
+				print_compiler_errors(compiler);
+				// Later lines mustn't see the names this one declared before it failed
+				restore_global_state(symbol_table, constants, num_definitions, num_constants);
+				free_compiler(compiler);
+				free_program(program);
+				free_lexer(lexer);
+				free(source);
+				continue;
+			}
+			vm_t *vm = new_vm_with_globals(compiler_bytecode(compiler), globals);
+			evaluated = vm_run(vm);
+			free_vm(vm);
+			free_compiler(compiler);
+		}
+		print_value(evaluated, stdout);
+		putchar('\n');
+
+		// Compiled code and plain values are independent of the tree, but evaluator
+		// closures keep pointing at their body and the source its tokens slice
+		free_lexer(lexer);
+		if (engine == ENGINE_VM || !program->has_function_literals){
+			free_program(program);
+			free(source);
+		}
 	}
 	
 	/* TODO: Free allocated memory*/
@@ -1,3 +1,13 @@
+#ifndef REPL_H
+#define REPL_H
+
 #include <stdio.h>
 
-void repl_start(FILE *in, FILE *out);
+typedef enum {
+	ENGINE_VM,
+	ENGINE_EVAL,
+} engine_t;
+
+void repl_start(FILE *in, FILE *out, engine_t engine);
+
+#endif
@@ -0,0 +1,214 @@
+#include "resolver.h"
+#include "ast.h"
+#include "environment.h"
+#include "hashmap.h"
+#include "intern.h"
+#include "object.h"
+#include "vector.h"
+
+typedef struct ResolverScope resolver_scope_t;
+typedef struct ResolverScope {
+    /*Interned name to slot index + 1, NULL for the global scope*/
+    hash_map_t *slots;
+    int num_slots;
+    /*Function literals to resolve once this scope has seen all of its lets*/
+    vector_t *pending;
+    resolver_scope_t *outer;
+} resolver_scope_t;
+
+typedef struct Resolver {
+    environment_t *globals;
+    resolver_scope_t *scope;
+} resolver_t;
+
+static void resolve_statement(resolver_t *resolver, statement_t *statement);
+static void resolve_expression(resolver_t *resolver, expression_t *expression);
+
+static void mark_tail_calls(block_statement_t *block, bool tail);
+
+/*A call is in tail position if its value goes straight back out of the function*/
+static void mark_tail_expression(expression_t *expression, bool tail){
+    if (expression == NULL){
+        return;
+    }
+    if (expression->type == CALL_EXPRESSION){
+        expression->call_expression.tail = tail;
+    } else if (expression->type == IF_EXPR){
+        mark_tail_calls(expression->if_expression.consequence, tail);
+        mark_tail_calls(expression->if_expression.alternative, tail);
+    }
+}
+
+/*
+ * Returned calls are always tail calls, the last statement's call only when the block's
+ * own value is returned. Only statement level ifs are walked, a return nested deeper in
+ * an expression stays an ordinary call.
+ */
+static void mark_tail_calls(block_statement_t *block, bool tail){
+    if (block == NULL){
+        return;
+    }
+    for (int i = 0; i < block->statements->count; i++){
+        statement_t *statement = block->statements->data[i];
+        if (statement->type == RETURN_STATEMENT){
+            mark_tail_expression(statement->value, true);
+        } else if (statement->type == EXPRESSION_STATEMENT){
+            mark_tail_expression(statement->value, tail && i == block->statements->count - 1);
+        }
+    }
+}
+
+static void resolve_pending(resolver_t *resolver){
+    vector_t *pending = resolver->scope->pending;
+    for (int i = 0; i < pending->count; i++){
+        expression_t *literal = pending->data[i];
+        resolver_scope_t scope = {
+            .slots = new_interned_hash_table(NULL),
+            .pending = create_vector(),
+            .outer = resolver->scope,
+        };
+        resolver->scope = &scope;
+
+        vector_t *parameters = literal->function_literal.parameters;
+        for (int j = 0; j < parameters->count; j++){
+            identifier_t *param = parameters->data[j];
+            interned_set(scope.slots, param->value, (void *)(intptr_t)(scope.num_slots + 1));
+            param->depth = 0;
+            param->slot = scope.num_slots++;
+        }
+
+        vector_t *statements = literal->function_literal.body->statements;
+        for (int j = 0; j < statements->count; j++){
+            resolve_statement(resolver, statements->data[j]);
+        }
+        mark_tail_calls(literal->function_literal.body, true);
+        // Any function literal in the body captures this frame
+        literal->function_literal.frame_escapes = scope.pending->count > 0;
+        resolve_pending(resolver);
+        literal->function_literal.num_locals = scope.num_slots;
+
+        resolver->scope = scope.outer;
+        free_hash(scope.slots);
+        free_vector(scope.pending);
+    }
+}
+
+static void declare(resolver_t *resolver, identifier_t *name){
+    resolver_scope_t *scope = resolver->scope;
+    name->depth = 0;
+    if (scope->slots == NULL){
+        name->slot = env_define(resolver->globals, name->value);
+        return;
+    }
+
+    intptr_t slot = (intptr_t)interned_get(scope->slots, name->value);
+    if (slot != 0){
+        // Rebinding a name in the same function reuses its slot
+        name->slot = slot - 1;
+        return;
+    }
+    interned_set(scope->slots, name->value, (void *)(intptr_t)(scope->num_slots + 1));
+    name->slot = scope->num_slots++;
+}
+
+static void resolve_identifier(resolver_t *resolver, identifier_t *ident){
+    int depth = 0;
+    resolver_scope_t *scope = resolver->scope;
+    for (; scope->slots != NULL; scope = scope->outer, depth++){
+        intptr_t slot = (intptr_t)interned_get(scope->slots, ident->value);
+        if (slot != 0){
+            ident->depth = depth;
+            ident->slot = slot - 1;
+            return;
+        }
+    }
+    // Globals may be defined by a later statement or program, so always reserve a slot
+    ident->depth = depth;
+    ident->slot = env_define(resolver->globals, ident->value);
+    // Only used while the global is unset, so a let of the same name still shadows it
+    ident->builtin = builtin_index(ident->value) + 1;
+}
+
+static void resolve_block(resolver_t *resolver, block_statement_t *block){
+    if (block == NULL){
+        return;
+    }
+    for (int i = 0; i < block->statements->count; i++){
+        resolve_statement(resolver, block->statements->data[i]);
+    }
+}
+
+static void resolve_expressions(resolver_t *resolver, vector_t *expressions){
+    for (int i = 0; i < expressions->count; i++){
+        resolve_expression(resolver, expressions->data[i]);
+    }
+}
+
+static void resolve_expression(resolver_t *resolver, expression_t *expression){
+    if (expression == NULL){
+        return;
+    }
+    switch(expression->type){
+        case IDENT_EXPR:
+            resolve_identifier(resolver, &expression->ident);
+            break;
+        case PREFIX_EXPR:
+            resolve_expression(resolver, expression->prefix_expression.right);
+            break;
+        case INFIX_EXPR:
+            resolve_expression(resolver, expression->infix_expression.left);
+            resolve_expression(resolver, expression->infix_expression.right);
+            break;
+        case IF_EXPR:
+            resolve_expression(resolver, expression->if_expression.condition);
+            resolve_block(resolver, expression->if_expression.consequence);
+            resolve_block(resolver, expression->if_expression.alternative);
+            break;
+        case FUNCTION_LITERAL:
+            append_vector(resolver->scope->pending, expression);
+            break;
+        case CALL_EXPRESSION:
+            resolve_expression(resolver, expression->call_expression.function);
+            resolve_expressions(resolver, expression->call_expression.arguments);
+            break;
+        case ARRAY_LITERAL:
+            resolve_expressions(resolver, expression->array_literal.elements);
+            break;
+        case HASH_LITERAL:
+            for (int i = 0; i < expression->hash_literal.pairs_len; i++){
+                resolve_expression(resolver, expression->hash_literal.pairs[i]->key);
+                resolve_expression(resolver, expression->hash_literal.pairs[i]->value);
+            }
+            break;
+        case INDEX_EXPR:
+            resolve_expression(resolver, expression->index_expression.left);
+            resolve_expression(resolver, expression->index_expression.index);
+            break;
+        default:
+            break;
+    }
+}
+
+static void resolve_statement(resolver_t *resolver, statement_t *statement){
+    // The value is resolved first so `let x = x + 1` still reads the outer x
+    resolve_expression(resolver, statement->value);
+    if (statement->type == LET_STATEMENT){
+        declare(resolver, &statement->name);
+    }
+}
+
+void resolve_program(program_t *program, environment_t *globals){
+    resolver_scope_t global_scope = {
+        .pending = create_vector(),
+    };
+    resolver_t resolver = {
+        .globals = globals,
+        .scope = &global_scope,
+    };
+
+    for (int i = 0; i < program->statements->count; i++){
+        resolve_statement(&resolver, program->statements->data[i]);
+    }
+    resolve_pending(&resolver);
+    free_vector(global_scope.pending);
+}
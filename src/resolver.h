@@ -0,0 +1,20 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include "ast.h"
+#include "environment.h"
+
+/*
+ * Static scope resolution for the tree walking evaluator. Annotates every identifier
+ * with the number of frames to walk outwards and its slot in that frame, every function
+ * literal with the size of its call frame and whether closures can capture it, and
+ * every call in tail position so the evaluator can run it without growing the C stack.
+ *
+ * Function bodies are resolved once their enclosing scope is complete, so a body sees
+ * every let of the scopes around it, matching the evaluator's call time lookups (this
+ * is what lets `let f = fn() { f() }` recurse). Names not bound by any enclosing
+ * function are globals and get a slot reserved in the global frame.
+ */
+void resolve_program(program_t *program, environment_t *globals);
+
+#endif
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lexer.h"
+#include "parser.h"
+#include "evaluator.h"
+#include "environment.h"
+#include "compiler.h"
+#include "vm.h"
+#include "gc.h"
+#include "script.h"
+
+/*
+ * The file is mapped read only and lexed in place, tokens are slices of the mapping.
+ * It stays mapped until the program has finished running since the evaluator walks
+ * the tree, and through it the tokens, for as long as the script runs.
+ */
+static const char *map_file(const char *path, size_t *length){
+    int fd = open(path, O_RDONLY);
+    if (fd < 0){
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0){
+        close(fd);
+        return NULL;
+    }
+    *length = st.st_size;
+    if (*length == 0){
+        // mmap rejects empty mappings, an empty script is just an empty program
+        close(fd);
+        return "";
+    }
+    void *mapped = mmap(NULL, *length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED){
+        return NULL;
+    }
+    madvise(mapped, *length, MADV_SEQUENTIAL);
+    return mapped;
+}
+
+static int run_program(program_t *program, engine_t engine){
+    value_t result;
+    if (engine == ENGINE_EVAL){
+        environment_t *env = new_environment();
+        gc_push_env_root(env);
+        result = eval(program, NODE_PROGRAM, env);
+    } else {
+        compiler_t *compiler = new_compiler();
+        if (!compile_program(compiler, program)){
+            print_compiler_errors(compiler);
+            free_compiler(compiler);
+            return 1;
+        }
+        vm_t *vm = new_vm(compiler_bytecode(compiler));
+        result = vm_run(vm);
+        free_vm(vm);
+        free_compiler(compiler);
+    }
+
+    // Only errors are reported, a script talks through puts
+    if (value_is(result, OBJECT_ERROR)){
+        print_value(result, stderr);
+        fputc('\n', stderr);
+        return 1;
+    }
+    return 0;
+}
+
+int run_script(const char *path, engine_t engine){
+    size_t length;
+    const char *source = map_file(path, &length);
+    if (source == NULL){
+        fprintf(stderr, "could not read %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    if (length > INT32_MAX){
+        fprintf(stderr, "%s is too large\n", path);
+        munmap((void *)source, length);
+        return 1;
+    }
+
+    lexer_t *lexer = new_lexer_n(source, length);
+    parser_t *parser = new_parser(lexer);
+    program_t *program = parse_program(parser);
+
+    int status = 0;
+    if (parser->errors->count > 0){
+        print_errors(parser);
+        status = 1;
+    } else {
+        status = run_program(program, engine);
+    }
+
+    free_program(program);
+    free_parser(parser);
+    free_lexer(lexer);
+    if (length > 0){
+        munmap((void *)source, length);
+    }
+    return status;
+}
@@ -0,0 +1,9 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include "repl.h"
+
+/*Runs a whole source file as one program. Returns the process exit status*/
+int run_script(const char *path, engine_t engine);
+
+#endif
@@ -0,0 +1,99 @@
+#include <time.h>
+#include "stats.h"
+#include "evaluator.h"
+#include "gc.h"
+#include "hashmap.h"
+
+stats_t stats;
+
+static const char *PHASE_NAMES[PHASE_COUNT] = {
+    [PHASE_LEX] = "lex",
+    [PHASE_PARSE] = "parse",
+    [PHASE_RESOLVE] = "resolve",
+    [PHASE_COMPILE] = "compile",
+    [PHASE_EVAL] = "eval",
+    [PHASE_VM] = "vm",
+    [PHASE_INSPECT] = "inspect",
+    [PHASE_GC] = "gc",
+};
+
+/*Phases currently entered, the innermost is charged for time until the next switch*/
+static stats_phase_t phase_stack[STATS_MAX_DEPTH];
+static int phase_depth = 0;
+static uint64_t last_switch = 0;
+
+/*Where the cycle counter and the clock were at stats_enable, to convert one to the other*/
+static uint64_t enabled_ns = 0;
+static uint64_t enabled_cycles = 0;
+
+uint64_t stats_now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void charge_current(uint64_t now){
+    if (phase_depth > 0){
+        int top = phase_depth <= STATS_MAX_DEPTH ? phase_depth - 1 : STATS_MAX_DEPTH - 1;
+        stats.phase_ns[phase_stack[top]] += now - last_switch;
+    }
+    last_switch = now;
+}
+
+void stats_enable(void){
+    stats.enabled = true;
+    enabled_ns = stats_now_ns();
+    enabled_cycles = stats_cycles();
+}
+
+static double lex_ms(void){
+    uint64_t cycles = stats_cycles() - enabled_cycles;
+    if (cycles == 0){
+        return 0;
+    }
+    return stats.lex_cycles * ((double)(stats_now_ns() - enabled_ns) / cycles) / 1e6;
+}
+
+void stats_push_phase(stats_phase_t phase){
+    charge_current(stats_now_ns());
+    if (phase_depth < STATS_MAX_DEPTH){
+        phase_stack[phase_depth] = phase;
+    }
+    phase_depth++;
+    stats.phase_calls[phase]++;
+}
+
+void stats_pop_phase(void){
+    charge_current(stats_now_ns());
+    // Enabling from inside a phase leaves a leave without an enter
+    if (phase_depth > 0){
+        phase_depth--;
+    }
+}
+
+void stats_print(FILE *out){
+    charge_current(stats_now_ns());
+    fprintf(out, "phase\tcalls\tms\n");
+    for (int i = 0; i < PHASE_COUNT; i++){
+        double ms = i == PHASE_LEX ? lex_ms() : stats.phase_ns[i] / 1e6;
+        fprintf(out, "%s\t%zu\t%.3f\n", PHASE_NAMES[i], stats.phase_calls[i], ms);
+    }
+
+    fprintf(out, "objects\n");
+    for (int i = 0; i < OBJECT_TYPE_COUNT; i++){
+        if (stats.objects[i] > 0){
+            fprintf(out, "%s\t%zu\n", object_type_to_string(i), stats.objects[i]);
+        }
+    }
+
+    double mean_probe = hash_stats.lookups == 0 ? 0 : (double)hash_stats.probes / hash_stats.lookups;
+    double mean_levels = hash_stats.hamt_lookups == 0 ? 0 : (double)hash_stats.hamt_levels / hash_stats.hamt_lookups;
+    fprintf(out, "environments\t%zu\n", stats.environments);
+    fprintf(out, "bytes_allocated\t%zu\n", stats.bytes_allocated);
+    fprintf(out, "table_lookups\t%zu\n", hash_stats.lookups);
+    fprintf(out, "table_mean_probe\t%.2f\n", mean_probe);
+    fprintf(out, "table_longest_probe\t%zu\n", hash_stats.longest_probe);
+    fprintf(out, "hash_lookups\t%zu\n", hash_stats.hamt_lookups);
+    fprintf(out, "hash_mean_levels\t%.2f\n", mean_levels);
+    fprintf(out, "gc_collections\t%zu\n", gc_collections());
+}
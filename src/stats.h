@@ -0,0 +1,73 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "object.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * Instrumentation behind --stats. The counters are plain increments and always run.
+ * Phase timing reads the clock, so it only runs after stats_enable. Phases nest and
+ * time goes to the innermost one, so puts inside eval counts as inspect, not eval.
+ * Parse includes the lexing the parser does as it pulls tokens. Lex is the part of that
+ * spent inside lexer_next_token, one call per token, read from the cycle counter since
+ * the clock would cost more than most tokens do.
+ */
+typedef enum {
+	PHASE_LEX,
+	PHASE_PARSE,
+	PHASE_RESOLVE,
+	PHASE_COMPILE,
+	PHASE_EVAL,
+	PHASE_VM,
+	PHASE_INSPECT,
+	PHASE_GC,
+	PHASE_COUNT,
+} stats_phase_t;
+
+#define STATS_MAX_DEPTH 32
+
+typedef struct Stats {
+	bool enabled;
+	uint64_t phase_ns[PHASE_COUNT];
+	size_t phase_calls[PHASE_COUNT];
+	uint64_t lex_cycles; // converted to PHASE_LEX time when printed
+	size_t objects[OBJECT_TYPE_COUNT];
+	size_t environments;
+	size_t bytes_allocated;
+} stats_t;
+
+extern stats_t stats;
+
+void stats_enable(void);
+void stats_push_phase(stats_phase_t phase);
+void stats_pop_phase(void);
+void stats_print(FILE *out);
+uint64_t stats_now_ns(void);
+
+/*Ticks at some steady rate, stats_print works out how many per nanosecond*/
+static inline uint64_t stats_cycles(void){
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return stats_now_ns();
+#endif
+}
+
+static inline void stats_enter(stats_phase_t phase){
+	if (stats.enabled){
+		stats_push_phase(phase);
+	}
+}
+
+static inline void stats_leave(void){
+	if (stats.enabled){
+		stats_pop_phase();
+	}
+}
+
+#endif
@@ -0,0 +1,127 @@
+#include <stdlib.h>
+#include <string.h>
+#include "symbol_table.h"
+#include "hashmap.h"
+#include "vector.h"
+#include "intern.h"
+
+static symbol_t *new_symbol(const char *name, symbol_scope_t scope, int index){
+    symbol_t *symbol = malloc(sizeof(symbol_t));
+    if (symbol == NULL){
+        return NULL;
+    }
+    symbol->name = name;
+    symbol->scope = scope;
+    symbol->index = index;
+    return symbol;
+}
+
+symbol_table_t *new_symbol_table(void){
+    symbol_table_t *table = malloc(sizeof(symbol_table_t));
+    if (table == NULL){
+        return NULL;
+    }
+    table->outer = NULL;
+    table->store = new_interned_hash_table(free);
+    table->num_definitions = 0;
+    table->free_symbols = create_vector();
+    return table;
+}
+
+symbol_table_t *new_enclosed_symbol_table(symbol_table_t *outer){
+    symbol_table_t *table = new_symbol_table();
+    table->outer = outer;
+    return table;
+}
+
+void free_symbol_table(symbol_table_t *table){
+    if (table == NULL){
+        return;
+    }
+    free_hash(table->store);
+    free_vector(table->free_symbols);
+    free(table);
+}
+
+/*Sets name to symbol, freeing whatever this scope had under that name before*/
+static void replace_symbol(symbol_table_t *table, const char *name, symbol_t *symbol){
+    symbol_t *replaced = interned_get(table->store, name);
+    interned_set(table->store, name, symbol);
+    free(replaced);
+}
+
+symbol_t *symbol_define(symbol_table_t *table, const char *name){
+    symbol_scope_t scope = table->outer == NULL ? SCOPE_GLOBAL : SCOPE_LOCAL;
+    // Redefining a name keeps its slot, so a long REPL session doesn't run out of globals
+    symbol_t *existing = interned_get(table->store, name);
+    if (existing != NULL && existing->scope == scope){
+        return existing;
+    }
+    symbol_t *symbol = new_symbol(name, scope, table->num_definitions);
+    replace_symbol(table, name, symbol);
+    table->num_definitions++;
+    return symbol;
+}
+
+symbol_t *symbol_define_builtin(symbol_table_t *table, int index, const char *name){
+    symbol_t *symbol = new_symbol(name, SCOPE_BUILTIN, index);
+    replace_symbol(table, name, symbol);
+    return symbol;
+}
+
+symbol_t *symbol_define_function_name(symbol_table_t *table, const char *name){
+    symbol_t *symbol = new_symbol(name, SCOPE_FUNCTION, 0);
+    replace_symbol(table, name, symbol);
+    return symbol;
+}
+
+static symbol_t *define_free(symbol_table_t *table, symbol_t *original){
+    append_vector(table->free_symbols, original);
+    symbol_t *symbol = new_symbol(original->name, SCOPE_FREE, table->free_symbols->count - 1);
+    replace_symbol(table, original->name, symbol);
+    return symbol;
+}
+
+symbol_t *symbol_resolve(symbol_table_t *table, const char *name){
+    symbol_t *symbol = interned_get(table->store, name);
+    if (symbol != NULL || table->outer == NULL){
+        return symbol;
+    }
+
+    symbol = symbol_resolve(table->outer, name);
+    if (symbol == NULL){
+        return NULL;
+    }
+    if (symbol->scope == SCOPE_GLOBAL || symbol->scope == SCOPE_BUILTIN){
+        return symbol;
+    }
+    return define_free(table, symbol);
+}
+
+void symbol_forget_globals(symbol_table_t *table, int num_definitions){
+    // Collected first, the store can't change while it's being iterated
+    vector_t *names = create_vector();
+    hash_iter_t iter = hash_iter(table->store);
+    while (hash_next(&iter)){
+        symbol_t *symbol = iter.value;
+        if (symbol->scope == SCOPE_GLOBAL && symbol->index >= num_definitions){
+            append_vector(names, (void *)symbol->name);
+        }
+    }
+    for (size_t i = 0; i < names->count; i++){
+        hash_delete_hashed(table->store, names->data[i], interned_hash(names->data[i]));
+    }
+    free_vector(names);
+    table->num_definitions = num_definitions;
+}
+
+const char *symbol_global_name(symbol_table_t *table, int index){
+    hash_iter_t iter = hash_iter(table->store);
+    while (hash_next(&iter)){
+        symbol_t *symbol = iter.value;
+        if (symbol->scope == SCOPE_GLOBAL && symbol->index == index){
+            return symbol->name;
+        }
+    }
+    return NULL;
+}
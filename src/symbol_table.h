@@ -0,0 +1,44 @@
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include "hashmap.h"
+#include "vector.h"
+
+typedef enum {
+	SCOPE_GLOBAL,
+	SCOPE_LOCAL,
+	SCOPE_BUILTIN,
+	SCOPE_FREE,
+	SCOPE_FUNCTION,
+} symbol_scope_t;
+
+typedef struct Symbol {
+	const char *name; // interned, see intern.h
+	symbol_scope_t scope;
+	int index;
+} symbol_t;
+
+typedef struct SymbolTable symbol_table_t;
+typedef struct SymbolTable {
+	symbol_table_t *outer;
+	hash_map_t *store;
+	int num_definitions;
+	/*Original symbols from enclosing scopes that this scope closes over*/
+	vector_t *free_symbols;
+} symbol_table_t;
+
+symbol_table_t *new_symbol_table(void);
+symbol_table_t *new_enclosed_symbol_table(symbol_table_t *outer);
+/*Frees the table and its own symbols, not the enclosing tables or the symbols it closes over*/
+void free_symbol_table(symbol_table_t *table);
+/*Names are interned strings, see intern.h*/
+symbol_t *symbol_define(symbol_table_t *table, const char *name);
+symbol_t *symbol_define_builtin(symbol_table_t *table, int index, const char *name);
+symbol_t *symbol_define_function_name(symbol_table_t *table, const char *name);
+symbol_t *symbol_resolve(symbol_table_t *table, const char *name);
+/*Drops the globals defined since the table had num_definitions of them*/
+void symbol_forget_globals(symbol_table_t *table, int num_definitions);
+/*Scans the whole table, meant for error messages only*/
+const char *symbol_global_name(symbol_table_t *table, int index);
+
+#endif
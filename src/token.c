@@ -38,6 +38,22 @@ const char *token_type_to_string(TokenType t) {
     return TOKEN_TYPE_STRINGS[t];
 }
 
+/*Source spelling of an operator token, for printing and error messages*/
+const char *operator_to_string(TokenType op) {
+    switch (op) {
+        case PLUS: return "+";
+        case MINUS: return "-";
+        case BANG: return "!";
+        case ASTERISK: return "*";
+        case SLASH: return "/";
+        case EQ: return "==";
+        case NOT_EQ: return "!=";
+        case LT: return "<";
+        case GT: return ">";
+        default: return token_type_to_string(op);
+    }
+}
+
 TokenType string_to_token_type(const char *str) {
     for (int i = 0; i < TOKEN_TYPE_COUNT; i++) {
         if (strcmp(TOKEN_TYPE_STRINGS[i], str) == 0) {
@@ -48,27 +64,23 @@ TokenType string_to_token_type(const char *str) {
 }
 
 
-token_t *new_token(TokenType type, char *literal){
-	token_t *token = malloc(sizeof(token_t));
-	token->type = type;
-	token->literal = strdup(literal);
-	return token;
+token_t new_token(TokenType type, uint32_t offset, int length){
+	return (token_t){ .type = type, .offset = offset, .length = length };
 }
 
-void free_token(token_t *token){
-	free(token->literal);
-	free(token);
+const char *token_start(const char *source, token_t token){
+	return source + token.offset;
 }
 
-void print_token(token_t *token){
-	printf("type: %s, literal: %s \n", token_type_to_string(token->type), token->literal);
+/*Copies the literal out of the source, for AST nodes that need a C string*/
+char *token_literal_dup(const char *source, token_t token){
+	return strndup(token_start(source, token), token.length);
 }
 
-void copy_token(token_t *dest, token_t *src) {
-    dest->type = src->type;
-    if (src->literal != NULL) {
-        dest->literal = strdup(src->literal);
-    } else {
-	dest->literal = NULL;
-    }
+bool token_literal_equals(const char *source, token_t token, const char *literal){
+	return strlen(literal) == token.length && memcmp(token_start(source, token), literal, token.length) == 0;
+}
+
+void print_token(const char *source, token_t token){
+	printf("type: %s, literal: %.*s \n", token_type_to_string(token.type), token.length, token_start(source, token));
 }
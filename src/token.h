@@ -1,6 +1,9 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 
 typedef enum {
 	ILLEGAL,
@@ -46,16 +49,24 @@ typedef enum {
 
 extern const char *TOKEN_TYPE_STRINGS[TOKEN_TYPE_COUNT];
 
+/*
+ * A span of the lexer's input, which has to outlive every token and AST node made from
+ * it. Tokens don't point at their text, it's at source + offset in the input they were
+ * lexed from.
+ */
 typedef struct Token {
 	TokenType	type;
-	char		*literal;
+	uint32_t	offset; // Byte offset in the input, the span is offset to offset + length
+	int		length;
 } token_t;
 
 const char *token_type_to_string(TokenType t);
+const char *operator_to_string(TokenType op);
 TokenType string_to_token_type(const char *str);
-token_t *new_token(TokenType type, char *literal);
-void free_token(token_t *token);
-void print_token(token_t *token);
-void copy_token(token_t *dest, token_t *src);
+token_t new_token(TokenType type, uint32_t offset, int length);
+const char *token_start(const char *source, token_t token); // Not NUL terminated
+char *token_literal_dup(const char *source, token_t token);
+bool token_literal_equals(const char *source, token_t token, const char *literal);
+void print_token(const char *source, token_t token);
 
 #endif
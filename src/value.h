@@ -0,0 +1,96 @@
+#ifndef VALUE_H
+#define VALUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * A Monkey value in a single word. Integers, booleans and null are encoded inline and
+ * never allocate. Everything else is a pointer to a heap object_t, see object.h.
+ *
+ *   ...xxxxxxx1  integer, the payload is the value shifted left by one
+ *   ...00000010  null
+ *   ...00000110  false
+ *   ...00001010  true
+ *   ...00010010  tail call marker, internal to the evaluator (see call_with_frame)
+ *   ...xxxxx000  object_t pointer, objects are at least 8 byte aligned
+ *
+ * All zero bits is VALUE_EMPTY, which marks unset slots (globals, frame locals, missing
+ * hash entries) and is never a Monkey value. Since it matches a NULL pointer, values can
+ * be stored in the void * slots of vector_t and hash_map_t via value_to_ptr/value_from_ptr.
+ */
+
+struct Object;
+typedef struct Object object_t;
+
+typedef struct Value {
+	uintptr_t bits;
+} value_t;
+
+#define VALUE_TAG_MASK ((uintptr_t)0x7)
+#define VALUE_TAG_SPECIAL ((uintptr_t)0x2)
+
+#define VALUE_EMPTY ((value_t){ .bits = 0x0 })
+#define VALUE_NULL ((value_t){ .bits = 0x2 })
+#define VALUE_FALSE ((value_t){ .bits = 0x6 })
+#define VALUE_TRUE ((value_t){ .bits = 0xA })
+#define VALUE_TAIL_CALL ((value_t){ .bits = 0x12 })
+
+static inline value_t value_from_int(int value){
+	return (value_t){ .bits = ((uintptr_t)(intptr_t)value << 1) | 1 };
+}
+
+static inline int value_as_int(value_t value){
+	return (int)((intptr_t)value.bits >> 1);
+}
+
+static inline value_t value_from_bool(bool value){
+	return value ? VALUE_TRUE : VALUE_FALSE;
+}
+
+static inline bool value_as_bool(value_t value){
+	return value.bits == VALUE_TRUE.bits;
+}
+
+static inline value_t value_from_object(object_t *object){
+	return (value_t){ .bits = (uintptr_t)object };
+}
+
+static inline object_t *value_as_object(value_t value){
+	return (object_t *)value.bits;
+}
+
+static inline bool value_is_int(value_t value){
+	return (value.bits & 1) != 0;
+}
+
+static inline bool value_is_bool(value_t value){
+	return value.bits == VALUE_TRUE.bits || value.bits == VALUE_FALSE.bits;
+}
+
+static inline bool value_is_null(value_t value){
+	return value.bits == VALUE_NULL.bits;
+}
+
+static inline bool value_is_empty(value_t value){
+	return value.bits == 0;
+}
+
+static inline bool value_is_object(value_t value){
+	return value.bits != 0 && (value.bits & VALUE_TAG_MASK) == 0;
+}
+
+/*Identity for objects, value equality for everything encoded inline*/
+static inline bool value_same(value_t a, value_t b){
+	return a.bits == b.bits;
+}
+
+static inline void *value_to_ptr(value_t value){
+	return (void *)value.bits;
+}
+
+static inline value_t value_from_ptr(void *ptr){
+	return (value_t){ .bits = (uintptr_t)ptr };
+}
+
+#endif
@@ -1,6 +1,7 @@
 #include "vector.h"
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
 vector_t *create_vector(){
 	int init_cap = 2;
@@ -17,13 +18,39 @@ vector_t *create_vector(){
 
 	vector->capacity = init_cap;
 	vector->count = 0;
+	vector->arena = NULL;
 	return vector;
 }
 
+vector_t *create_arena_vector(arena_t *arena){
+	int init_cap = 2;
+	vector_t *vector = arena_alloc(arena, sizeof(vector_t));
+	if (vector == NULL){
+		return NULL;
+	}
+	vector->data = arena_alloc(arena, sizeof(void *) * init_cap);
+	vector->capacity = init_cap;
+	vector->count = 0;
+	vector->arena = arena;
+	return vector;
+}
+
+static void **grow_data(vector_t *vector, size_t capacity){
+	if (vector->arena == NULL){
+		return realloc(vector->data, sizeof(void *) * capacity);
+	}
+	// Arena memory can't be resized, the old block is abandoned until the arena goes
+	void **data = arena_alloc(vector->arena, sizeof(void *) * capacity);
+	if (data != NULL){
+		memcpy(data, vector->data, sizeof(void *) * vector->count);
+	}
+	return data;
+}
+
 void append_vector(vector_t *vector, void *element){
 	if (vector->count >= vector->capacity){
 		vector->capacity = vector->capacity * 2;
-		void **tmp = realloc(vector->data, sizeof(void *) * vector->capacity);
+		void **tmp = grow_data(vector, vector->capacity);
 		vector->data = tmp;
 	}
 	vector->data[vector->count] = element;
@@ -46,11 +73,12 @@ vector_t *rest_vector(const vector_t *original, copy_fn_t copy){
 		return NULL;
 	}
 
-	copied->data =  malloc(sizeof(void *) * copied->capacity);
-	if (copied->data == NULL){
-		free(copied);
+	void **data = realloc(copied->data, sizeof(void *) * new_capacity);
+	if (data == NULL){
+		free_vector(copied);
 		return NULL;
 	}
+	copied->data = data;
 
 	for (int i = 1; i < original->count; i++){
 		copied->data[i-1] = copy( original->data[i] );
@@ -61,9 +89,11 @@ vector_t *rest_vector(const vector_t *original, copy_fn_t copy){
 	return copied;
 }
 
+/*Frees the container only, elements are owned by whoever put them there*/
 void free_vector(vector_t *vector){
-	for (int i = 0; i < vector->count; i++){
-		free(vector->data[i]);
+	if (vector == NULL || vector->arena != NULL){
+		return;
 	}
+	free(vector->data);
 	free(vector);
 }
@@ -2,15 +2,20 @@
 #define VECTOR_H
 
 #include <stdlib.h>
+#include "arena.h"
 
 typedef struct Vector {
 	void **data;
 	size_t capacity;
 	size_t count;
+	/*Set for vectors that live in an arena, their storage is released with it*/
+	arena_t *arena;
 } vector_t;
 
 vector_t *create_vector();
+vector_t *create_arena_vector(arena_t *arena);
 void append_vector(vector_t *vector, void *element);
+void free_vector(vector_t *vector);
 
 typedef void* (*copy_fn_t)(const void*);
 vector_t *rest_vector(const vector_t *vector, copy_fn_t copy);
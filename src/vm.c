@@ -0,0 +1,458 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vm.h"
+#include "code.h"
+#include "compiler.h"
+#include "evaluator.h"
+#include "gc.h"
+#include "hashmap.h"
+#include "object.h"
+#include "profiler.h"
+#include "stats.h"
+#include "vector.h"
+
+static value_t vm_error(const char *format, ...){
+    char error_msg[BUFSIZ];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(error_msg, sizeof(error_msg), format, args);
+    va_end(args);
+    return new_error(error_msg);
+}
+
+static void mark_globals(void *context){
+    value_t *globals = context;
+    for (int i = 0; i < GLOBALS_SIZE; i++){
+        gc_mark_value(globals[i]);
+    }
+}
+
+/*Globals stay rooted between runs so a REPL can collect while the VM is idle*/
+value_t *new_vm_globals(void){
+    value_t *globals = calloc(GLOBALS_SIZE, sizeof(value_t));
+    gc_add_root_marker(mark_globals, globals);
+    return globals;
+}
+
+void free_vm_globals(value_t *globals){
+    gc_remove_root_marker(mark_globals, globals);
+    free(globals);
+}
+
+vm_t *new_vm_with_globals(bytecode_t bytecode, value_t *globals){
+    vm_t *vm = malloc(sizeof(vm_t));
+    if (vm == NULL){
+        return NULL;
+    }
+    vm->constants = bytecode.constants;
+    vm->symbol_table = bytecode.symbol_table;
+    vm->stack = malloc(sizeof(value_t) * STACK_SIZE);
+    vm->sp = 0;
+    vm->globals = globals;
+    vm->owns_globals = false;
+    vm->frames = malloc(sizeof(frame_t) * MAX_FRAMES);
+    vm->last_popped = VALUE_NULL;
+
+    object_t *main_fn = new_object(OBJECT_COMPILED_FUNCTION);
+    main_fn->compiled_function = (compiled_function_object_t){
+        .instructions = bytecode.instructions,
+    };
+    object_t *main_closure = new_object(OBJECT_CLOSURE);
+    main_closure->closure = (closure_object_t){ .fn = main_fn };
+
+    vm->frames[0] = (frame_t){ .closure = main_closure, .ip = 0, .base_pointer = 0 };
+    vm->frame_index = 0;
+    return vm;
+}
+
+vm_t *new_vm(bytecode_t bytecode){
+    vm_t *vm = new_vm_with_globals(bytecode, new_vm_globals());
+    vm->owns_globals = true;
+    return vm;
+}
+
+void free_vm(vm_t *vm){
+    // Constants, and globals passed in by the caller, outlive a single run in the REPL
+    if (vm->owns_globals){
+        free_vm_globals(vm->globals);
+    }
+    free(vm->stack);
+    free(vm->frames);
+    free(vm);
+}
+
+static const TokenType OPCODE_OPERATORS[OPCODE_COUNT] = {
+    [OP_ADD] = PLUS,
+    [OP_SUB] = MINUS,
+    [OP_MUL] = ASTERISK,
+    [OP_DIV] = SLASH,
+    [OP_GREATER_THAN] = GT,
+    [OP_LESS_THAN] = LT,
+    [OP_EQUAL] = EQ,
+    [OP_NOT_EQUAL] = NOT_EQ,
+};
+
+/*Integers take the fast path, everything else defers to the evaluator so both backends agree on semantics*/
+static value_t execute_binary_operation(opcode_t op, value_t left, value_t right){
+    if (value_is_int(left) && value_is_int(right)){
+        int left_value = value_as_int(left);
+        int right_value = value_as_int(right);
+        switch (op){
+            case OP_ADD:
+                return value_from_int(left_value + right_value);
+            case OP_SUB:
+                return value_from_int(left_value - right_value);
+            case OP_MUL:
+                return value_from_int(left_value * right_value);
+            case OP_DIV:
+                if (right_value == 0){
+                    return vm_error("division by zero");
+                }
+                return value_from_int(left_value / right_value);
+            case OP_GREATER_THAN:
+                return value_from_bool(left_value > right_value);
+            case OP_LESS_THAN:
+                return value_from_bool(left_value < right_value);
+            case OP_EQUAL:
+                return value_from_bool(left_value == right_value);
+            case OP_NOT_EQUAL:
+                return value_from_bool(left_value != right_value);
+            default:
+                break;
+        }
+    }
+    return eval_infix_expression(OPCODE_OPERATORS[op], left, right);
+}
+
+static value_t build_hash(value_t *pairs, int count){
+    // No safepoint until it's pushed, so the half built hash doesn't need rooting
+    object_t *hash = new_hash_object();
+    for (int i = 0; i < count; i += 2){
+        hash_key_t key;
+        if (!value_to_hash_key(pairs[i], &key)){
+            return vm_error("unuseable as hash key: %s", object_type_to_string(value_type(pairs[i])));
+        }
+        hash_object_set(&hash->hash, key, pairs[i + 1]);
+    }
+    return value_from_object(hash);
+}
+
+/*Prefixes an error with the position of the instruction that ends just before ip*/
+static value_t located_error(frame_t *frame, int ip, value_t error){
+    instructions_t *instructions = frame->closure->closure.fn->compiled_function.instructions;
+    uint32_t line, column;
+    if (!instructions_position(instructions, ip - 1, &line, &column)){
+        return error;
+    }
+    char error_msg[BUFSIZ];
+    snprintf(error_msg, sizeof(error_msg), "%u:%u: %s", line, column, value_as_object(error)->error_message->data);
+    return new_error(error_msg);
+}
+
+/*A call in tail position returns whatever comes back, possibly by jumping out of an if first*/
+static bool returns_next(uint8_t *ins, size_t ins_len, int ip){
+    if ((size_t)ip < ins_len && ins[ip] == OP_JUMP){
+        ip = read_uint16(ins + ip + 1);
+    }
+    return (size_t)ip < ins_len && ins[ip] == OP_RETURN_VALUE;
+}
+
+static void mark_vm_roots(void *context){
+    vm_t *vm = context;
+    for (int i = 0; i < vm->sp; i++){
+        gc_mark_value(vm->stack[i]);
+    }
+    for (size_t i = 0; i < vm->constants->count; i++){
+        gc_mark_value(value_from_ptr(vm->constants->data[i]));
+    }
+    for (int i = 0; i <= vm->frame_index; i++){
+        gc_mark_object(vm->frames[i].closure);
+    }
+    gc_mark_value(vm->last_popped);
+}
+
+static value_t vm_execute(vm_t *vm){
+    value_t *stack = vm->stack;
+    frame_t *frame = &vm->frames[vm->frame_index];
+    instructions_t *instructions = frame->closure->closure.fn->compiled_function.instructions;
+    uint8_t *ins = instructions->data;
+    size_t ins_len = instructions->len;
+    int ip = frame->ip;
+
+// Runtime errors say where they happened, ip is still inside the failing instruction
+#define FAIL(error) return located_error(frame, ip, (error))
+#define PUSH(obj) do { \
+        if (vm->sp >= STACK_SIZE){ FAIL(vm_error("stack overflow")); } \
+        stack[vm->sp++] = (obj); \
+    } while (0)
+#define POP() (stack[--vm->sp])
+#define LOAD_FRAME() do { \
+        frame = &vm->frames[vm->frame_index]; \
+        instructions = frame->closure->closure.fn->compiled_function.instructions; \
+        ins = instructions->data; \
+        ins_len = instructions->len; \
+        ip = frame->ip; \
+    } while (0)
+
+    while ((size_t)ip < ins_len){
+        opcode_t op = ins[ip++];
+        switch (op){
+            case OP_CONSTANT: {
+                uint16_t index = read_uint16(ins + ip);
+                ip += 2;
+                PUSH(value_from_ptr(vm->constants->data[index]));
+                break;
+            }
+            case OP_POP:
+                vm->last_popped = POP();
+                gc_safepoint();
+                break;
+            case OP_ADD:
+            case OP_SUB:
+            case OP_MUL:
+            case OP_DIV:
+            case OP_EQUAL:
+            case OP_NOT_EQUAL:
+            case OP_GREATER_THAN:
+            case OP_LESS_THAN: {
+                value_t right = POP();
+                value_t left = POP();
+                value_t result = execute_binary_operation(op, left, right);
+                if (value_is(result, OBJECT_ERROR)){
+                    FAIL(result);
+                }
+                PUSH(result);
+                break;
+            }
+            case OP_TRUE:
+                PUSH(VALUE_TRUE);
+                break;
+            case OP_FALSE:
+                PUSH(VALUE_FALSE);
+                break;
+            case OP_NULL:
+                PUSH(VALUE_NULL);
+                break;
+            case OP_BANG: {
+                value_t operand = POP();
+                PUSH(value_from_bool(!is_truthy(operand)));
+                break;
+            }
+            case OP_MINUS: {
+                value_t operand = POP();
+                if (!value_is_int(operand)){
+                    FAIL(eval_minus_operator(operand));
+                }
+                PUSH(value_from_int(-value_as_int(operand)));
+                break;
+            }
+            case OP_JUMP:
+                ip = read_uint16(ins + ip);
+                break;
+            case OP_JUMP_NOT_TRUTHY: {
+                uint16_t target = read_uint16(ins + ip);
+                ip += 2;
+                if (!is_truthy(POP())){
+                    ip = target;
+                }
+                break;
+            }
+            case OP_SET_GLOBAL: {
+                uint16_t index = read_uint16(ins + ip);
+                ip += 2;
+                vm->globals[index] = POP();
+                break;
+            }
+            case OP_GET_GLOBAL: {
+                uint16_t index = read_uint16(ins + ip);
+                ip += 2;
+                value_t value = vm->globals[index];
+                // Declared up front but its let hasn't run yet
+                if (value_is_empty(value)){
+                    FAIL(vm_error("identifier not found: %s", symbol_global_name(vm->symbol_table, index)));
+                }
+                PUSH(value);
+                break;
+            }
+            case OP_SET_LOCAL: {
+                uint8_t index = read_uint8(ins + ip);
+                ip += 1;
+                stack[frame->base_pointer + index] = POP();
+                break;
+            }
+            case OP_GET_LOCAL: {
+                uint8_t index = read_uint8(ins + ip);
+                ip += 1;
+                PUSH(stack[frame->base_pointer + index]);
+                break;
+            }
+            case OP_GET_BUILTIN: {
+                uint8_t index = read_uint8(ins + ip);
+                ip += 1;
+                PUSH(get_builtin_by_index(index));
+                break;
+            }
+            case OP_GET_FREE: {
+                uint8_t index = read_uint8(ins + ip);
+                ip += 1;
+                PUSH(frame->closure->closure.free[index]);
+                break;
+            }
+            case OP_CURRENT_CLOSURE:
+                PUSH(value_from_object(frame->closure));
+                break;
+            case OP_ARRAY: {
+                uint16_t count = read_uint16(ins + ip);
+                ip += 2;
+                object_t *array = new_array_object(count);
+                for (int i = vm->sp - count; i < vm->sp; i++){
+                    array_append(array, stack[i]);
+                }
+                vm->sp -= count;
+                PUSH(value_from_object(array));
+                break;
+            }
+            case OP_HASH: {
+                uint16_t count = read_uint16(ins + ip);
+                ip += 2;
+                value_t hash = build_hash(stack + vm->sp - count, count);
+                if (value_is(hash, OBJECT_ERROR)){
+                    FAIL(hash);
+                }
+                vm->sp -= count;
+                PUSH(hash);
+                break;
+            }
+            case OP_INDEX: {
+                value_t index = POP();
+                value_t left = POP();
+                value_t result = eval_index_expression(left, index);
+                if (value_is(result, OBJECT_ERROR)){
+                    FAIL(result);
+                }
+                PUSH(result);
+                break;
+            }
+            case OP_CALL: {
+                uint8_t num_args = read_uint8(ins + ip);
+                ip += 1;
+                gc_safepoint();
+                value_t callee_value = stack[vm->sp - 1 - num_args];
+                object_type_t callee_type = value_type(callee_value);
+
+                if (callee_type == OBJECT_BUILTIN){
+                    vector_t *args = create_vector();
+                    for (int i = vm->sp - num_args; i < vm->sp; i++){
+                        append_vector(args, value_to_ptr(stack[i]));
+                    }
+                    value_t result = value_as_object(callee_value)->builtin(args);
+                    free(args->data);
+                    free(args);
+                    if (value_is(result, OBJECT_ERROR)){
+                        FAIL(result);
+                    }
+                    vm->sp -= num_args + 1;
+                    PUSH(result);
+                    break;
+                }
+                if (callee_type != OBJECT_CLOSURE){
+                    FAIL(vm_error("not a function"));
+                }
+                object_t *callee = value_as_object(callee_value);
+
+                compiled_function_object_t *fn = &callee->closure.fn->compiled_function;
+                if (num_args != fn->num_parameters){
+                    FAIL(vm_error("wrong number of arguments"));
+                }
+                // Nothing is left to do in this frame, so the callee takes it over
+                bool tail = vm->frame_index > 0 && returns_next(ins, ins_len, ip);
+                if (!tail && vm->frame_index + 1 >= MAX_FRAMES){
+                    FAIL(vm_error("stack overflow"));
+                }
+                int base_pointer = tail ? frame->base_pointer : vm->sp - num_args;
+                if (base_pointer + fn->num_locals >= STACK_SIZE){
+                    FAIL(vm_error("stack overflow"));
+                }
+                if (tail){
+                    memmove(&stack[base_pointer - 1], &stack[vm->sp - 1 - num_args], (num_args + 1) * sizeof(value_t));
+                    vm->sp = base_pointer + num_args;
+                    profiler_pop();
+                } else {
+                    frame->ip = ip;
+                    vm->frame_index++;
+                }
+                // Locals that are read before their let has run see null, not a stale slot
+                for (int i = vm->sp; i < base_pointer + fn->num_locals; i++){
+                    stack[i] = VALUE_NULL;
+                }
+
+                vm->frames[vm->frame_index] = (frame_t){
+                    .closure = callee,
+                    .ip = 0,
+                    .base_pointer = base_pointer,
+                };
+                vm->sp = base_pointer + fn->num_locals;
+                profiler_push(fn->name);
+                LOAD_FRAME();
+                break;
+            }
+            case OP_RETURN_VALUE:
+            case OP_RETURN: {
+                value_t return_value = op == OP_RETURN_VALUE ? POP() : VALUE_NULL;
+                if (vm->frame_index == 0){
+                    // A top level return ends the program like it does in eval_program
+                    vm->last_popped = return_value;
+                    frame->ip = ins_len;
+                    return vm->last_popped;
+                }
+                vm->sp = frame->base_pointer - 1;
+                vm->frame_index--;
+                profiler_pop();
+                LOAD_FRAME();
+                PUSH(return_value);
+                break;
+            }
+            case OP_CLOSURE: {
+                uint16_t const_index = read_uint16(ins + ip);
+                uint8_t num_free = read_uint8(ins + ip + 2);
+                ip += 3;
+
+                object_t *closure = new_object(OBJECT_CLOSURE);
+                closure->closure.fn = value_as_object(value_from_ptr(vm->constants->data[const_index]));
+                closure->closure.num_free = num_free;
+                closure->closure.free = NULL;
+                if (num_free > 0){
+                    closure->closure.free = malloc(sizeof(value_t) * num_free);
+                    memcpy(closure->closure.free, stack + vm->sp - num_free, sizeof(value_t) * num_free);
+                }
+                vm->sp -= num_free;
+                PUSH(value_from_object(closure));
+                break;
+            }
+            default:
+                FAIL(vm_error("unknown opcode %d", op));
+        }
+    }
+
+#undef PUSH
+#undef POP
+#undef FAIL
+#undef LOAD_FRAME
+
+    frame->ip = ip;
+    return vm->last_popped;
+}
+
+value_t vm_run(vm_t *vm){
+    gc_add_root_marker(mark_vm_roots, vm);
+    stats_enter(PHASE_VM);
+    // Errors return straight out of nested calls, leaving their frames on the shadow stack
+    sig_atomic_t profiler_depth = profiler.depth;
+    value_t result = vm_execute(vm);
+    profiler.depth = profiler_depth;
+    stats_leave();
+    gc_remove_root_marker(mark_vm_roots, vm);
+    return result;
+}
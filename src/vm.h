@@ -0,0 +1,41 @@
+#ifndef VM_H
+#define VM_H
+
+#include "compiler.h"
+#include "object.h"
+#include "vector.h"
+
+#define STACK_SIZE 2048
+#define GLOBALS_SIZE 65536
+#define MAX_FRAMES 1024
+
+typedef struct Frame {
+	object_t *closure;
+	int ip;
+	int base_pointer;
+} frame_t;
+
+typedef struct VM {
+	vector_t *constants;
+	symbol_table_t *symbol_table;
+
+	value_t *stack;
+	int sp; // Always points to the next free slot, top of stack is stack[sp-1]
+
+	value_t *globals;
+	bool owns_globals;
+
+	frame_t *frames;
+	int frame_index;
+
+	value_t last_popped;
+} vm_t;
+
+vm_t *new_vm(bytecode_t bytecode);
+vm_t *new_vm_with_globals(bytecode_t bytecode, value_t *globals);
+value_t *new_vm_globals(void);
+void free_vm_globals(value_t *globals);
+value_t vm_run(vm_t *vm);
+void free_vm(vm_t *vm);
+
+#endif
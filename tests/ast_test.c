@@ -3,6 +3,7 @@
 #include "../src/token.h"
 #include "../src/parser.h"
 #include "../src/custom_string.h"
+#include "../src/intern.h"
 
 void test_ast_string() {
         program_t *program = malloc(sizeof(program_t));
@@ -11,22 +12,19 @@ void test_ast_string() {
         // Allocate statement
         statement_t *statement = malloc(sizeof(statement_t));
         statement->type = LET_STATEMENT;
-        statement->token.type = LET;
-        statement->token.literal = strdup("let");
+        // Spans of "let myVar = anotherVar"
+        statement->token = new_token(LET, 0, 3);
 
         // Set up identifier name
-        statement->name.token.type = IDENT;
-        statement->name.token.literal = strdup("myVar");
-        statement->name.value = strdup("myVar");
+        statement->name.token = new_token(IDENT, 4, 5);
+        statement->name.value = intern_string("myVar");
 
         // Set up identifier value
         expression_t *value_expr = malloc(sizeof(expression_t));
         value_expr->type = IDENT_EXPR;
-        value_expr->token.type = IDENT;
-        value_expr->token.literal = strdup("anotherVar");
-        value_expr->ident.token.type = IDENT;
-        value_expr->ident.token.literal = strdup("anotherVar");
-        value_expr->ident.value = strdup("anotherVar");
+        value_expr->token = new_token(IDENT, 12, 10);
+        value_expr->ident.token = value_expr->token;
+        value_expr->ident.value = intern_string("anotherVar");
 
         statement->value = value_expr;
         // Add to program
@@ -45,15 +43,9 @@ void test_ast_string() {
         string_free(program_str);
 
         // Free statement components
-        free(value_expr->token.literal);
-        free(value_expr->ident.token.literal);
-        free(value_expr->ident.value);
         free(value_expr);
 
         // Free statement
-        free(statement->token.literal);
-        free(statement->name.token.literal); 
-        free(statement->name.value);
         free(statement);
 
         // Free program 
@@ -0,0 +1,338 @@
+#include "test_helpers.h"
+#include "../src/code.h"
+#include "../src/compiler.h"
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "../src/intern.h"
+#include "../src/object.h"
+
+void test_make_instructions() {
+        struct {
+                opcode_t op;
+                int operands[2];
+                uint8_t expected[4];
+                size_t expected_len;
+        } tests[] = {
+                {OP_CONSTANT, {65534}, {OP_CONSTANT, 255, 254}, 3},
+                {OP_ADD, {0}, {OP_ADD}, 1},
+                {OP_GET_LOCAL, {255}, {OP_GET_LOCAL, 255}, 2},
+                {OP_CLOSURE, {65534, 255}, {OP_CLOSURE, 255, 254, 255}, 4},
+        };
+
+        for (int i = 0; i < sizeof(tests)/sizeof(tests[0]); i++) {
+                instructions_t *ins = new_instructions();
+                emit_instruction(ins, tests[i].op, tests[i].operands[0], tests[i].operands[1]);
+                assertf(ins->len == tests[i].expected_len,
+                        "[%d] instruction has wrong length. want=%zu, got=%zu",
+                        i, tests[i].expected_len, ins->len);
+                for (size_t j = 0; j < ins->len; j++) {
+                        assertf(ins->data[j] == tests[i].expected[j],
+                                "[%d] wrong byte at pos %zu. want=%d, got=%d",
+                                i, j, tests[i].expected[j], ins->data[j]);
+                }
+                free_instructions(ins);
+        }
+}
+
+void test_instructions_string() {
+        instructions_t *ins = new_instructions();
+        emit_instruction(ins, OP_ADD);
+        emit_instruction(ins, OP_GET_LOCAL, 1);
+        emit_instruction(ins, OP_CONSTANT, 2);
+        emit_instruction(ins, OP_CONSTANT, 65535);
+        emit_instruction(ins, OP_CLOSURE, 65535, 255);
+
+        char *expected = "0000 OpAdd\n"
+                         "0001 OpGetLocal 1\n"
+                         "0003 OpConstant 2\n"
+                         "0006 OpConstant 65535\n"
+                         "0009 OpClosure 65535 255\n";
+
+        string_t *got = instructions_to_string(ins);
+        assertf(strcmp(got->data, expected) == 0,
+                "instructions wrongly formatted.\nwant=%s\ngot=%s", expected, got->data);
+}
+
+compiler_t *compile_input(char *input) {
+        lexer_t *lexer = new_lexer(input);
+        parser_t *parser = new_parser(lexer);
+        program_t *program = parse_program(parser);
+        compiler_t *compiler = new_compiler();
+        bool ok = compile_program(compiler, program);
+        assertf(ok, "compiler error: %s", ok ? "" : (char *)compiler->errors->data[0]);
+        return compiler;
+}
+
+void check_instructions(char *input, instructions_t *expected, instructions_t *got) {
+        string_t *want_str = instructions_to_string(expected);
+        string_t *got_str = instructions_to_string(got);
+        assertf(strcmp(want_str->data, got_str->data) == 0,
+                "wrong instructions for %s.\nwant=\n%s\ngot=\n%s",
+                input, want_str->data, got_str->data);
+        string_free(want_str);
+        string_free(got_str);
+}
+
+void test_integer_arithmetic() {
+        char *input = "1 + 2; -3 < 4";
+        compiler_t *compiler = compile_input(input);
+        bytecode_t bytecode = compiler_bytecode(compiler);
+
+        instructions_t *expected = new_instructions();
+        emit_instruction(expected, OP_CONSTANT, 0);
+        emit_instruction(expected, OP_CONSTANT, 1);
+        emit_instruction(expected, OP_ADD);
+        emit_instruction(expected, OP_POP);
+        emit_instruction(expected, OP_CONSTANT, 2);
+        emit_instruction(expected, OP_MINUS);
+        emit_instruction(expected, OP_CONSTANT, 3);
+        emit_instruction(expected, OP_LESS_THAN);
+        emit_instruction(expected, OP_POP);
+        check_instructions(input, expected, bytecode.instructions);
+
+        int constants[] = {1, 2, 3, 4};
+        assertf(bytecode.constants->count == 4,
+                "wrong number of constants. want=4, got=%zu", bytecode.constants->count);
+        for (int i = 0; i < 4; i++) {
+                value_t constant = value_from_ptr(bytecode.constants->data[i]);
+                assertf(value_is_int(constant) && value_as_int(constant) == constants[i],
+                        "constant %d wrong. want=%d, got=%d", i, constants[i], value_as_int(constant));
+        }
+}
+
+void test_conditionals() {
+        char *input = "if (true) { 10 } else { 20 }; 3333;";
+        compiler_t *compiler = compile_input(input);
+
+        instructions_t *expected = new_instructions();
+        emit_instruction(expected, OP_TRUE);                // 0000
+        emit_instruction(expected, OP_JUMP_NOT_TRUTHY, 10); // 0001
+        emit_instruction(expected, OP_CONSTANT, 0);         // 0004
+        emit_instruction(expected, OP_JUMP, 13);            // 0007
+        emit_instruction(expected, OP_CONSTANT, 1);         // 0010
+        emit_instruction(expected, OP_POP);                 // 0013
+        emit_instruction(expected, OP_CONSTANT, 2);         // 0014
+        emit_instruction(expected, OP_POP);                 // 0017
+        check_instructions(input, expected, compiler_bytecode(compiler).instructions);
+}
+
+void test_global_let_statements() {
+        char *input = "let one = 1; let two = one; two;";
+        compiler_t *compiler = compile_input(input);
+
+        instructions_t *expected = new_instructions();
+        emit_instruction(expected, OP_CONSTANT, 0);
+        emit_instruction(expected, OP_SET_GLOBAL, 0);
+        emit_instruction(expected, OP_GET_GLOBAL, 0);
+        emit_instruction(expected, OP_SET_GLOBAL, 1);
+        emit_instruction(expected, OP_GET_GLOBAL, 1);
+        emit_instruction(expected, OP_POP);
+        check_instructions(input, expected, compiler_bytecode(compiler).instructions);
+}
+
+void test_redefined_globals_keep_their_slot() {
+        char *input = "let a = 1; let b = 2; let a = 3; a;";
+        compiler_t *compiler = compile_input(input);
+
+        instructions_t *expected = new_instructions();
+        emit_instruction(expected, OP_CONSTANT, 0);
+        emit_instruction(expected, OP_SET_GLOBAL, 0);
+        emit_instruction(expected, OP_CONSTANT, 1);
+        emit_instruction(expected, OP_SET_GLOBAL, 1);
+        emit_instruction(expected, OP_CONSTANT, 2);
+        emit_instruction(expected, OP_SET_GLOBAL, 0);
+        emit_instruction(expected, OP_GET_GLOBAL, 0);
+        emit_instruction(expected, OP_POP);
+        check_instructions(input, expected, compiler_bytecode(compiler).instructions);
+        assertf(compiler->symbol_table->num_definitions == 2,
+                "wrong number of globals. want=2, got=%d", compiler->symbol_table->num_definitions);
+}
+
+void test_closures() {
+        char *input = "fn(a) { fn(b) { a + b } }";
+        compiler_t *compiler = compile_input(input);
+        bytecode_t bytecode = compiler_bytecode(compiler);
+
+        instructions_t *inner = new_instructions();
+        emit_instruction(inner, OP_GET_FREE, 0);
+        emit_instruction(inner, OP_GET_LOCAL, 0);
+        emit_instruction(inner, OP_ADD);
+        emit_instruction(inner, OP_RETURN_VALUE);
+        object_t *inner_fn = value_as_object(value_from_ptr(bytecode.constants->data[0]));
+        assertf(inner_fn->type == OBJECT_COMPILED_FUNCTION, "constant 0 is not a compiled function");
+        check_instructions(input, inner, inner_fn->compiled_function.instructions);
+
+        instructions_t *outer = new_instructions();
+        emit_instruction(outer, OP_GET_LOCAL, 0);
+        emit_instruction(outer, OP_CLOSURE, 0, 1);
+        emit_instruction(outer, OP_RETURN_VALUE);
+        object_t *outer_fn = value_as_object(value_from_ptr(bytecode.constants->data[1]));
+        check_instructions(input, outer, outer_fn->compiled_function.instructions);
+        assertf(outer_fn->compiled_function.num_locals == 1,
+                "wrong number of locals. want=1, got=%d", outer_fn->compiled_function.num_locals);
+
+        instructions_t *main_ins = new_instructions();
+        emit_instruction(main_ins, OP_CLOSURE, 1, 0);
+        emit_instruction(main_ins, OP_POP);
+        check_instructions(input, main_ins, bytecode.instructions);
+}
+
+void test_recursive_function_uses_current_closure() {
+        char *input = "let countDown = fn(x) { countDown(x - 1); }; countDown(1);";
+        compiler_t *compiler = compile_input(input);
+        bytecode_t bytecode = compiler_bytecode(compiler);
+
+        instructions_t *body = new_instructions();
+        emit_instruction(body, OP_CURRENT_CLOSURE);
+        emit_instruction(body, OP_GET_LOCAL, 0);
+        emit_instruction(body, OP_CONSTANT, 0);
+        emit_instruction(body, OP_SUB);
+        emit_instruction(body, OP_CALL, 1);
+        emit_instruction(body, OP_RETURN_VALUE);
+        object_t *fn = value_as_object(value_from_ptr(bytecode.constants->data[1]));
+        check_instructions(input, body, fn->compiled_function.instructions);
+}
+
+void test_undefined_identifier() {
+        lexer_t *lexer = new_lexer("let a = 1;\n  foobar");
+        parser_t *parser = new_parser(lexer);
+        program_t *program = parse_program(parser);
+        compiler_t *compiler = new_compiler();
+
+        assertf(!compile_program(compiler, program), "expected compilation to fail");
+        assertf(strcmp(compiler->errors->data[0], "2:3: identifier not found: foobar") == 0,
+                "wrong error. got=%s", (char *)compiler->errors->data[0]);
+}
+
+void test_failed_function_leaves_its_scope() {
+        lexer_t *lexer = new_lexer("let f = fn(x) { let y = x; foobar };");
+        parser_t *parser = new_parser(lexer);
+        program_t *program = parse_program(parser);
+        compiler_t *compiler = new_compiler();
+        symbol_table_t *globals = compiler->symbol_table;
+
+        assertf(!compile_program(compiler, program), "expected compilation to fail");
+        assertf(compiler->scope_index == 0, "left in scope %d", compiler->scope_index);
+        assertf(compiler->symbol_table == globals, "left with the function's symbol table");
+        assertf(symbol_resolve(globals, intern_string("y")) == NULL, "function local leaked into the globals");
+}
+
+void test_failed_compile_restores_global_state() {
+        symbol_table_t *symbol_table = new_global_symbol_table();
+        vector_t *constants = create_vector();
+        lexer_t *lexer = new_lexer("let a = 1; let len = 2; let b = foobar;");
+        parser_t *parser = new_parser(lexer);
+        compiler_t *compiler = new_compiler_with_state(symbol_table, constants);
+
+        assertf(!compile_program(compiler, parse_program(parser)), "expected compilation to fail");
+        restore_global_state(symbol_table, constants, 0, 0);
+        assertf(symbol_resolve(symbol_table, intern_string("a")) == NULL, "a is still defined");
+        assertf(symbol_resolve(symbol_table, intern_string("b")) == NULL, "b is still defined");
+        symbol_t *len = symbol_resolve(symbol_table, intern_string("len"));
+        assertf(len != NULL && len->scope == SCOPE_BUILTIN, "len is no longer the builtin");
+        assertf(symbol_table->num_definitions == 0, "wrong num_definitions. got=%d", symbol_table->num_definitions);
+        assertf(constants->count == 0, "wrong number of constants. got=%zu", constants->count);
+}
+
+void test_integer_constants_are_shared() {
+        char *input = "1; 2; 1; let a = 2;";
+        compiler_t *compiler = compile_input(input);
+        bytecode_t bytecode = compiler_bytecode(compiler);
+
+        instructions_t *expected = new_instructions();
+        emit_instruction(expected, OP_CONSTANT, 0);
+        emit_instruction(expected, OP_POP);
+        emit_instruction(expected, OP_CONSTANT, 1);
+        emit_instruction(expected, OP_POP);
+        emit_instruction(expected, OP_CONSTANT, 0);
+        emit_instruction(expected, OP_POP);
+        emit_instruction(expected, OP_CONSTANT, 1);
+        emit_instruction(expected, OP_SET_GLOBAL, 0);
+        check_instructions(input, expected, bytecode.instructions);
+        assertf(bytecode.constants->count == 2,
+                "wrong number of constants. want=2, got=%zu", bytecode.constants->count);
+}
+
+char *compile_error(char *input) {
+        lexer_t *lexer = new_lexer(input);
+        parser_t *parser = new_parser(lexer);
+        program_t *program = parse_program(parser);
+        assertf(parser->errors->count == 0, "parser error: %s",
+                parser->errors->count == 0 ? "" : (char *)parser->errors->data[0]);
+        compiler_t *compiler = new_compiler();
+        assertf(!compile_program(compiler, program), "expected compilation to fail");
+        assertf(compiler->errors->count == 1, "expected one error, got=%d", compiler->errors->count);
+        return compiler->errors->data[0];
+}
+
+void check_compile_error(char *input, char *expected) {
+        char *error = compile_error(input);
+        assertf(strcmp(error, expected) == 0, "wrong error.\nwant=%s\ngot=%s", expected, error);
+}
+
+void test_operands_out_of_range() {
+        // One constant too many, every let is a different integer
+        string_t *source = string_new();
+        char line[64];
+        for (int i = 0; i <= 65536; i++) {
+                snprintf(line, sizeof(line), "let a = %d;\n", i);
+                string_append(source, line);
+        }
+        check_compile_error(source->data, "65537:9: too many constants, at most 65536");
+        string_free(source);
+
+        // A branch longer than a 16 bit jump target can reach
+        source = string_new();
+        string_append(source, "let x = 1;\nif (x) {\n");
+        for (int i = 0; i < 10000; i++) {
+                string_append(source, "x + x;\n");
+        }
+        string_append(source, "}\n");
+        check_compile_error(source->data, "2:1: function too long to jump within, at most 65536 bytes of bytecode");
+        string_free(source);
+
+        source = string_new();
+        string_append(source, "fn() {\n");
+        for (int i = 0; i <= 256; i++) {
+                // Identifiers can't hold digits
+                snprintf(line, sizeof(line), "let v%c%c = 1;\n", 'a' + i / 26, 'a' + i % 26);
+                string_append(source, line);
+        }
+        string_append(source, "}\n");
+        check_compile_error(source->data, "258:1: too many local bindings in one function, at most 256");
+        string_free(source);
+
+        source = string_new();
+        string_append(source, "let f = fn() { 1 };\nf(");
+        for (int i = 0; i <= 255; i++) {
+                string_append(source, i == 0 ? "1" : ", 1");
+        }
+        string_append(source, ");\n");
+        check_compile_error(source->data, "2:2: too many arguments in one call, at most 255");
+        string_free(source);
+
+        source = string_new();
+        string_append(source, "[");
+        for (int i = 0; i <= 65535; i++) {
+                string_append(source, i == 0 ? "1" : ",1");
+        }
+        string_append(source, "]");
+        check_compile_error(source->data, "1:1: too many elements in one array literal, at most 65535");
+        string_free(source);
+}
+
+int main(int argc, char *argv[]) {
+        TEST(test_make_instructions);
+        TEST(test_instructions_string);
+        TEST(test_integer_arithmetic);
+        TEST(test_conditionals);
+        TEST(test_global_let_statements);
+        TEST(test_redefined_globals_keep_their_slot);
+        TEST(test_closures);
+        TEST(test_recursive_function_uses_current_closure);
+        TEST(test_undefined_identifier);
+        TEST(test_failed_function_leaves_its_scope);
+        TEST(test_failed_compile_restores_global_state);
+        TEST(test_integer_constants_are_shared);
+        TEST(test_operands_out_of_range);
+}
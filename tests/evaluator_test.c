@@ -3,33 +3,25 @@
 #include "../src/lexer.h"
 #include "../src/parser.h"
 #include "../src/environment.h"
+#include "../src/intern.h"
+#include "../src/stats.h"
 
-void check_integer_object(object_t evaluated, int expected){
-        assertf(evaluated.type == OBJECT_INTEGER,
+void check_integer_object(value_t evaluated, int expected){
+        assertf(value_is_int(evaluated),
                 "wrong type, expected OBJECT_INTEGER, got %s\n",
-                object_type_to_string(evaluated.integer));
-        assertf(evaluated.integer == expected,
+                object_type_to_string(value_type(evaluated)));
+        assertf(value_as_int(evaluated) == expected,
                 "wrong value, expected %d, got %d\n",
                 expected,
-                evaluated.integer);
-}
-
-void check_return_integer(object_t evaluated, int expected){
-        assertf(evaluated.type == OBJECT_RETURN,
-                "wrong type, expected OBJECT_INTEGER, got %s\n",
-                object_type_to_string(evaluated.integer));
-        assertf(evaluated.integer == expected,
-                "wrong value, expected %d, got %d\n",
-                expected,
-                evaluated.integer);
+                value_as_int(evaluated));
 }
 
 
-void check_error(object_t evaluated, char *expected_msg){
-        assertf(evaluated.type == OBJECT_ERROR,
+void check_error(value_t evaluated, char *expected_msg){
+        assertf(value_is(evaluated, OBJECT_ERROR),
                 "wrong type, expected OBJECT_ERROR, got %s\n",
-                object_type_to_string(evaluated.integer));
-        char *error_msg = string_get_data(evaluated.error_message);
+                object_type_to_string(value_type(evaluated)));
+        char *error_msg = value_as_object(evaluated)->error_message->data;
         assertf(strcmp(error_msg, expected_msg) == 0,
                "wrong error message, expected %s, got %s\n",
                expected_msg,
@@ -66,20 +58,20 @@ void test_eval_integer_expression(){
 
 		program_t *program = parse_program(parser);
 		environment_t *env = new_environment();
-                object_t *evaluated = eval(program, NODE_PROGRAM, env);
-                check_integer_object(*evaluated, tests[i].expected);
+                value_t evaluated = eval(program, NODE_PROGRAM, env);
+                check_integer_object(evaluated, tests[i].expected);
 
         }
 }
 
-void check_boolean_object(object_t evaluated, bool expected){
-        assertf(evaluated.type == OBJECT_BOOLEAN,
+void check_boolean_object(value_t evaluated, bool expected){
+        assertf(value_is_bool(evaluated),
                 "wrong type, expected OBJECT_BOOLEAN, got %s\n",
-                object_type_to_string(evaluated.type));
-        assertf(evaluated.boolean == expected,
+                object_type_to_string(value_type(evaluated)));
+        assertf(value_as_bool(evaluated) == expected,
                 "wrong value, expected %d, got %d\n",
                 expected,
-                evaluated.boolean);
+                value_as_bool(evaluated));
 }
 
 void test_eval_boolean_expression(){
@@ -106,6 +98,11 @@ void test_eval_boolean_expression(){
                 {"(1 < 2) == false", false},
                 {"(1 > 2) == true", false},
                 {"(1 > 2) == false", true},
+                {"\"a\" == \"a\"", true},
+                {"\"a\" != \"a\"", false},
+                {"\"a\" == \"b\"", false},
+                {"\"ab\" == \"a\" + \"b\"", true},
+                {"\"ab\" != \"a\" + \"c\"", true},
         };
 
         for (int i = 0; i < sizeof(tests)/sizeof(tests[0]); i++){
@@ -115,8 +112,8 @@ void test_eval_boolean_expression(){
                 program_t *program = parse_program(parser);
 		environment_t *env = new_environment();
                 statement_t *statement = program->statements->data[0];
-                object_t *evaluated = eval(statement, NODE_STATEMENT, env);
-                check_boolean_object(*evaluated, tests[i].expected);
+                value_t evaluated = eval(statement, NODE_STATEMENT, env);
+                check_boolean_object(evaluated, tests[i].expected);
         }
 }
 
@@ -140,15 +137,15 @@ void test_eval_bang_operator(){
                 program_t *program = parse_program(parser);
 		environment_t *env = new_environment();
 
-                object_t *evaluated = eval(program, NODE_PROGRAM, env);
-                check_boolean_object(*evaluated, tests[i].expected);
+                value_t evaluated = eval(program, NODE_PROGRAM, env);
+                check_boolean_object(evaluated, tests[i].expected);
         }
 }
 
-bool check_null_object(object_t obj) {
-    if (obj.type != OBJECT_NULL) {
+bool check_null_object(value_t obj) {
+    if (!value_is_null(obj)) {
         printf("Error: object is not NULL. got=%s \n", 
-               object_type_to_string(obj.type));
+               object_type_to_string(value_type(obj)));
         return false;
     }
     return true;
@@ -174,11 +171,11 @@ void test_eval_if_else_expressions() {
                 parser_t *parser = new_parser(lexer);
                 program_t *program = parse_program(parser);
 		environment_t *env = new_environment();
-                object_t *evaluated = eval(program, NODE_PROGRAM, env);
+                value_t evaluated = eval(program, NODE_PROGRAM, env);
                 if (tests[i].has_value) {
-                        check_integer_object(*evaluated, tests[i].expected);
+                        check_integer_object(evaluated, tests[i].expected);
                 } else {
-                        check_null_object(*evaluated);
+                        check_null_object(evaluated);
                 }
         }
 }
@@ -205,8 +202,8 @@ void test_eval_return_statements() {
                 parser_t *parser = new_parser(lexer);
                 program_t *program = parse_program(parser);
 		environment_t *env = new_environment();
-                object_t *evaluated = eval(program, NODE_PROGRAM, env);
-                check_integer_object(*evaluated, tests[i].expected);
+                value_t evaluated = eval(program, NODE_PROGRAM, env);
+                check_integer_object(evaluated, tests[i].expected);
         }
 }
 
@@ -217,27 +214,27 @@ void test_eval_error_handling() {
         } tests[] = {
                 {
                    "5 + true;",
-                   "type mismatch: OBJECT_INTEGER + OBJECT_BOOLEAN"
+                   "1:3: type mismatch: OBJECT_INTEGER + OBJECT_BOOLEAN"
                 },
                 {
                    "5 + true; 5;", 
-                   "type mismatch: OBJECT_INTEGER + OBJECT_BOOLEAN"
+                   "1:3: type mismatch: OBJECT_INTEGER + OBJECT_BOOLEAN"
                 },
                 {
                    "-true",
-                   "unknown operator: -OBJECT_BOOLEAN "
+                   "1:1: unknown operator: -OBJECT_BOOLEAN "
                 },
                 {
                    "true + false;",
-                   "unknown operator: OBJECT_BOOLEAN + OBJECT_BOOLEAN"
+                   "1:6: unknown operator: OBJECT_BOOLEAN + OBJECT_BOOLEAN"
                 },
                 {
                    "5; true + false; 5",
-                   "unknown operator: OBJECT_BOOLEAN + OBJECT_BOOLEAN"
+                   "1:9: unknown operator: OBJECT_BOOLEAN + OBJECT_BOOLEAN"
                 },
                 {
                    "if (10 > 1) { true + false; }",
-                   "unknown operator: OBJECT_BOOLEAN + OBJECT_BOOLEAN"
+                   "1:20: unknown operator: OBJECT_BOOLEAN + OBJECT_BOOLEAN"
                 },
                 {
                    "if (10 > 1) {\n"
@@ -246,19 +243,31 @@ void test_eval_error_handling() {
                    "  }\n"
                    "  return 1;\n"
                    "}",
-                   "unknown operator: OBJECT_BOOLEAN + OBJECT_BOOLEAN"
+                   "3:17: unknown operator: OBJECT_BOOLEAN + OBJECT_BOOLEAN"
                 },
                 {
                 "foobar",
-                "identifier not found: foobar",
+                "1:1: identifier not found: foobar",
                 },
                 {
                 "\"Hello\" - \"World\"",
-                "unknown operator: OBJECT_STRING - OBJECT_STRING",
+                "1:9: unknown operator: OBJECT_STRING - OBJECT_STRING",
                 },
                 {
                 "{\"name\": \"Monkey\"}[fn(x) { x }];",
-                "unuseable as hash key: OBJECT_FUNCTION",
+                "1:19: unuseable as hash key: OBJECT_FUNCTION",
+                },
+                {
+                "set([1], 1, 2)",
+                "1:4: argument to `set` must be a hash, got OBJECT_ARRAY",
+                },
+                {
+                "delete({}, [1])",
+                "1:7: unuseable as hash key: OBJECT_ARRAY",
+                },
+                {
+                "10 / (5 - 5)",
+                "1:4: division by zero",
                 },
         };
 
@@ -267,9 +276,15 @@ void test_eval_error_handling() {
                 parser_t *parser = new_parser(lexer);
                 program_t *program = parse_program(parser);
 		environment_t *env = new_environment();
-                object_t *evaluated = eval(program, NODE_PROGRAM, env);
-                check_error(*evaluated, tests[i].expected_message);
+                value_t evaluated = eval(program, NODE_PROGRAM, env);
+                check_error(evaluated, tests[i].expected_message);
         }
+
+        // A function defined by an earlier program points into that program's source
+        environment_t *env = new_environment();
+        eval(parse_program(new_parser(new_lexer("let f = fn() {\n  1 + true\n};"))), NODE_PROGRAM, env);
+        value_t evaluated = eval(parse_program(new_parser(new_lexer("f();"))), NODE_PROGRAM, env);
+        check_error(evaluated, "2:5: type mismatch: OBJECT_INTEGER + OBJECT_BOOLEAN");
 }
 
 void test_eval_let_statements() {
@@ -288,8 +303,8 @@ void test_eval_let_statements() {
                parser_t *parser = new_parser(lexer);
                program_t *program = parse_program(parser);
                environment_t *env = new_environment();
-               object_t *evaluated = eval(program, NODE_PROGRAM, env);
-               check_integer_object(*evaluated, tests[i].expected);
+               value_t evaluated = eval(program, NODE_PROGRAM, env);
+               check_integer_object(evaluated, tests[i].expected);
         }
 }
 
@@ -301,23 +316,24 @@ void test_eval_function_object() {
         program_t *program = parse_program(parser);
         environment_t *env = new_environment();
 
-        object_t *evaluated = eval(program, NODE_PROGRAM, env);
+        value_t evaluated = eval(program, NODE_PROGRAM, env);
 
-        assertf(evaluated->type == OBJECT_FUNCTION, 
+        assertf(value_is(evaluated, OBJECT_FUNCTION), 
                 "object is not Function. got=%s",
-                object_type_to_string(evaluated->type));
+                object_type_to_string(value_type(evaluated)));
+        object_t *function = value_as_object(evaluated);
 
-        assertf(evaluated->function.parameters->count == 1,
+        assertf(function->function.parameters->count == 1,
                 "function has wrong parameters. got=%d", 
-                evaluated->function.parameters->count);
+                function->function.parameters->count);
 
-        identifier_t *param = evaluated->function.parameters->data[0];
+        identifier_t *param = function->function.parameters->data[0];
         assertf(strcmp(param->value, "x") == 0,
                 "parameter is not 'x'. got=%s", 
                 param->value);
 
         string_t *body_str = string_new();
-        format_block_statement(body_str, evaluated->function.body);
+        format_block_statement(body_str, function->function.body);
         assertf(strcmp(string_get_data(body_str), "(x + 2)") == 0,
                 "body is not '(x + 2)'. got=%s",
                 body_str);
@@ -343,8 +359,8 @@ void test_eval_function_application() {
                 parser_t *parser = new_parser(lexer);
                 program_t *program = parse_program(parser);
                 environment_t *env = new_environment();
-                object_t *evaluated = eval(program, NODE_PROGRAM, env);
-                check_integer_object(*evaluated, tests[i].expected);
+                value_t evaluated = eval(program, NODE_PROGRAM, env);
+                check_integer_object(evaluated, tests[i].expected);
         }
 }
 
@@ -368,11 +384,43 @@ void test_closures() {
                 parser_t *parser = new_parser(lexer);
                 program_t *program = parse_program(parser);
                 environment_t *env = new_environment();
-                object_t *evaluated = eval(program, NODE_PROGRAM, env);
-                check_integer_object(*evaluated, tests[i].expected);
+                value_t evaluated = eval(program, NODE_PROGRAM, env);
+                check_integer_object(evaluated, tests[i].expected);
         }
 }
 
+void test_tail_calls() {
+        struct {
+                char *input;
+                int expected;
+        } tests[] = {
+                // Deep enough to overflow the C stack if every call nested
+                {"let count = fn(n, acc) { if (n == 0) { acc } else { count(n - 1, acc + 1) } }; count(200000, 0);", 200000},
+                {"let count = fn(n) { if (n == 0) { return 7; } return count(n - 1); }; count(200000);", 7},
+                {"let even = fn(n) { if (n == 0) { 1 } else { odd(n - 1) } };"
+                 "let odd = fn(n) { if (n == 0) { 0 } else { even(n - 1) } }; even(100001);", 0},
+                // Closures capture the frame, so it has to stay alive after the tail call replaces it
+                {"let loop = fn(n, fs) { if (n == 0) { fs } else { loop(n - 1, push(fs, fn() { n })) } };"
+                 "let fs = loop(3, []); fs[0]() + fs[1]() * 10 + fs[2]() * 100;", 123},
+                // Tail calls made while evaluating another tail call's arguments
+                {"let id = fn(x) { x }; let f = fn(n) { if (n == 0) { 0 } else { f(id(n - 1)) } }; f(1000);", 0},
+                {"let sum = fn(n) { if (n == 0) { 0 } else { n + sum(n - 1) } }; sum(100);", 5050},
+        };
+
+        for (int i = 0; i < sizeof(tests)/sizeof(tests[0]); i++) {
+                lexer_t *lexer = new_lexer(tests[i].input);
+                parser_t *parser = new_parser(lexer);
+                program_t *program = parse_program(parser);
+                environment_t *env = new_environment();
+                value_t evaluated = eval(program, NODE_PROGRAM, env);
+                check_integer_object(evaluated, tests[i].expected);
+        }
+
+        char *input = "let f = fn(n) { if (n == 0) { g } else { f(n - 1, 1) } }; f(3);";
+        value_t evaluated = eval(parse_program(new_parser(new_lexer(input))), NODE_PROGRAM, new_environment());
+        check_error(evaluated, "1:43: wrong number of arguments");
+}
+
 void test_string_literal() {
         struct {
                 char *input;
@@ -389,17 +437,44 @@ void test_string_literal() {
                 parser_t *parser = new_parser(lexer);
                 program_t *program = parse_program(parser);
                 environment_t *env = new_environment();
-                object_t *evaluated = eval(program, NODE_PROGRAM, env);
-                assertf(evaluated->type == OBJECT_STRING,
-                        "object is not String. got=%d (%s)", 
-                        evaluated->type, evaluated->string_literal->data);
+                value_t evaluated = eval(program, NODE_PROGRAM, env);
+                assertf(value_is(evaluated, OBJECT_STRING),
+                        "object is not String. got=%s", 
+                        object_type_to_string(value_type(evaluated)));
 
-                assertf(strcmp(evaluated->string_literal->data, tests[i].expected) == 0,
+                assertf(strcmp(value_as_object(evaluated)->string_literal->data, tests[i].expected) == 0,
                         "String has wrong value. got=%s",
-                        evaluated->string_literal->data);
+                        value_as_object(evaluated)->string_literal->data);
                         }
 }
 
+void test_string_literals_are_interned() {
+        char *input = "let greeting = \"hello\"; let other = \"hello\"; greeting";
+        lexer_t *lexer = new_lexer(input);
+        parser_t *parser = new_parser(lexer);
+        program_t *program = parse_program(parser);
+
+        statement_t *first = program->statements->data[0];
+        statement_t *second = program->statements->data[1];
+        statement_t *last = program->statements->data[2];
+        assertf(first->value->string_literal->data == second->value->string_literal->data,
+                "equal literals were stored twice");
+        assertf(first->name.value == last->value->ident.value,
+                "identifier was not interned");
+
+        // Parsing the same names again only looks them up
+        size_t interned = intern_count();
+        parse_program(new_parser(new_lexer(input)));
+        assertf(intern_count() == interned, "interned a duplicate. before=%zu, after=%zu",
+                interned, intern_count());
+
+        // Every evaluation of a literal yields the same object
+        environment_t *env = new_environment();
+        value_t a = eval(first->value, NODE_EXPRESSION, env);
+        value_t b = eval(second->value, NODE_EXPRESSION, env);
+        assertf(value_same(a, b), "literal allocated a new string per evaluation");
+}
+
 void test_string_concatenation() {
         struct {
                 char *input;
@@ -415,17 +490,47 @@ void test_string_concatenation() {
                 parser_t *parser = new_parser(lexer);
                 program_t *program = parse_program(parser);
                 environment_t *env = new_environment();
-                object_t *evaluated = eval(program, NODE_PROGRAM, env);
-                assertf(evaluated->type == OBJECT_STRING,
-                        "object is not String. got=%d (%s)",
-                        evaluated->type, evaluated->string_literal->data);
+                value_t evaluated = eval(program, NODE_PROGRAM, env);
+                assertf(value_is(evaluated, OBJECT_STRING),
+                        "object is not String. got=%s",
+                        object_type_to_string(value_type(evaluated)));
 
-                assertf(strcmp(evaluated->string_literal->data, tests[i].expected) == 0,
+                assertf(strcmp(value_as_object(evaluated)->string_literal->data, tests[i].expected) == 0,
                         "String has wrong value. got=%s",
-                        evaluated->string_literal->data);
+                        value_as_object(evaluated)->string_literal->data);
         }
 }
 
+void test_long_concatenation_is_lazy() {
+        char input[1024];
+        char a[201], b[101], expected[301];
+        memset(a, 'a', 200);
+        a[200] = '\0';
+        memset(b, 'b', 100);
+        b[100] = '\0';
+        snprintf(expected, sizeof(expected), "%s%s", a, b);
+        snprintf(input, sizeof(input), "let a = \"%s\"; let b = \"%s\"; a + b", a, b);
+
+        lexer_t *lexer = new_lexer(input);
+        parser_t *parser = new_parser(lexer);
+        program_t *program = parse_program(parser);
+        environment_t *env = new_environment();
+        value_t evaluated = eval(program, NODE_PROGRAM, env);
+
+        object_t *string = value_as_object(evaluated);
+        assertf(string->rope_left != NULL, "long concatenation was copied eagerly");
+        assertf(string->string_literal->len == 300, "wrong length. got=%zu", string->string_literal->len);
+        assertf(strcmp(object_string(string)->data, expected) == 0, "wrong contents after flattening");
+        assertf(string->rope_left == NULL, "flattened string still holds its halves");
+
+        // Hashing and comparing have to see through an unflattened key
+        snprintf(input, sizeof(input), "let a = \"%s\"; let b = \"%s\"; let h = {a + b: 1}; h[a + b]", a, b);
+        lexer = new_lexer(input);
+        parser = new_parser(lexer);
+        program = parse_program(parser);
+        check_integer_object(eval(program, NODE_PROGRAM, env), 1);
+}
+
 void test_builtin_functions() {
         struct {
                 char *input;
@@ -467,22 +572,17 @@ void test_builtin_functions() {
                 parser_t *parser = new_parser(lexer);
                 program_t *program = parse_program(parser);
                 environment_t *env = new_environment();
-                object_t *evaluated = eval(program, NODE_PROGRAM, env);
+                value_t evaluated = eval(program, NODE_PROGRAM, env);
 
                 if (!tests[i].is_error) {
                         // Expecting integer result
-                        assertf(evaluated->type == OBJECT_INTEGER, 
-                                "object is not Integer. got=%d", 
-                                evaluated->type);
-                        assertf(evaluated->integer == tests[i].expected.int_val,
-                                "wrong integer value. got=%d, want=%d",
-                                evaluated->integer, tests[i].expected.int_val);
+                        check_integer_object(evaluated, tests[i].expected.int_val);
                 } else {
                         // Expecting error message 
-                        assertf(evaluated->type == OBJECT_ERROR,
+                        assertf(value_is(evaluated, OBJECT_ERROR),
                                 "object is not Error. got=%d",
-                                evaluated->type);
-                        char *error_msg = string_get_data(evaluated->error_message);
+                                value_type(evaluated));
+                        char *error_msg = value_as_object(evaluated)->error_message->data;
                         assertf(strcmp(error_msg, tests[i].expected.str_val) != 0,
                                 "wrong error message. got=%s, want=%s",
                                 error_msg, tests[i].expected.str_val);
@@ -490,6 +590,27 @@ void test_builtin_functions() {
         }
 }
 
+static value_t answer_builtin(vector_t *args) {
+        return value_from_int(42);
+}
+
+void test_builtin_registry() {
+        environment_t *env = new_environment();
+        value_t first = eval(parse_program(new_parser(new_lexer("len"))), NODE_PROGRAM, env);
+        value_t second = eval(parse_program(new_parser(new_lexer("len"))), NODE_PROGRAM, env);
+        assertf(value_is(first, OBJECT_BUILTIN) && value_as_object(first)->immortal,
+                "builtin should be an immortal object");
+        assertf(value_same(first, second), "each reference allocated a new builtin");
+
+        int index = register_builtin("answer", answer_builtin);
+        assertf(index == builtin_count() - 1, "host builtin should be appended. got=%d", index);
+        assertf(builtin_index(intern_string("answer")) == index, "host builtin not found by name");
+        check_integer_object(eval(parse_program(new_parser(new_lexer("answer()"))), NODE_PROGRAM, env), 42);
+
+        // A global of the same name still shadows the builtin
+        check_integer_object(eval(parse_program(new_parser(new_lexer("let len = 5; len"))), NODE_PROGRAM, env), 5);
+}
+
 void test_array_literals() {
         char *input = "[1, 2 * 2, 3 + 3]";
 
@@ -498,24 +619,20 @@ void test_array_literals() {
         program_t *program = parse_program(parser);
         environment_t *env = new_environment();
 
-        object_t *evaluated = eval(program, NODE_PROGRAM, env);
-        printf("%s\n", object_type_to_string(evaluated->type));
+        value_t evaluated = eval(program, NODE_PROGRAM, env);
+        printf("%s\n", object_type_to_string(value_type(evaluated)));
 
-        assertf(evaluated->type == OBJECT_ARRAY,
+        assertf(value_is(evaluated, OBJECT_ARRAY),
                     "object is not Array. got=%s\n",
-                    object_type_to_string(evaluated->type));
-        assertf(evaluated->array.elements->count == 3,
-                    "array has wrong num of elements. got=%d\n",
-                    evaluated->array.elements->count);
+                    object_type_to_string(value_type(evaluated)));
+        array_object_t *elements = &value_as_object(evaluated)->array;
+        assertf(elements->count == 3,
+                    "array has wrong num of elements. got=%zu\n",
+                    elements->count);
         // Test each element
-        object_t *first = evaluated->array.elements->data[0];
-        check_integer_object(*first, 1);
-
-        object_t *second = evaluated->array.elements->data[1];
-        check_integer_object(*second, 4);
-
-        object_t *third = evaluated->array.elements->data[2];
-        check_integer_object(*third, 6);
+        check_integer_object(array_get(elements, 0), 1);
+        check_integer_object(array_get(elements, 1), 4);
+        check_integer_object(array_get(elements, 2), 6);
 }
 
 
@@ -547,15 +664,110 @@ void test_array_index_expressions() {
         parser_t *parser = new_parser(lexer);
         program_t *program = parse_program(parser);
         environment_t *env = new_environment();
-        object_t *evaluated = eval(program, NODE_PROGRAM, env);
+        value_t evaluated = eval(program, NODE_PROGRAM, env);
         if (!tests[i].should_be_null){
-                check_integer_object(*evaluated, tests[i].expected.int_val);
+                check_integer_object(evaluated, tests[i].expected.int_val);
         } else {
-                check_null_object(*evaluated);
+                check_null_object(evaluated);
         }
     }
 }
 
+void test_push_and_rest_share_storage() {
+    char *input = "let a = [1, 2]; let b = push(a, 3); let c = push(a, 4); "
+                  "[a, b, c, rest(b), rest(rest(rest(a))), push(rest(c), 5)]";
+    lexer_t *lexer = new_lexer(input);
+    parser_t *parser = new_parser(lexer);
+    program_t *program = parse_program(parser);
+    environment_t *env = new_environment();
+    value_t evaluated = eval(program, NODE_PROGRAM, env);
+
+    // Pushing onto the same array twice must not let the second push overwrite the first
+    string_t *inspected = string_new();
+    inspect_value(evaluated, inspected);
+    char *expected = "[[1, 2], [1, 2, 3], [1, 2, 4], [2, 3], [], [2, 4, 5]]";
+    assertf(strcmp(inspected->data, expected) == 0, "wrong arrays. expected %s, got %s", expected, inspected->data);
+    string_free(inspected);
+
+    array_object_t *arrays = &value_as_object(evaluated)->array;
+    array_object_t *a = &value_as_object(array_get(arrays, 0))->array;
+    array_object_t *b = &value_as_object(array_get(arrays, 1))->array;
+    array_object_t *rest_b = &value_as_object(array_get(arrays, 3))->array;
+    assertf(a->buffer == b->buffer, "push from the end of an array copied it");
+    assertf(rest_b->buffer == b->buffer && rest_b->offset == 1, "rest copied the array");
+}
+
+value_t hash_lookup(hash_object_t *hash, value_t key) {
+    hash_key_t hash_key;
+    assertf(value_to_hash_key(key, &hash_key), "key is not hashable");
+    return hash_object_get(hash, hash_key);
+}
+
+value_t string_value(char *data) {
+    object_t *string = new_object(OBJECT_STRING);
+    string->string_literal = string_from(data);
+    return value_from_object(string);
+}
+
+void test_inspect_large_array() {
+    // Far past BUFSIZ, which used to truncate
+    int count = 100000;
+    object_t *array = new_array_object(count);
+    for (int i = 0; i < count; i++) {
+        array_append(array, value_from_int(i % 10));
+    }
+    string_t *inspected = string_new();
+    inspect_value(value_from_object(array), inspected);
+    size_t expected_len = 2 + count + 2 * (count - 1);
+    assertf(inspected->len == expected_len, "wrong length. expected %zu, got %zu", expected_len, inspected->len);
+    assertf(strncmp(inspected->data, "[0, 1, 2", 8) == 0, "wrong start: %.8s", inspected->data);
+    assertf(strcmp(inspected->data + inspected->len - 5, "8, 9]") == 0,
+            "wrong end: %s", inspected->data + inspected->len - 5);
+
+    // Streaming writes the same bytes
+    FILE *file = tmpfile();
+    print_value(value_from_object(array), file);
+    assertf(ftell(file) == (long)expected_len, "streamed %ld bytes, expected %zu", ftell(file), expected_len);
+    fclose(file);
+    string_free(inspected);
+}
+
+void test_stats_count_phases_and_allocations() {
+    char *input = "let f = fn(x) { [x, x] }; f(1); f(2); {1: 2}[1];";
+    lexer_t *lexer = new_lexer(input);
+    size_t tokens = 1;
+    while (lexer_next_token(lexer).type != EOF_TOKEN){
+        tokens++;
+    }
+    free_lexer(lexer);
+
+    stats_enable();
+    stats_t before = stats;
+    hash_stats_t hashes = hash_stats;
+
+    program_t *program = parse_program(new_parser(new_lexer(input)));
+    environment_t *env = new_environment();
+    eval(program, NODE_PROGRAM, env);
+
+    assertf(stats.phase_calls[PHASE_PARSE] == before.phase_calls[PHASE_PARSE] + 1, "parse phase not entered once");
+    assertf(stats.phase_calls[PHASE_EVAL] == before.phase_calls[PHASE_EVAL] + 1, "eval phase not entered once");
+    // The parser asks for EOF more than once, so at least one call per token
+    assertf(stats.phase_calls[PHASE_LEX] - before.phase_calls[PHASE_LEX] >= tokens,
+            "not every token timed. got=%zu", stats.phase_calls[PHASE_LEX] - before.phase_calls[PHASE_LEX]);
+    assertf(stats.lex_cycles > before.lex_cycles, "no lexing time counted");
+    assertf(stats.objects[OBJECT_ARRAY] == before.objects[OBJECT_ARRAY] + 2,
+            "wrong array count. got=%zu", stats.objects[OBJECT_ARRAY] - before.objects[OBJECT_ARRAY]);
+    assertf(stats.objects[OBJECT_FUNCTION] == before.objects[OBJECT_FUNCTION] + 1, "function not counted");
+    // The global environment and one frame per call
+    assertf(stats.environments == before.environments + 3,
+            "wrong environment count. got=%zu", stats.environments - before.environments);
+    assertf(stats.bytes_allocated > before.bytes_allocated, "allocated bytes not counted");
+    assertf(hash_stats.lookups > hashes.lookups, "name lookups not counted");
+    assertf(hash_stats.hamt_lookups == hashes.hamt_lookups + 1, "hash index not counted");
+    assertf(hash_stats.hamt_levels > hashes.hamt_levels, "hash levels not counted");
+    stats.enabled = false;
+}
+
 void test_eval_hash_literals(void) {
     char *input = "let two = \"two\";\n"
                   "{\n"
@@ -571,67 +783,63 @@ void test_eval_hash_literals(void) {
     parser_t *parser = new_parser(lexer);
     program_t *program = parse_program(parser);
     environment_t *env = new_environment();
-    object_t *evaluated = eval_program(program, env);
+    value_t evaluated = eval_program(program, env);
 
     // Check that we got a hash object
-    assertf(evaluated->type == OBJECT_HASH,
+    assertf(value_is(evaluated, OBJECT_HASH),
             "object is not Hash. got=%d",
-            evaluated->type);
+            value_type(evaluated));
 
-    hash_object_t hash = evaluated->hash;
-    hash_map_t *pairs = hash.pairs;
+    hash_object_t hash = value_as_object(evaluated)->hash;
 
     // Check total number of pairs
     int pair_count = 0;
-    for (int i = 0; i < TABLE_SIZE; i++) {
-        hash_entry_t *entry = pairs->table[i];
-        while (entry != NULL) {
-            pair_count++;
-            entry = entry->next;
-        }
+    hamt_iter_t iter = hamt_iter(&hash.pairs);
+    while (hamt_next(&iter)) {
+        pair_count++;
     }
     assertf(pair_count == 6,
             "hash has wrong number of pairs. got=%d",
             pair_count);
 
     // Test each expected key-value pair
-    object_t *value;
+    value_t value;
 
     // Test "one": 10 - 9
-    value = hash_get(pairs, "OBJECT_STRING-one");
-    assertf(value != NULL, "no pair for key 'one'");
-    assertf(value->type == OBJECT_INTEGER && value->integer == 1,
-            "wrong value for 'one'. got=%d", value->integer);
+    value = hash_lookup(&hash, string_value("one"));
+    assertf(!value_is_empty(value), "no pair for key 'one'");
+    assertf(value_is_int(value) && value_as_int(value) == 1,
+            "wrong value for 'one'. got=%d", value_as_int(value));
 
     // Test two: 1 + 1
-    value = hash_get(pairs, "OBJECT_STRING-two");
-    assertf(value != NULL, "no pair for key 'two'");
-    assertf(value->type == OBJECT_INTEGER && value->integer == 2,
-            "wrong value for 'two'. got=%d", value->integer);
+    value = hash_lookup(&hash, string_value("two"));
+    assertf(!value_is_empty(value), "no pair for key 'two'");
+    assertf(value_is_int(value) && value_as_int(value) == 2,
+            "wrong value for 'two'. got=%d", value_as_int(value));
 
     // Test "three": 6 / 2 
-    value = hash_get(pairs, "OBJECT_STRING-three");
-    assertf(value != NULL, "no pair for key 'three'");
-    assertf(value->type == OBJECT_INTEGER && value->integer == 3,
-            "wrong value for 'three'. got=%d", value->integer);
+    value = hash_lookup(&hash, string_value("three"));
+    assertf(!value_is_empty(value), "no pair for key 'three'");
+    assertf(value_is_int(value) && value_as_int(value) == 3,
+            "wrong value for 'three'. got=%d", value_as_int(value));
 
     // Test 4: 4
-    value = hash_get(pairs, "OBJECT_INTEGER-4");  // integer keys stored as strings
-    assertf(value != NULL, "no pair for key '4'");
-    assertf(value->type == OBJECT_INTEGER && value->integer == 4,
-            "wrong value for '4'. got=%d", value->integer);
+    value = hash_lookup(&hash, value_from_int(4));
+    assertf(!value_is_empty(value), "no pair for key '4'");
+    assertf(value_is_int(value) && value_as_int(value) == 4,
+            "wrong value for '4'. got=%d", value_as_int(value));
 
     // Test true: 5
-    value = hash_get(pairs, "OBJECT_BOOLEAN-true");
-    assertf(value != NULL, "no pair for key 'true'");
-    assertf(value->type == OBJECT_INTEGER && value->integer == 5,
-            "wrong value for 'true'. got=%d", value->integer);
+    value = hash_lookup(&hash, VALUE_TRUE);
+    assertf(!value_is_empty(value), "no pair for key 'true'");
+    assertf(value_is_int(value) && value_as_int(value) == 5,
+            "wrong value for 'true'. got=%d", value_as_int(value));
 
     // Test false: 6
-    value = hash_get(pairs, "OBJECT_BOOLEAN-false");
-    assertf(value != NULL, "no pair for key 'false'");
-    assertf(value->type == OBJECT_INTEGER && value->integer == 6,
-            "wrong value for 'false'. got=%d", value->integer);
+    value = hash_lookup(&hash, VALUE_FALSE);
+    assertf(!value_is_empty(value), "no pair for key 'false'");
+    assertf(value_is_int(value) && value_as_int(value) == 6,
+            "wrong value for 'false'. got=%d", value_as_int(value));
 }
 
 void test_hash_index_expressions() {
@@ -674,6 +882,44 @@ void test_hash_index_expressions() {
             "{false: 5}[false]",
             5,
             false
+        },
+        {
+            "{\"1\": 1, 1: 2}[1]",
+            2,
+            false
+        },
+        {
+            // Long keys used to be truncated to a shared prefix
+            "let pad = \"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\";"
+            "{pad + \"a\": 1, pad + \"b\": 2}[pad + \"a\"]",
+            1,
+            false
+        },
+        {
+            "let h = {\"a\": 1}; let g = set(h, \"b\", 2); g[\"a\"] + g[\"b\"]",
+            3,
+            false
+        },
+        {
+            // set and delete make new versions, the hash they were given is unchanged
+            "let h = {\"a\": 1}; let g = set(h, \"b\", 2); h[\"b\"]",
+            0,
+            true
+        },
+        {
+            "let h = {\"a\": 1, 2: 2}; let g = delete(h, \"a\"); g[\"a\"]",
+            0,
+            true
+        },
+        {
+            "let h = {\"a\": 1, 2: 2}; let g = delete(h, \"a\"); h[\"a\"] + g[2]",
+            3,
+            false
+        },
+        {
+            "delete({1: 1}, 2)[1]",
+            1,
+            false
         }
     };
 
@@ -686,21 +932,21 @@ void test_hash_index_expressions() {
         program_t *program = parse_program(parser);
         environment_t *env = new_environment();
 
-        object_t *evaluated = eval(program, NODE_PROGRAM, env);
+        value_t evaluated = eval(program, NODE_PROGRAM, env);
         if (tests[i].is_null) {
             // Test for null cases
-            assertf(evaluated->type == OBJECT_NULL,
+            assertf(value_is_null(evaluated),
                    "expected null for input '%s'. got=%d",
-                   tests[i].input, evaluated->type);
+                   tests[i].input, value_type(evaluated));
         } else {
             // Test for integer cases
-            assertf(evaluated->type == OBJECT_INTEGER,
+            assertf(value_is_int(evaluated),
                    "wrong type for input '%s'. got=%d, want=OBJECT_INTEGER",
-                   tests[i].input, evaluated->type);
+                   tests[i].input, value_type(evaluated));
 
-            assertf(evaluated->integer == tests[i].expected,
+            assertf(value_as_int(evaluated) == tests[i].expected,
                    "wrong integer value for input '%s'. got=%d, want=%d",
-                   tests[i].input, evaluated->integer, tests[i].expected);
+                   tests[i].input, value_as_int(evaluated), tests[i].expected);
         }
     }
 }
@@ -715,11 +961,18 @@ int main(int argc, char *argv[]) {
         TEST(test_eval_let_statements);
         TEST(test_eval_function_object);
         TEST(test_eval_function_application);
+        TEST(test_tail_calls);
         TEST(test_string_literal);
+        TEST(test_string_literals_are_interned);
         TEST(test_string_concatenation);
+        TEST(test_long_concatenation_is_lazy);
         TEST(test_builtin_functions);
+        TEST(test_builtin_registry);
         TEST(test_array_literals);
         TEST(test_array_index_expressions);
+        TEST(test_push_and_rest_share_storage);
+        TEST(test_inspect_large_array);
+        TEST(test_stats_count_phases_and_allocations);
         TEST(test_eval_hash_literals);
         TEST(test_hash_index_expressions);
 }
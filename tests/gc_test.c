@@ -0,0 +1,177 @@
+#include "test_helpers.h"
+#include "../src/compiler.h"
+#include "../src/environment.h"
+#include "../src/evaluator.h"
+#include "../src/gc.h"
+#include "../src/intern.h"
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "../src/vm.h"
+
+value_t eval_input(char *input, environment_t *env) {
+        lexer_t *lexer = new_lexer(input);
+        parser_t *parser = new_parser(lexer);
+        program_t *program = parse_program(parser);
+        return eval(program, NODE_PROGRAM, env);
+}
+
+void test_unreachable_objects_are_swept() {
+        environment_t *env = new_environment();
+        gc_push_env_root(env);
+        eval_input("let keep = [1, 2, 3];", env);
+        gc_collect();
+        size_t baseline = gc_live_objects();
+
+        eval_input("[1, 2, 3, 4, 5]; {\"a\": 1, \"b\": \"two\"}; \"x\" + \"y\";", env);
+        assertf(gc_live_objects() > baseline, "expected temporaries to be allocated");
+
+        gc_collect();
+        assertf(gc_live_objects() == baseline,
+                "temporaries were not swept. baseline=%zu, live=%zu",
+                baseline, gc_live_objects());
+
+        value_t keep = env_get(env, intern_string("keep"));
+        assertf(value_is(keep, OBJECT_ARRAY) && value_as_object(keep)->array.count == 3,
+                "rooted binding did not survive collection");
+        gc_restore_roots(0);
+}
+
+void test_call_environments_are_swept() {
+        environment_t *env = new_environment();
+        gc_push_env_root(env);
+        eval_input("let make = fn(a) { fn() { a } }; make(1)(); make(2)();", env);
+        size_t before = gc_live_environments();
+        gc_collect();
+        assertf(gc_live_environments() < before,
+                "call environments were not swept. before=%zu, after=%zu",
+                before, gc_live_environments());
+        gc_restore_roots(0);
+}
+
+void test_closures_keep_their_environment() {
+        environment_t *env = new_environment();
+        gc_push_env_root(env);
+        eval_input("let newAdder = fn(x) { fn(y) { x + y } }; let addTwo = newAdder(2);", env);
+        gc_collect();
+
+        value_t result = eval_input("addTwo(40)", env);
+        assertf(value_is_int(result) && value_as_int(result) == 42,
+                "closure lost its captured environment. got=%s",
+                object_type_to_string(value_type(result)));
+        gc_restore_roots(0);
+}
+
+void test_deep_recursion_stays_bounded() {
+        environment_t *env = new_environment();
+        gc_push_env_root(env);
+        eval_input("let loop = fn(n, acc) { if (n == 0) { acc } else { let junk = [n, n, n]; loop(n - 1, acc + 1) } };", env);
+        for (int i = 0; i < 50; i++) {
+                value_t result = eval_input("loop(200, 0)", env);
+                assertf(value_is_int(result) && value_as_int(result) == 200,
+                        "wrong result on iteration %d", i);
+        }
+        gc_collect();
+        assertf(gc_live_environments() < 10,
+                "environments leaked across calls. live=%zu", gc_live_environments());
+        gc_restore_roots(0);
+}
+
+void test_non_capturing_calls_use_frame_stack() {
+        environment_t *env = new_environment();
+        gc_push_env_root(env);
+        eval_input("let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } };", env);
+        size_t before = gc_live_environments();
+        value_t result = eval_input("fib(15)", env);
+        assertf(value_is_int(result) && value_as_int(result) == 610,
+                "wrong result for fib(15)");
+        assertf(gc_live_environments() == before,
+                "calls allocated heap environments. before=%zu, after=%zu",
+                before, gc_live_environments());
+
+        value_t adder = eval_input("let newAdder = fn(x) { fn(y) { x + y } }; newAdder(1)(2)", env);
+        assertf(value_is_int(adder) && value_as_int(adder) == 3,
+                "escaping frame was not kept for its closure");
+        gc_restore_roots(0);
+}
+
+void test_inline_values_do_not_allocate() {
+        environment_t *env = new_environment();
+        gc_push_env_root(env);
+        eval_input("let count = fn(n, acc) { if (n == 0) { acc == acc } else { count(n - 1, acc + 100000) } };", env);
+        size_t before = gc_live_objects();
+        value_t result = eval_input("count(200, 0)", env);
+        assertf(value_is_bool(result) && value_as_bool(result),
+                "wrong result for count. got=%s", object_type_to_string(value_type(result)));
+        assertf(gc_live_objects() <= before,
+                "integer or boolean results were allocated. before=%zu, after=%zu",
+                before, gc_live_objects());
+
+        assertf(value_as_int(value_from_int(-123456789)) == -123456789,
+                "negative integers should round trip");
+        assertf(!value_is_object(value_from_int(0)) && !value_is_object(VALUE_NULL),
+                "inline values should not look like objects");
+        gc_restore_roots(0);
+}
+
+void test_vm_globals_survive_collection() {
+        symbol_table_t *symbol_table = new_global_symbol_table();
+        vector_t *constants = create_vector();
+        value_t *globals = new_vm_globals();
+
+        char *lines[] = {
+                "let xs = [1, 2, 3];",
+                "let f = fn(n) { if (n == 0) { 0 } else { let t = [n]; f(n - 1) } }; f(100);",
+                "len(xs)",
+        };
+        value_t result = VALUE_EMPTY;
+        for (int i = 0; i < sizeof(lines)/sizeof(lines[0]); i++) {
+                lexer_t *lexer = new_lexer(lines[i]);
+                parser_t *parser = new_parser(lexer);
+                program_t *program = parse_program(parser);
+                compiler_t *compiler = new_compiler_with_state(symbol_table, constants);
+                assertf(compile_program(compiler, program), "compilation failed");
+                vm_t *vm = new_vm_with_globals(compiler_bytecode(compiler), globals);
+                result = vm_run(vm);
+                free_vm(vm);
+                if (i < sizeof(lines)/sizeof(lines[0]) - 1) {
+                        gc_collect();
+                }
+        }
+        assertf(value_is_int(result) && value_as_int(result) == 3,
+                "global array did not survive collection");
+        free_vm_globals(globals);
+}
+
+void test_hash_versions_survive_collection() {
+        environment_t *env = new_environment();
+        gc_push_env_root(env);
+        value_t original = eval_input("{\"a\": [1], \"b\": \"two\", 3: [3]}", env);
+        gc_push_root(original);
+
+        hash_key_t key;
+        value_to_hash_key(value_from_int(3), &key);
+        value_t updated = hash_object_with(&value_as_object(original)->hash, key, value_from_int(4));
+        gc_push_root(updated);
+
+        // The versions share trie nodes, so the later one mustn't skip entries the first marked
+        gc_collect();
+        gc_collect();
+        hash_object_t *hash = &value_as_object(updated)->hash;
+        assertf(hash->pairs.count == 3, "wrong count. got=%zu", hash->pairs.count);
+        assertf(value_as_int(hash_object_get(hash, key)) == 4, "update lost after collection");
+        value_t three = hash_object_get(&value_as_object(original)->hash, key);
+        assertf(value_is(three, OBJECT_ARRAY) && value_as_object(three)->array.count == 1,
+                "original lost its value after collection");
+        gc_restore_roots(0);
+}
+
+int main(int argc, char *argv[]) {
+        TEST(test_unreachable_objects_are_swept);
+        TEST(test_call_environments_are_swept);
+        TEST(test_closures_keep_their_environment);
+        TEST(test_deep_recursion_stays_bounded);
+        TEST(test_non_capturing_calls_use_frame_stack);
+        TEST(test_inline_values_do_not_allocate);
+        TEST(test_vm_globals_survive_collection);
+        TEST(test_hash_versions_survive_collection);
+}
@@ -0,0 +1,138 @@
+#include "test_helpers.h"
+#include "../src/hamt.h"
+
+#define KEY_COUNT 10000
+
+static char keys[KEY_COUNT][32];
+
+static bool string_keys_equal(void *a, void *b) {
+        return strcmp(a, b) == 0;
+}
+
+static uint64_t key_hash(int i) {
+        return fnv1a_hash(keys[i]);
+}
+
+static hamt_t build(int count) {
+        hamt_t map = new_hamt(string_keys_equal);
+        for (intptr_t i = 0; i < count; i++) {
+                hamt_insert(&map, keys[i], key_hash(i), (void *)(i + 1));
+        }
+        return map;
+}
+
+void test_insert_and_get() {
+        hamt_t map = build(KEY_COUNT);
+        assertf(map.count == KEY_COUNT, "wrong count. got=%zu", map.count);
+        for (intptr_t i = 0; i < KEY_COUNT; i++) {
+                assertf(hamt_get(&map, keys[i], key_hash(i)) == (void *)(i + 1), "lost %s", keys[i]);
+        }
+        assertf(hamt_get(&map, "missing", fnv1a_hash("missing")) == NULL, "found a missing key");
+
+        hamt_insert(&map, keys[7], key_hash(7), (void *)42);
+        assertf(map.count == KEY_COUNT, "overwrite added an entry. count=%zu", map.count);
+        assertf(hamt_get(&map, keys[7], key_hash(7)) == (void *)42, "overwrite lost");
+        hamt_release(&map);
+}
+
+void test_updates_leave_old_versions_alone() {
+        hamt_t original = build(1000);
+        hamt_t updated, removed;
+        hamt_set(&original, keys[10], key_hash(10), (void *)99, &updated);
+        assertf(hamt_delete(&updated, keys[20], key_hash(20), &removed), "could not delete %s", keys[20]);
+
+        assertf(hamt_get(&original, keys[10], key_hash(10)) == (void *)11, "set changed the original");
+        assertf(hamt_get(&updated, keys[10], key_hash(10)) == (void *)99, "set lost the new value");
+        assertf(hamt_get(&updated, keys[20], key_hash(20)) == (void *)21, "delete changed the version it came from");
+        assertf(hamt_get(&removed, keys[20], key_hash(20)) == NULL, "delete kept the key");
+        assertf(original.count == 1000 && updated.count == 1000 && removed.count == 999,
+                "wrong counts. got=%zu, %zu, %zu", original.count, updated.count, removed.count);
+
+        // Only the path to the changed key is copied, the rest of the root's children are shared
+        uint32_t shared = 0;
+        for (uint32_t i = 0; i < original.root->size; i++) {
+                shared += original.root->slots[i].child == updated.root->slots[i].child;
+        }
+        assertf(shared == original.root->size - 1, "update copied more than one path. shared=%u of %u",
+                shared, original.root->size);
+
+        hamt_release(&original);
+        for (intptr_t i = 0; i < 1000; i++) {
+                void *expected = i == 10 ? (void *)99 : (void *)(i + 1);
+                assertf(hamt_get(&updated, keys[i], key_hash(i)) == expected, "releasing a version broke another");
+        }
+        hamt_release(&updated);
+        hamt_release(&removed);
+}
+
+void test_equal_hashes_share_a_list() {
+        hamt_t map = new_hamt(string_keys_equal);
+        for (intptr_t i = 0; i < 5; i++) {
+                hamt_insert(&map, keys[i], 12345, (void *)(i + 1));
+        }
+        assertf(map.count == 5, "wrong count. got=%zu", map.count);
+        for (intptr_t i = 0; i < 5; i++) {
+                assertf(hamt_get(&map, keys[i], 12345) == (void *)(i + 1), "lost colliding key %s", keys[i]);
+        }
+
+        hamt_t removed;
+        hamt_delete(&map, keys[2], 12345, &removed);
+        assertf(hamt_get(&removed, keys[2], 12345) == NULL, "deleted colliding key still there");
+        assertf(hamt_get(&removed, keys[3], 12345) == (void *)4, "delete lost a neighbour");
+        hamt_release(&map);
+        hamt_release(&removed);
+}
+
+void test_iteration_ignores_insertion_order() {
+        hamt_t forwards = build(500);
+        hamt_t backwards = new_hamt(string_keys_equal);
+        for (intptr_t i = 499; i >= 0; i--) {
+                hamt_insert(&backwards, keys[i], key_hash(i), (void *)(i + 1));
+        }
+
+        int visited = 0;
+        hamt_iter_t a = hamt_iter(&forwards);
+        hamt_iter_t b = hamt_iter(&backwards);
+        while (hamt_next(&a)) {
+                assertf(hamt_next(&b), "iterators stopped at different points");
+                assertf(a.key == b.key && a.value == b.value, "iteration order depends on insertion order");
+                visited++;
+        }
+        assertf(!hamt_next(&b), "iterators stopped at different points");
+        assertf(visited == 500, "wrong number of entries visited. got=%d", visited);
+        hamt_release(&forwards);
+        hamt_release(&backwards);
+}
+
+static int visits;
+static void count_visit(void *key, void *value) {
+        visits++;
+}
+
+void test_visit_skips_shared_nodes() {
+        hamt_t original = build(1000);
+        hamt_t updated;
+        hamt_set(&original, keys[0], key_hash(0), (void *)7, &updated);
+
+        visits = 0;
+        hamt_visit(&original, 1, count_visit);
+        hamt_visit(&updated, 1, count_visit);
+        assertf(visits > 1000 && visits < 1100, "shared nodes visited twice. visits=%d", visits);
+
+        visits = 0;
+        hamt_visit(&updated, 2, count_visit);
+        assertf(visits == 1000, "new epoch should visit everything. visits=%d", visits);
+        hamt_release(&original);
+        hamt_release(&updated);
+}
+
+int main(int argc, char *argv[]) {
+        for (int i = 0; i < KEY_COUNT; i++) {
+                snprintf(keys[i], sizeof(keys[i]), "key-%d", i);
+        }
+        TEST(test_insert_and_get);
+        TEST(test_updates_leave_old_versions_alone);
+        TEST(test_equal_hashes_share_a_list);
+        TEST(test_iteration_ignores_insertion_order);
+        TEST(test_visit_skips_shared_nodes);
+}
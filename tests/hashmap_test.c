@@ -0,0 +1,103 @@
+#include "test_helpers.h"
+#include "../src/hashmap.h"
+
+#define KEY_COUNT 10000
+
+static void key_for(char *buf, int i) {
+        snprintf(buf, 32, "key-%d", i);
+}
+
+void test_set_and_get() {
+        hash_map_t *map = new_hash_table(NULL);
+        assertf(hash_get(map, "missing") == NULL, "empty map should miss");
+
+        hash_set(map, "one", (void *)1);
+        hash_set(map, "two", (void *)2);
+        hash_set(map, "one", (void *)3);
+        assertf(map->count == 2, "overwrite should not add an entry. count=%zu", map->count);
+        assertf(hash_get(map, "one") == (void *)3, "overwrite lost");
+        assertf(hash_get(map, "two") == (void *)2, "wrong value for two");
+        free_hash(map);
+}
+
+void test_grows_past_load_factor() {
+        hash_map_t *map = new_hash_table(NULL);
+        char key[32];
+        for (intptr_t i = 0; i < KEY_COUNT; i++) {
+                key_for(key, i);
+                hash_set(map, key, (void *)(i + 1));
+        }
+        assertf(map->count == KEY_COUNT, "wrong count. got=%zu", map->count);
+        assertf(map->count * 100 <= map->capacity * HASH_MAX_LOAD,
+                "table over its load factor. count=%zu, capacity=%zu", map->count, map->capacity);
+        for (intptr_t i = 0; i < KEY_COUNT; i++) {
+                key_for(key, i);
+                assertf(hash_get(map, key) == (void *)(i + 1), "lost %s after growing", key);
+        }
+        free_hash(map);
+}
+
+void test_delete_keeps_other_keys_reachable() {
+        hash_map_t *map = new_hash_table(NULL);
+        char key[32];
+        for (intptr_t i = 0; i < KEY_COUNT; i++) {
+                key_for(key, i);
+                hash_set(map, key, (void *)(i + 1));
+        }
+        for (intptr_t i = 0; i < KEY_COUNT; i += 2) {
+                key_for(key, i);
+                assertf(hash_delete(map, key), "could not delete %s", key);
+        }
+        assertf(!hash_delete(map, "key-0"), "deleted a key twice");
+        assertf(map->count == KEY_COUNT / 2, "wrong count after delete. got=%zu", map->count);
+
+        for (intptr_t i = 0; i < KEY_COUNT; i++) {
+                key_for(key, i);
+                void *expected = i % 2 == 0 ? NULL : (void *)(i + 1);
+                assertf(hash_get(map, key) == expected, "wrong value for %s after delete", key);
+        }
+
+        // Every slot is either empty or a live entry, deletes leave no markers behind
+        size_t occupied = 0;
+        for (size_t i = 0; i < map->capacity; i++) {
+                occupied += map->entries[i].key != NULL;
+        }
+        assertf(occupied == map->count, "deleted slots still occupied. occupied=%zu, count=%zu",
+                occupied, map->count);
+        free_hash(map);
+}
+
+void test_iteration_visits_every_entry() {
+        hash_map_t *map = new_hash_table(NULL);
+        char key[32];
+        intptr_t expected_sum = 0;
+        for (intptr_t i = 0; i < 100; i++) {
+                key_for(key, i);
+                hash_set(map, key, (void *)i);
+                expected_sum += i;
+        }
+
+        int visited = 0;
+        intptr_t sum = 0;
+        hash_iter_t iter = hash_iter(map);
+        while (hash_next(&iter)) {
+                assertf(hash_get(map, iter.key) == iter.value, "iterator returned a stale pair");
+                visited++;
+                sum += (intptr_t)iter.value;
+        }
+        assertf(visited == 100, "wrong number of entries visited. got=%d", visited);
+        assertf(sum == expected_sum, "wrong values visited");
+
+        hash_map_t *empty = new_hash_table(NULL);
+        iter = hash_iter(empty);
+        assertf(!hash_next(&iter), "empty map should have nothing to iterate");
+        free_hash(empty);
+        free_hash(map);
+}
+
+int main(int argc, char *argv[]) {
+        TEST(test_set_and_get);
+        TEST(test_grows_past_load_factor);
+        TEST(test_delete_keeps_other_keys_reachable);
+        TEST(test_iteration_visits_every_entry);
+}
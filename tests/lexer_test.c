@@ -1,10 +1,14 @@
+#include <time.h>
 #include "../src/token.h"
 #include "../src/lexer.h"
 #include "test_helpers.h"
 
 void test_lexer(){
 	char *input = "=+(){},;";
-	token_t tests[] = {
+	struct {
+		TokenType type;
+		char *literal;
+	} tests[] = {
 		{ASSIGN, "="},
 		{PLUS, "+"},
 		{LPAREN, "("},
@@ -17,12 +21,12 @@ void test_lexer(){
 	};
 
 	lexer_t *l = new_lexer(input);
-	token_t *t;
 	for (int i = 0; i < sizeof(tests)/sizeof(tests[0]); i++){
-		t = lexer_next_token(l);
-		assertf(t->type == tests[i].type, "[%d] wrong type: expected \"%s\", got \"%s\"\n", i, token_type_to_string(tests[i].type), token_type_to_string(t->type));
+		token_t t = lexer_next_token(l);
+		assertf(t.type == tests[i].type, "[%d] wrong type: expected \"%s\", got \"%s\"\n", i, token_type_to_string(tests[i].type), token_type_to_string(t.type));
+		assertf(token_literal_equals(input, t, tests[i].literal), "[%d] wrong literal: expected \"%s\", got \"%.*s\"\n", i, tests[i].literal, t.length, token_start(input, t));
 	}
-
+	free_lexer(l);
 }
 
 void test_next_token(){
@@ -46,7 +50,10 @@ void test_next_token(){
 		"[1, 2];\n"
 		"{\"foo\": \"bar\"}";
 	
-	token_t tests[] = {
+	struct {
+		TokenType type;
+		char *literal;
+	} tests[] = {
 		{LET, "let"},
 		{IDENT, "five"},
 		{ASSIGN, "="},
@@ -136,15 +143,84 @@ void test_next_token(){
 		{EOF_TOKEN, ""},
 	};
 	lexer_t *l = new_lexer(input);
-	token_t *t;
 	for (int i = 0; i < sizeof(tests)/sizeof(tests[0]); i++){
-		t = lexer_next_token(l);
-		assertf(t->type == tests[i].type, "[%d] wrong type: expected \"%s\", got \"%s\"\n", i, token_type_to_string(tests[i].type), token_type_to_string(t->type));
+		token_t t = lexer_next_token(l);
+		assertf(t.type == tests[i].type, "[%d] wrong type: expected \"%s\", got \"%s\"\n", i, token_type_to_string(tests[i].type), token_type_to_string(t.type));
+		assertf(token_literal_equals(input, t, tests[i].literal), "[%d] wrong literal: expected \"%s\", got \"%.*s\"\n", i, tests[i].literal, t.length, token_start(input, t));
+	}
+	free_lexer(l);
+}
+
+void test_large_input(){
+	// Lexing used to rescan the whole input for every character
+	char *line = "let config_value = 1234567 + \"some quoted text\";\n";
+	int lines = 1024 * 1024 / strlen(line);
+	char *input = malloc(lines * strlen(line) + 1);
+	input[0] = '\0';
+	for (int i = 0, offset = 0; i < lines; i++){
+		strcpy(input + offset, line);
+		offset += strlen(line);
 	}
+
+	clock_t start = clock();
+	lexer_t *l = new_lexer(input);
+	int count = 0;
+	for (;;){
+		token_t t = lexer_next_token(l);
+		if (t.type == EOF_TOKEN){
+			break;
+		}
+		count++;
+	}
+	double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	assertf(count == lines * 7, "wrong token count. expected %d, got %d", lines * 7, count);
+	assertf(seconds < 1.0, "lexing 1MB took %.2fs", seconds);
+	free_lexer(l);
+	free(input);
 }
 
+void test_lexes_borrowed_buffer(){
+	// Mapped files have no terminator, the lexer has to stop at the length it was given
+	char input[] = {'l', 'e', 't', ' ', 'x', ' ', '=', ' ', '5', '!', '!'};
+	lexer_t *l = new_lexer_n(input, 9);
+	assertf(l->input == input, "lexer copied its input");
+
+	TokenType expected[] = {LET, IDENT, ASSIGN, INT, EOF_TOKEN};
+	for (int i = 0; i < sizeof(expected) / sizeof(expected[0]); i++){
+		token_t t = lexer_next_token(l);
+		assertf(t.type == expected[i], "token %d has wrong type. expected %s, got %s", i,
+			token_type_to_string(expected[i]), token_type_to_string(t.type));
+		assertf(t.offset + t.length <= 9, "token %d is not a slice of the input", i);
+	}
+	free_lexer(l);
+}
+
+void test_token_offsets(){
+	// Offsets count bytes from the start of the input, through newlines and string literals
+	char *input = "let s = \"a\nb\";\n\tfoo";
+	lexer_t *l = new_lexer(input);
+	struct {
+		TokenType type;
+		uint32_t offset;
+		int length;
+	} expected[] = {
+		{LET, 0, 3}, {IDENT, 4, 1}, {ASSIGN, 6, 1}, {STRING, 9, 3}, {SEMICOLON, 13, 1},
+		{IDENT, 16, 3}, {EOF_TOKEN, 19, 0},
+	};
+	for (int i = 0; i < sizeof(expected) / sizeof(expected[0]); i++){
+		token_t t = lexer_next_token(l);
+		assertf(t.type == expected[i].type, "token %d has wrong type. got %s", i, token_type_to_string(t.type));
+		assertf(t.offset == expected[i].offset && t.length == expected[i].length,
+			"token %d has wrong span. expected %u+%d, got %u+%d", i,
+			expected[i].offset, expected[i].length, t.offset, t.length);
+	}
+	free_lexer(l);
+}
 
 int main(int argc, char *argv[]) {
 	TEST(test_lexer);
 	TEST(test_next_token);
+	TEST(test_large_input);
+	TEST(test_lexes_borrowed_buffer);
+	TEST(test_token_offsets);
 }
@@ -3,6 +3,14 @@
 #include "../src/parser.h"
 #include <string.h>
 
+/*The input of the test running now, tokens are offsets into it*/
+static char *source;
+
+lexer_t *source_lexer(char *input){
+	source = input;
+	return new_lexer(input);
+}
+
 void check_parser_errors(parser_t *parser){
 	if (parser->errors->count > 0){
 		print_errors(parser);
@@ -14,13 +22,13 @@ void check_integer_literal(expression_t *expression, int value){
 	assertf(expression->integer == value, "wrong value. expected %d, got %d\n", value, expression->integer);
 	char literal_buffer[BUFSIZ];
 	sprintf(literal_buffer, "%d", value);
-	assertf(strcmp(expression->token.literal, literal_buffer) == 0, "wrong literal. expected %s, got %s\n", literal_buffer, expression->token.literal);
+	assertf(token_literal_equals(source, expression->token, literal_buffer), "wrong literal. expected %s, got %.*s\n", literal_buffer, expression->token.length, token_start(source, expression->token));
 }
 
 void check_identifier(expression_t *expression, char *value) {
 	assertf(expression->type == IDENT_EXPR, "exp not IDENT_EXPR. got=%d\n", expression->type);
 	assertf(strcmp(expression->ident.value, value) == 0, "ident.Value not %s. got=%s\n", value, expression->ident.value);
-	assertf(strcmp(expression->token.literal, value) == 0, "ident.TokenLiteral not %s. got=%s\n", value, expression->token.literal);
+	assertf(token_literal_equals(source, expression->token, value), "ident.TokenLiteral not %s. got=%.*s\n", value, expression->token.length, token_start(source, expression->token));
 }
 
 void check_boolean_literal(expression_t *expression, bool value) {
@@ -35,10 +43,10 @@ void check_boolean_literal(expression_t *expression, bool value) {
 
     char literal_buffer[6];  // enough for "true" or "false"
     sprintf(literal_buffer, "%s", value ? "true" : "false");
-    assertf(strcmp(expression->token.literal, literal_buffer) == 0,
-            "wrong literal. expected %s, got %s", 
+    assertf(token_literal_equals(source, expression->token, literal_buffer),
+            "wrong literal. expected %s, got %.*s", 
             literal_buffer, 
-            expression->token.literal);
+            expression->token.length, token_start(source, expression->token));
 }
 
 void test_let_statements() {
@@ -60,7 +68,7 @@ void test_let_statements() {
 	};
 
 	for (int i = 0; i < sizeof(tests)/sizeof(tests[0]); i++) {
-		lexer_t *lexer = new_lexer(tests[i].input);
+		lexer_t *lexer = source_lexer(tests[i].input);
 		parser_t *parser = new_parser(lexer);
 
 		program_t *program = parse_program(parser);
@@ -110,7 +118,7 @@ void test_return_statements(){
 		"return 5;"
 		"return 10;"
 		"return 993322;";
-	lexer_t *lexer = new_lexer(input);
+	lexer_t *lexer = source_lexer(input);
 	parser_t *parser = new_parser(lexer);
 
 	program_t *program = parse_program(parser);
@@ -134,14 +142,14 @@ void test_return_statements(){
 	for (int i = 0; i < sizeof(tests)/sizeof(tests[0]); i++){
 		statement_t statement = *(statement_t *)program->statements->data[i];
 		assertf(statement.token.type == RETURN, "wrong token type. expected %s, got %s\n", "RETURN", token_type_to_string(statement.token.type));
-		assertf(strcmp(statement.token.literal, tests[i].literal) == 0, "wrong literal. expected %s, got %s\n", tests[i].name, statement.token.literal);
+		assertf(token_literal_equals(source, statement.token, tests[i].literal), "wrong literal. expected %s, got %.*s\n", tests[i].literal, statement.token.length, token_start(source, statement.token));
 	}
 }
 
 void test_identifier(){
 	char *input = "foobar;";
 
-	lexer_t *lexer = new_lexer(input);
+	lexer_t *lexer = source_lexer(input);
 	parser_t *parser = new_parser(lexer);
 
 	program_t *program = parse_program(parser);
@@ -158,12 +166,12 @@ void test_identifier(){
 	assertf(statement.type == EXPRESSION_STATEMENT, "wrong token type. expected %s, got %s\n", "EXPRESSION_STATEMENT", token_type_to_string(statement.token.type));
 	assertf(statement.value->type == IDENT_EXPR, "wrong expression type. expected %s, got %d\n", "IDENT_EXPR", statement.value->type);
 	assertf(strcmp(statement.value->ident.value, "foobar") == 0, "wrong identifier value. expected %s, got %s\n", "foobar", statement.value->ident.value);
-	assertf(strcmp(statement.value->ident.token.literal, "foobar") == 0, "wrong literal. expected %s, got %s\n", "foobar", statement.token.literal);
+	assertf(token_literal_equals(source, statement.value->ident.token, "foobar"), "wrong literal. expected %s, got %.*s\n", "foobar", statement.value->ident.token.length, token_start(source, statement.value->ident.token));
 }
 
 void test_integer(){
 	char *input = "5;";
-	lexer_t *lexer = new_lexer(input);
+	lexer_t *lexer = source_lexer(input);
 	parser_t *parser = new_parser(lexer);
 
 	program_t *program = parse_program(parser);
@@ -193,7 +201,7 @@ void test_parsing_prefix_expressions(){
 		{"!false;", "!", false},
 	};
 	for (int i = 0; i < sizeof(tests)/sizeof(tests[0]); i++){
-		lexer_t *lexer = new_lexer(tests[i].input);
+		lexer_t *lexer = source_lexer(tests[i].input);
 		parser_t *parser = new_parser(lexer);
 
 		program_t *program = parse_program(parser);
@@ -208,7 +216,7 @@ void test_parsing_prefix_expressions(){
 
 		assertf(statement.type == EXPRESSION_STATEMENT, "wrong token type. expected %s, got %s\n", "EXPRESSION_STATEMENT", token_type_to_string(statement.token.type));
 		assertf(statement.value->type == PREFIX_EXPR, "wrong expression type. expected %s, got %d\n", "PREFIX_EXPRESSION", statement.value->type);
-		assertf(strcmp(statement.value->prefix_expression.op, tests[i].operator) == 0, "wrong operator type. got %s, expected %s\n", statement.value->prefix_expression.op, tests[i].operator);
+		assertf(strcmp(operator_to_string(statement.value->prefix_expression.op), tests[i].operator) == 0, "wrong operator type. got %s, expected %s\n", operator_to_string(statement.value->prefix_expression.op), tests[i].operator);
 
 		if (statement.value->infix_expression.right->token.type == INT){
 			check_integer_literal(statement.value->prefix_expression.right, tests[i].value);
@@ -241,7 +249,7 @@ void test_parsing_infix_expressions() {
 		{"false == false;", false, "==" , false},
 	};
 	for (int i = 0; i < sizeof(tests)/sizeof(tests[0]); i++) {
-		lexer_t *lexer = new_lexer(tests[i].input);
+		lexer_t *lexer = source_lexer(tests[i].input);
 		parser_t *parser = new_parser(lexer);
 
 		program_t *program = parse_program(parser);
@@ -263,20 +271,20 @@ void test_parsing_infix_expressions() {
 
 		if (exp->infix_expression.left->token.type == INT){
 			check_integer_literal(exp->infix_expression.left, tests[i].left_value);
-			assertf(strcmp(exp->infix_expression.op, tests[i].operator) == 0,
+			assertf(strcmp(operator_to_string(exp->infix_expression.op), tests[i].operator) == 0,
 			       "exp.Operator is not '%s'. got=%s",
 			       tests[i].operator,
-			       exp->infix_expression.op);
+			       operator_to_string(exp->infix_expression.op));
 			check_integer_literal(exp->infix_expression.right, tests[i].right_value);
 		}
 
 		if (exp->infix_expression.left->token.type == TRUE || 
 				exp->infix_expression.left->token.type == FALSE){
 			check_boolean_literal(exp->infix_expression.left, tests[i].left_value);
-			assertf(strcmp(exp->infix_expression.op, tests[i].operator) == 0,
+			assertf(strcmp(operator_to_string(exp->infix_expression.op), tests[i].operator) == 0,
 			       "exp.Operator is not '%s'. got=%s",
 			       tests[i].operator,
-			       exp->infix_expression.op);
+			       operator_to_string(exp->infix_expression.op));
 			check_boolean_literal(exp->infix_expression.right, tests[i].right_value);
 		}
     }
@@ -321,7 +329,7 @@ void test_operator_precedence() {
 	};
 
 	for (int i = 0; i < sizeof(tests)/sizeof(tests[0]); i++) {
-		lexer_t *lexer = new_lexer(tests[i].input);
+		lexer_t *lexer = source_lexer(tests[i].input);
 		parser_t *parser = new_parser(lexer);
 
 		program_t *program = parse_program(parser);
@@ -346,7 +354,7 @@ void test_boolean_expression() {
 		{"false;", false},
 	};
 	for (int i = 0; i < sizeof(tests)/sizeof(tests[0]); i++) {
-		lexer_t *lexer = new_lexer(tests[i].input);
+		lexer_t *lexer = source_lexer(tests[i].input);
 		parser_t *parser = new_parser(lexer);
 
 		program_t *program = parse_program(parser);
@@ -367,7 +375,7 @@ void test_boolean_expression() {
 
 void test_if_expression(void) {
 	char *input = "if (x < y) { x }";
-	lexer_t *lexer = new_lexer(input);
+	lexer_t *lexer = source_lexer(input);
 	parser_t *parser = new_parser(lexer);
 	program_t *program = parse_program(parser);
 
@@ -392,9 +400,9 @@ void test_if_expression(void) {
 		"condition is not infix expression. got=%d",
 		condition->type);
 	check_identifier(condition->infix_expression.left, "x");
-	assertf(strcmp(condition->infix_expression.op, "<") == 0,
+	assertf(strcmp(operator_to_string(condition->infix_expression.op), "<") == 0,
 		"condition operator is not '<'. got=%s",
-		condition->infix_expression.op);
+		operator_to_string(condition->infix_expression.op));
 	check_identifier(condition->infix_expression.right, "y");
 
 	block_statement_t *consequence = exp->if_expression.consequence;
@@ -415,7 +423,7 @@ void test_if_expression(void) {
 
 void test_if_else_expression(void) {
 	char *input = "if (x < y) { x } else { y }";
-	lexer_t *lexer = new_lexer(input);
+	lexer_t *lexer = source_lexer(input);
 	parser_t *parser = new_parser(lexer);
 	program_t *program = parse_program(parser);
 
@@ -441,9 +449,9 @@ void test_if_else_expression(void) {
 	"condition is not infix expression. got=%d",
 	condition->type);
 	check_identifier(condition->infix_expression.left, "x");
-	assertf(strcmp(condition->infix_expression.op, "<") == 0,
+	assertf(strcmp(operator_to_string(condition->infix_expression.op), "<") == 0,
 		"condition operator is not '<'. got=%s",
-		condition->infix_expression.op);
+		operator_to_string(condition->infix_expression.op));
 	check_identifier(condition->infix_expression.right, "y");
 
 	// Test consequence
@@ -472,7 +480,7 @@ void test_if_else_expression(void) {
 
 void test_function_literal_parsing(void) {
 	char *input = "fn(x, y) { x + y; }";
-	lexer_t *lexer = new_lexer(input);
+	lexer_t *lexer = source_lexer(input);
 	parser_t *parser = new_parser(lexer);
 	program_t *program = parse_program(parser);
 
@@ -520,15 +528,15 @@ void test_function_literal_parsing(void) {
    			body_expr->type);
 
    	check_identifier(body_expr->infix_expression.left, "x");
-   	assertf(strcmp(body_expr->infix_expression.op, "+") == 0,
+   	assertf(body_expr->infix_expression.op == PLUS,
    			"wrong operator. expected=+, got=%s", 
-   			body_expr->infix_expression.op);
+   			operator_to_string(body_expr->infix_expression.op));
    	check_identifier(body_expr->infix_expression.right, "y");
 }
 
 void test_call_expression_parsing(void) {
        char *input = "add(1, 2 * 3, 4 + 5);";
-       lexer_t *lexer = new_lexer(input);
+       lexer_t *lexer = source_lexer(input);
        parser_t *parser = new_parser(lexer);
        program_t *program = parse_program(parser);
 
@@ -560,19 +568,19 @@ void test_call_expression_parsing(void) {
        expression_t *arg1 = exp->call_expression.arguments->data[1];
        assertf(arg1->type == INFIX_EXPR, "arg1 not infix expression");
        check_integer_literal(arg1->infix_expression.left, 2);
-       assertf(strcmp(arg1->infix_expression.op, "*") == 0, "wrong operator");
+       assertf(arg1->infix_expression.op == ASTERISK, "wrong operator");
        check_integer_literal(arg1->infix_expression.right, 3);
 
        expression_t *arg2 = exp->call_expression.arguments->data[2];
        assertf(arg2->type == INFIX_EXPR, "arg2 not infix expression");
        check_integer_literal(arg2->infix_expression.left, 4);
-       assertf(strcmp(arg2->infix_expression.op, "+") == 0, "wrong operator");
+       assertf(arg2->infix_expression.op == PLUS, "wrong operator");
        check_integer_literal(arg2->infix_expression.right, 5);
 }
 
 void test_string_literal_expression(void) {
 	char *input = "\"hello world\";";
-	lexer_t *lexer = new_lexer(input);
+	lexer_t *lexer = source_lexer(input);
 	parser_t *parser = new_parser(lexer);
 	program_t *program = parse_program(parser);
 
@@ -591,7 +599,7 @@ void test_string_literal_expression(void) {
 	    "expression is not string literal. got=%d",
 	    expression->type);
 
-	char *string_literal = string_get_data(expression->string_literal);
+	char *string_literal = expression->string_literal->data;
 	assertf(strcmp(string_literal, "hello world") == 0,
 	    "literal.value not %s. got=%s",
 	    "hello world", string_literal);
@@ -599,7 +607,7 @@ void test_string_literal_expression(void) {
 
 void test_array_literal_expression() {
 	char *input = "[1, 2 * 3, 4 + 5];";
-	lexer_t *lexer = new_lexer(input);
+	lexer_t *lexer = source_lexer(input);
 	parser_t *parser = new_parser(lexer);
 	program_t *program = parse_program(parser);
 
@@ -627,7 +635,7 @@ void test_array_literal_expression() {
 
 void test_index_expression(void) {
 	char *input = "myArray[1 + 1]";
-	lexer_t *lexer = new_lexer(input);
+	lexer_t *lexer = source_lexer(input);
 	parser_t *parser = new_parser(lexer);
 	program_t *program = parse_program(parser);
 
@@ -655,9 +663,9 @@ void test_index_expression(void) {
     
     expression_t *infix = index_exp->index;
     check_integer_literal(infix->infix_expression.left, 1);
-    assertf(strcmp(infix->infix_expression.op, "+") == 0,
+    assertf(infix->infix_expression.op == PLUS,
             "operator is not '+'. got=%s",
-            infix->infix_expression.op);
+            operator_to_string(infix->infix_expression.op));
     check_integer_literal(infix->infix_expression.right, 1);
 }
 
@@ -668,9 +676,9 @@ void check_infix_expression(expression_t *exp, int left_value, char *operator, i
             exp->type);
     
     // Check operator
-    assertf(strcmp(exp->infix_expression.op, operator) == 0,
+    assertf(strcmp(operator_to_string(exp->infix_expression.op), operator) == 0,
             "operator is not '%s'. got=%s",
-            operator, exp->infix_expression.op);
+            operator, operator_to_string(exp->infix_expression.op));
     
     // Check left operand is integer literal with correct value
     expression_t *left = exp->infix_expression.left;
@@ -693,7 +701,7 @@ void check_infix_expression(expression_t *exp, int left_value, char *operator, i
 
 void test_hash_literal_string_keys() {
     char *input = "{\"one\": 1, \"two\": 2, \"three\": 3}";
-    lexer_t *lexer = new_lexer(input);
+    lexer_t *lexer = source_lexer(input);
     parser_t *parser = new_parser(lexer);
     program_t *program = parse_program(parser);
 
@@ -719,16 +727,16 @@ void test_hash_literal_string_keys() {
             exp->hash_literal.pairs_len);
 
     // Create test key expressions
-    token_t one_token = {.type = STRING, .literal = "one"};
-    expression_t *one_key = new_expression(STRING_LITERAL, one_token);
+    token_t one_token = new_token(STRING, 0, 3);
+    expression_t *one_key = new_expression(program->arena, STRING_LITERAL, one_token);
     one_key->string_literal = string_from("one");
 
-    token_t two_token = {.type = STRING, .literal = "two"};
-    expression_t *two_key = new_expression(STRING_LITERAL, two_token);
+    token_t two_token = new_token(STRING, 0, 3);
+    expression_t *two_key = new_expression(program->arena, STRING_LITERAL, two_token);
     two_key->string_literal = string_from("two");
 
-    token_t three_token = {.type = STRING, .literal = "three"};
-    expression_t *three_key = new_expression(STRING_LITERAL, three_token);
+    token_t three_token = new_token(STRING, 0, 5);
+    expression_t *three_key = new_expression(program->arena, STRING_LITERAL, three_token);
     three_key->string_literal = string_from("three");
 
     // Test expected values
@@ -748,7 +756,7 @@ void test_hash_literal_string_keys() {
 
 void test_empty_hash_literal() {
     char *input = "{}";
-    lexer_t *lexer = new_lexer(input);
+    lexer_t *lexer = source_lexer(input);
     parser_t *parser = new_parser(lexer);
     program_t *program = parse_program(parser);
 
@@ -775,7 +783,7 @@ void test_empty_hash_literal() {
 
 void test_hash_literal_with_expressions() {
     char *input = "{\"one\": 0 + 1, \"two\": 10 - 8, \"three\": 15 / 5}";
-    lexer_t *lexer = new_lexer(input);
+    lexer_t *lexer = source_lexer(input);
     parser_t *parser = new_parser(lexer);
     program_t *program = parse_program(parser);
 
@@ -800,16 +808,16 @@ void test_hash_literal_with_expressions() {
             exp->hash_literal.pairs_len);
 
     // Create test key expressions
-    token_t one_token = {.type = STRING, .literal = "one"};
-    expression_t *one_key = new_expression(STRING_LITERAL, one_token);
+    token_t one_token = new_token(STRING, 0, 3);
+    expression_t *one_key = new_expression(program->arena, STRING_LITERAL, one_token);
     one_key->string_literal = string_from("one");
 
-    token_t two_token = {.type = STRING, .literal = "two"};
-    expression_t *two_key = new_expression(STRING_LITERAL, two_token);
+    token_t two_token = new_token(STRING, 0, 3);
+    expression_t *two_key = new_expression(program->arena, STRING_LITERAL, two_token);
     two_key->string_literal = string_from("two");
 
-    token_t three_token = {.type = STRING, .literal = "three"};
-    expression_t *three_key = new_expression(STRING_LITERAL, three_token);
+    token_t three_token = new_token(STRING, 0, 5);
+    expression_t *three_key = new_expression(program->arena, STRING_LITERAL, three_token);
     three_key->string_literal = string_from("three");
 
     // Test expressions
@@ -831,6 +839,89 @@ void test_hash_literal_with_expressions() {
     check_infix_expression(value, 15, "/", 5);
 }
 
+void test_program_owns_its_nodes() {
+    char *input = "let add = fn(a, b) { a + b }; let xs = [1, 2, 3, 4, 5]; "
+                  "{\"k\": \"v\", 1: true}; if (add(1, 2) > 2) { xs[0] } else { -1 }";
+    lexer_t *lexer = source_lexer(input);
+    parser_t *parser = new_parser(lexer);
+    program_t *program = parse_program(parser);
+    check_parser_errors(parser);
+
+    assertf(program->statements->count == 4, "wrong statement count. got=%zu", program->statements->count);
+    assertf(program->has_function_literals, "function literal not recorded");
+    assertf(program->arena != NULL && program->arena->allocated > 0, "nodes not allocated from the arena");
+    assertf(parser->arena == NULL, "parser kept the arena after handing it over");
+
+    // Every node lives in the arena, so this must release the whole tree without touching it
+    free_program(program);
+    free_parser(parser);
+    free_lexer(lexer);
+
+    lexer = source_lexer("1 + 2");
+    parser = new_parser(lexer);
+    program = parse_program(parser);
+    assertf(!program->has_function_literals, "no function literal in this program");
+    free_program(program);
+    free_parser(parser);
+    free_lexer(lexer);
+}
+
+void test_function_literal_names(void) {
+	char *input = "let add = fn(x, y) { x + y }; fn() { 1 };";
+	lexer_t *lexer = source_lexer(input);
+	parser_t *parser = new_parser(lexer);
+	program_t *program = parse_program(parser);
+	check_parser_errors(parser);
+
+	statement_t *named = program->statements->data[0];
+	statement_t *anonymous = program->statements->data[1];
+	char *name = (char *)named->value->function_literal.name;
+	assertf(strcmp(name, "add") == 0, "let bound literal should take its name. got=%s", name);
+	// Anonymous literals are named after where they start in the source
+	name = (char *)anonymous->value->function_literal.name;
+	assertf(strcmp(name, "fn@1:31") == 0, "wrong anonymous name. got=%s", name);
+}
+
+void test_source_positions(void) {
+	char *input = "let a = 1;\n\nlet b = \"x\ny\";\n  a + b;";
+	lexer_t *lexer = source_lexer(input);
+	parser_t *parser = new_parser(lexer);
+	program_t *program = parse_program(parser);
+	check_parser_errors(parser);
+
+	struct {
+		uint32_t line;
+		uint32_t column;
+	} expected[] = {{1, 1}, {3, 1}, {5, 3}};
+	for (int i = 0; i < sizeof(expected) / sizeof(expected[0]); i++){
+		statement_t *statement = program->statements->data[i];
+		source_position_t position = program_position(program, statement->token);
+		assertf(position.line == expected[i].line && position.column == expected[i].column,
+			"statement %d at wrong position. expected %u:%u, got %u:%u", i,
+			expected[i].line, expected[i].column, position.line, position.column);
+	}
+	// The right operand keeps its own token, so nodes inside a statement have positions too
+	statement_t *last = program->statements->data[2];
+	source_position_t position = program_position(program, last->value->infix_expression.right->token);
+	assertf(position.line == 5 && position.column == 7, "wrong operand position. got %u:%u", position.line, position.column);
+	// A span past the end can't be from this program's source
+	position = program_position(program, new_token(IDENT, 1000, 1));
+	assertf(position.line == 0, "token past the end should have no position");
+	free_program(program);
+	free_parser(parser);
+	free_lexer(lexer);
+
+	lexer = source_lexer("let x = 1;\nlet = 2;");
+	parser = new_parser(lexer);
+	program = parse_program(parser);
+	assertf(parser->errors->count > 0, "expected a parser error");
+	char *error = parser->errors->data[0];
+	assertf(strcmp(error, "2:5: expected next token to be IDENT, got ASSIGN instead") == 0, "wrong error. got=%s", error);
+	free_program(program);
+	free_parser(parser);
+	free_lexer(lexer);
+}
+
 int main(int argc, char *argv[]) {
 	TEST(test_let_statements);
 	TEST(test_return_statements);
@@ -843,6 +934,8 @@ int main(int argc, char *argv[]) {
 	TEST(test_if_expression);
 	TEST(test_if_else_expression);
 	TEST(test_function_literal_parsing);
+	TEST(test_function_literal_names);
+	TEST(test_source_positions);
 	TEST(test_call_expression_parsing);
 	TEST(test_string_literal_expression);
 	TEST(test_array_literal_expression);
@@ -850,4 +943,5 @@ int main(int argc, char *argv[]) {
 	TEST(test_hash_literal_string_keys);
 	TEST(test_empty_hash_literal);
 	TEST(test_hash_literal_with_expressions);
+	TEST(test_program_owns_its_nodes);
 }
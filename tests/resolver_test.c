@@ -0,0 +1,120 @@
+#include "test_helpers.h"
+#include "../src/environment.h"
+#include "../src/evaluator.h"
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "../src/resolver.h"
+
+program_t *parse_input(char *input) {
+        lexer_t *lexer = new_lexer(input);
+        parser_t *parser = new_parser(lexer);
+        return parse_program(parser);
+}
+
+void test_identifiers_get_depth_and_slot() {
+        program_t *program = parse_input("let a = 1; let f = fn(x, y) { let z = x; fn() { a + y + z } };");
+        environment_t *env = new_environment();
+        resolve_program(program, env);
+
+        statement_t *let_a = program->statements->data[0];
+        statement_t *let_f = program->statements->data[1];
+        assertf(let_a->name.slot == 0 && let_f->name.slot == 1,
+                "wrong global slots. a=%d, f=%d", let_a->name.slot, let_f->name.slot);
+
+        expression_t *outer = let_f->value;
+        assertf(outer->function_literal.num_locals == 3,
+                "wrong frame size. got=%d, want=3", outer->function_literal.num_locals);
+        assertf(outer->function_literal.frame_escapes,
+                "frame captured by an inner function should escape");
+
+        statement_t *let_z = outer->function_literal.body->statements->data[0];
+        assertf(let_z->name.depth == 0 && let_z->name.slot == 2,
+                "wrong slot for z. got=(%d, %d)", let_z->name.depth, let_z->name.slot);
+        expression_t *x = let_z->value;
+        assertf(x->ident.depth == 0 && x->ident.slot == 0,
+                "wrong slot for x. got=(%d, %d)", x->ident.depth, x->ident.slot);
+
+        statement_t *inner_statement = outer->function_literal.body->statements->data[1];
+        expression_t *inner = inner_statement->value;
+        // a + y + z parses as (a + y) + z
+        statement_t *sum_statement = inner->function_literal.body->statements->data[0];
+        expression_t *sum = sum_statement->value;
+        expression_t *z = sum->infix_expression.right;
+        expression_t *y = sum->infix_expression.left->infix_expression.right;
+        expression_t *a = sum->infix_expression.left->infix_expression.left;
+        assertf(!inner->function_literal.frame_escapes,
+                "frame without closures should not escape");
+        assertf(z->ident.depth == 1 && z->ident.slot == 2,
+                "wrong slot for z. got=(%d, %d)", z->ident.depth, z->ident.slot);
+        assertf(y->ident.depth == 1 && y->ident.slot == 1,
+                "wrong slot for y. got=(%d, %d)", y->ident.depth, y->ident.slot);
+        assertf(a->ident.depth == 2 && a->ident.slot == 0,
+                "wrong slot for a. got=(%d, %d)", a->ident.depth, a->ident.slot);
+}
+
+void test_scoping_matches_dynamic_lookup() {
+        struct {
+                char *input;
+                int expected;
+        } tests[] = {
+                {"let x = 5; let f = fn() { let x = x + 1; x }; f() + x;", 11},
+                {"let f = fn() { let g = fn(n) { if (n == 0) { 0 } else { 1 + g(n - 1) } }; g(4) }; f();", 4},
+                {"let f = fn() { let get = fn() { later }; let later = 7; get() }; f();", 7},
+                {"let f = fn() { g() }; let g = fn() { 3 }; f();", 3},
+                {"let x = 1; let x = x + 1; x;", 2},
+                {"let counter = fn(x) { fn(y) { fn(z) { x + y + z } } }; counter(1)(2)(3);", 6},
+                {"let f = fn(a) { if (a > 0) { let b = a * 2; b } else { a } }; f(4);", 8},
+        };
+
+        for (int i = 0; i < ARRAY_SIZE(tests); i++) {
+                environment_t *env = new_environment();
+                value_t evaluated = eval(parse_input(tests[i].input), NODE_PROGRAM, env);
+                assertf(value_is_int(evaluated) && value_as_int(evaluated) == tests[i].expected,
+                        "wrong result for '%s'. got=%s %d, want=%d", tests[i].input,
+                        object_type_to_string(value_type(evaluated)), value_as_int(evaluated), tests[i].expected);
+        }
+}
+
+void test_globals_persist_across_programs() {
+        environment_t *env = new_environment();
+        eval(parse_input("let double = fn(x) { x * 2 };"), NODE_PROGRAM, env);
+        eval(parse_input("let n = 21;"), NODE_PROGRAM, env);
+        value_t evaluated = eval(parse_input("double(n)"), NODE_PROGRAM, env);
+        assertf(value_is_int(evaluated) && value_as_int(evaluated) == 42,
+                "globals from earlier programs were not visible");
+
+        evaluated = eval(parse_input("missing"), NODE_PROGRAM, env);
+        assertf(value_is(evaluated, OBJECT_ERROR)
+                && strcmp(value_as_object(evaluated)->error_message->data, "1:1: identifier not found: missing") == 0,
+                "expected identifier not found error");
+}
+
+void test_marks_tail_calls() {
+        program_t *program = parse_input(
+                "let f = fn(n) { if (n) { return f(n); }; let x = f(n); f(n) + 1; if (n) { f(n) } else { f(n) } };");
+        resolve_program(program, new_environment());
+
+        statement_t *let_f = program->statements->data[0];
+        vector_t *body = let_f->value->function_literal.body->statements;
+        statement_t *early_if = body->data[0];
+        statement_t *early_return = early_if->value->if_expression.consequence->statements->data[0];
+        assertf(early_return->value->call_expression.tail, "returned call should be a tail call");
+
+        statement_t *let_x = body->data[1];
+        assertf(!let_x->value->call_expression.tail, "bound call is not a tail call");
+        statement_t *sum = body->data[2];
+        assertf(!sum->value->infix_expression.left->call_expression.tail, "operand call is not a tail call");
+
+        statement_t *last_if = body->data[3];
+        statement_t *then = last_if->value->if_expression.consequence->statements->data[0];
+        statement_t *otherwise = last_if->value->if_expression.alternative->statements->data[0];
+        assertf(then->value->call_expression.tail && otherwise->value->call_expression.tail,
+                "calls ending the function's last if should be tail calls");
+}
+
+int main(int argc, char *argv[]) {
+        TEST(test_identifiers_get_depth_and_slot);
+        TEST(test_scoping_matches_dynamic_lookup);
+        TEST(test_globals_persist_across_programs);
+        TEST(test_marks_tail_calls);
+}
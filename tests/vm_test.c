@@ -0,0 +1,255 @@
+#include "test_helpers.h"
+#include "../src/compiler.h"
+#include "../src/evaluator.h"
+#include "../src/lexer.h"
+#include "../src/parser.h"
+#include "../src/profiler.h"
+#include "../src/vm.h"
+
+value_t run_vm(char *input) {
+        lexer_t *lexer = new_lexer(input);
+        parser_t *parser = new_parser(lexer);
+        program_t *program = parse_program(parser);
+        compiler_t *compiler = new_compiler();
+        bool ok = compile_program(compiler, program);
+        assertf(ok, "compiler error for %s: %s", input, ok ? "" : (char *)compiler->errors->data[0]);
+
+        vm_t *vm = new_vm(compiler_bytecode(compiler));
+        value_t result = vm_run(vm);
+        free_vm(vm);
+        return result;
+}
+
+void check_integer(char *input, value_t got, int expected) {
+        assertf(value_is_int(got),
+                "%s: wrong type, expected OBJECT_INTEGER, got %s\n",
+                input, object_type_to_string(value_type(got)));
+        assertf(value_as_int(got) == expected,
+                "%s: wrong value, expected %d, got %d\n",
+                input, expected, value_as_int(got));
+}
+
+void check_boolean(char *input, value_t got, bool expected) {
+        assertf(value_is_bool(got),
+                "%s: wrong type, expected OBJECT_BOOLEAN, got %s\n",
+                input, object_type_to_string(value_type(got)));
+        assertf(value_as_bool(got) == expected,
+                "%s: wrong value, expected %d, got %d\n",
+                input, expected, value_as_bool(got));
+}
+
+void test_integer_arithmetic() {
+        struct {
+                char *input;
+                int expected;
+        } tests[] = {
+                {"1", 1},
+                {"1 + 2", 3},
+                {"1 - 2", -1},
+                {"50 / 2 * 2 + 10 - 5", 55},
+                {"5 * (2 + 10)", 60},
+                {"-50 + 100 + -50", 0},
+                {"(5 + 10 * 2 + 15 / 3) * 2 + -10", 50},
+        };
+
+        for (int i = 0; i < sizeof(tests)/sizeof(tests[0]); i++) {
+                check_integer(tests[i].input, run_vm(tests[i].input), tests[i].expected);
+        }
+}
+
+void test_boolean_expressions() {
+        struct {
+                char *input;
+                bool expected;
+        } tests[] = {
+                {"true", true},
+                {"false", false},
+                {"1 < 2", true},
+                {"1 > 2", false},
+                {"1 == 1", true},
+                {"1 != 2", true},
+                {"true == false", false},
+                {"(1 < 2) == true", true},
+                {"!true", false},
+                {"!!5", true},
+                {"!(if (false) { 5; })", true},
+        };
+
+        for (int i = 0; i < sizeof(tests)/sizeof(tests[0]); i++) {
+                check_boolean(tests[i].input, run_vm(tests[i].input), tests[i].expected);
+        }
+}
+
+void test_conditionals() {
+        struct {
+                char *input;
+                int expected;
+                bool is_null;
+        } tests[] = {
+                {"if (true) { 10 }", 10, false},
+                {"if (1) { 10 }", 10, false},
+                {"if (1 > 2) { 10 } else { 20 }", 20, false},
+                {"if (1 > 2) { 10 }", 0, true},
+                {"if ((if (false) { 10 })) { 10 } else { 20 }", 20, false},
+        };
+
+        for (int i = 0; i < sizeof(tests)/sizeof(tests[0]); i++) {
+                value_t got = run_vm(tests[i].input);
+                if (tests[i].is_null) {
+                        assertf(value_is_null(got), "%s: expected null, got %s",
+                                tests[i].input, object_type_to_string(value_type(got)));
+                } else {
+                        check_integer(tests[i].input, got, tests[i].expected);
+                }
+        }
+}
+
+void test_global_let_statements() {
+        check_integer("let one = 1; one", run_vm("let one = 1; one"), 1);
+        check_integer("let one = 1; let two = one + one; one + two",
+                      run_vm("let one = 1; let two = one + one; one + two"), 3);
+}
+
+void test_forward_references() {
+        char *input = "let even = fn(n) { if (n == 0) { true } else { odd(n - 1) } };"
+                      "let odd = fn(n) { if (n == 0) { false } else { even(n - 1) } }; even(10)";
+        check_boolean(input, run_vm(input), true);
+        input = "let even = fn(n) { if (n == 0) { true } else { odd(n - 1) } };"
+                "let odd = fn(n) { if (n == 0) { false } else { even(n - 1) } }; odd(7)";
+        check_boolean(input, run_vm(input), true);
+        input = "let get = fn() { later * 2 }; let later = 21; get()";
+        check_integer(input, run_vm(input), 42);
+}
+
+void test_strings_arrays_and_hashes() {
+        value_t got = run_vm("\"mon\" + \"key\" + \"banana\"");
+        assertf(value_is(got, OBJECT_STRING)
+                && strcmp(value_as_object(got)->string_literal->data, "monkeybanana") == 0,
+                "wrong string result");
+
+        got = run_vm("[1, 2 * 2, 3 + 3]");
+        assertf(value_is(got, OBJECT_ARRAY) && value_as_object(got)->array.count == 3,
+                "wrong array result");
+        check_integer("[1, 2 * 2, 3 + 3][1]", array_get(&value_as_object(got)->array, 1), 4);
+
+        check_integer("[1, 2, 3][1 + 1]", run_vm("[1, 2, 3][1 + 1]"), 3);
+        check_integer("{1: 1, 2: 2}[2]", run_vm("{1: 1, 2: 2}[2]"), 2);
+        got = run_vm("[1, 2, 3][99]");
+        assertf(value_is_null(got), "out of range index should be null");
+        got = run_vm("{}[0]");
+        assertf(value_is_null(got), "missing key should be null");
+}
+
+void test_functions_and_closures() {
+        struct {
+                char *input;
+                int expected;
+        } tests[] = {
+                {"let fivePlusTen = fn() { 5 + 10; }; fivePlusTen();", 15},
+                {"let earlyExit = fn() { return 99; 100; }; earlyExit();", 99},
+                {"let sum = fn(a, b) { let c = a + b; c; }; sum(1, 2) + sum(3, 4);", 10},
+                {"let globalNum = 10; let sum = fn(a, b) { let c = a + b; c + globalNum; };"
+                 "let outer = fn() { sum(1, 2) + sum(3, 4) + globalNum; }; outer() + globalNum;", 50},
+                {"let newAdder = fn(a, b) { fn(c) { a + b + c }; }; let adder = newAdder(1, 2); adder(8);", 11},
+                {"let newClosure = fn(a) { fn() { a; }; }; let closure = newClosure(99); closure();", 99},
+                {"let fibonacci = fn(x) { if (x == 0) { return 0; } else { if (x == 1) { return 1; }"
+                 " else { fibonacci(x - 1) + fibonacci(x - 2); } } }; fibonacci(15);", 610},
+                {"let wrapper = fn() { let countDown = fn(x) { if (x == 0) { return 0; } else { countDown(x - 1); } };"
+                 " countDown(1); }; wrapper();", 0},
+                {"return 10; 9;", 10},
+        };
+
+        for (int i = 0; i < sizeof(tests)/sizeof(tests[0]); i++) {
+                check_integer(tests[i].input, run_vm(tests[i].input), tests[i].expected);
+        }
+}
+
+void test_tail_calls() {
+        struct {
+                char *input;
+                int expected;
+        } tests[] = {
+                // Deeper than MAX_FRAMES, so each call has to reuse its caller's frame
+                {"let count = fn(n, acc) { if (n == 0) { acc } else { count(n - 1, acc + 1) } }; count(5000, 0);", 5000},
+                {"let count = fn(n, acc) { if (n > 0) { count(n - 1, acc + 1) } else { acc } }; count(5000, 0);", 5000},
+                {"let count = fn(n) { if (n == 0) { return 7; } return count(n - 1); }; count(5000);", 7},
+                // Through a second function, whose callee needs more locals than it had arguments
+                {"let g = fn(x, f) { f(x) };"
+                 "let f = fn(n) { if (n == 0) { 0 } else { let a = n; let b = a - 1; g(b, f) } }; f(5000);", 0},
+                {"let sum = fn(n) { if (n == 0) { 0 } else { n + sum(n - 1) } }; sum(100);", 5050},
+        };
+
+        for (int i = 0; i < sizeof(tests)/sizeof(tests[0]); i++) {
+                check_integer(tests[i].input, run_vm(tests[i].input), tests[i].expected);
+        }
+
+        value_t got = run_vm("let sum = fn(n) { if (n == 0) { 0 } else { n + sum(n - 1) } }; sum(5000);");
+        assertf(value_is(got, OBJECT_ERROR), "expected calls outside tail position to overflow");
+}
+
+void test_builtin_functions() {
+        check_integer("len(\"four\")", run_vm("len(\"four\")"), 4);
+        check_integer("len([1, 2, 3])", run_vm("len([1, 2, 3])"), 3);
+        check_integer("first([1, 2, 3])", run_vm("first([1, 2, 3])"), 1);
+        check_integer("last(push([1], 2))", run_vm("last(push([1], 2))"), 2);
+        check_integer("len(rest([1, 2, 3]))", run_vm("len(rest([1, 2, 3]))"), 2);
+        char *input = "let h = {1: 1}; let g = delete(set(h, 2, 2), 1); h[1] + g[2]";
+        check_integer(input, run_vm(input), 3);
+}
+
+void test_runtime_errors() {
+        struct {
+                char *input;
+                char *expected_message;
+        } tests[] = {
+                {"5 + true;", "1:3: type mismatch: OBJECT_INTEGER + OBJECT_BOOLEAN"},
+                {"5 + true; 5;", "1:3: type mismatch: OBJECT_INTEGER + OBJECT_BOOLEAN"},
+                {"-true", "1:1: unknown operator: -OBJECT_BOOLEAN "},
+                {"true + false;", "1:6: unknown operator: OBJECT_BOOLEAN + OBJECT_BOOLEAN"},
+                {"\"Hello\" - \"World\"", "1:9: unknown operator: OBJECT_STRING - OBJECT_STRING"},
+                {"{\"name\": \"Monkey\"}[fn(x) { x }];", "1:19: unuseable as hash key: OBJECT_CLOSURE"},
+                {"fn(a) { a; }();", "1:13: wrong number of arguments"},
+                {"1();", "1:2: not a function"},
+                // Declared by the later let, but read before it runs
+                {"let f = fn() { later }; f(); let later = 1;", "1:16: identifier not found: later"},
+                // Errors inside a function point into its body
+                {"let f = fn() {\n  1 + true\n};\nf();", "2:5: type mismatch: OBJECT_INTEGER + OBJECT_BOOLEAN"},
+        };
+
+        for (int i = 0; i < sizeof(tests)/sizeof(tests[0]); i++) {
+                value_t got = run_vm(tests[i].input);
+                assertf(value_is(got, OBJECT_ERROR), "%s: expected error, got %s",
+                        tests[i].input, object_type_to_string(value_type(got)));
+                assertf(strcmp(value_as_object(got)->error_message->data, tests[i].expected_message) == 0,
+                        "%s: wrong error message, expected %s, got %s",
+                        tests[i].input, tests[i].expected_message, value_as_object(got)->error_message->data);
+        }
+}
+
+void test_profiler_shadow_stack() {
+        // Pushes without the sampling timer, only the bookkeeping is under test
+        profiler.enabled = true;
+        check_integer("nested calls", run_vm("let inner = fn(x) { x }; let outer = fn(x) { inner(x) + 1 }; outer(1)"), 2);
+        assertf(profiler.depth == 0, "calls left frames on the shadow stack. depth=%d", (int)profiler.depth);
+        check_integer("tail calls", run_vm("let f = fn(n) { if (n == 0) { 0 } else { f(n - 1) } }; f(10)"), 0);
+        assertf(profiler.depth == 0, "tail calls left frames on the shadow stack. depth=%d", (int)profiler.depth);
+
+        value_t got = run_vm("let fail = fn() { 1 + true }; let outer = fn() { fail() }; outer()");
+        assertf(value_is(got, OBJECT_ERROR), "expected an error");
+        assertf(profiler.depth == 0, "error left frames on the shadow stack. depth=%d", (int)profiler.depth);
+        profiler.enabled = false;
+}
+
+int main(int argc, char *argv[]) {
+        TEST(test_integer_arithmetic);
+        TEST(test_boolean_expressions);
+        TEST(test_conditionals);
+        TEST(test_global_let_statements);
+        TEST(test_forward_references);
+        TEST(test_strings_arrays_and_hashes);
+        TEST(test_functions_and_closures);
+        TEST(test_tail_calls);
+        TEST(test_builtin_functions);
+        TEST(test_runtime_errors);
+        TEST(test_profiler_shadow_stack);
+}